@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define NUM_ARGS 100000 /* ~1.5MB of strings and pointers */
+
+/**
+ * Re-exec ourselves with NUM_ARGS arguments, the child checks they all
+ * arrived intact.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    char **bigargv, *strs;
+    int i;
+
+    if(argc > 1) {
+        /* We are the exec'd image */
+        for(i = 1; i < argc; i++) {
+            if(atoi(argv[i]) != i) {
+                printf("argshuge: argv[%d] is '%s'\n", i, argv[i]);
+                return 1;
+            }
+        }
+        printf("argshuge: received %d args intact\n", argc);
+        return 0;
+    }
+
+    bigargv = malloc((NUM_ARGS + 1) * sizeof(char *));
+    strs = malloc(NUM_ARGS * 8);
+    if(!bigargv || !strs) {
+        printf("argshuge: malloc: %s\n", strerror(errno));
+        return 1;
+    }
+    bigargv[0] = argv[0];
+    for(i = 1; i < NUM_ARGS; i++) {
+        bigargv[i] = strs + i * 8;
+        snprintf(bigargv[i], 8, "%d", i);
+    }
+    bigargv[NUM_ARGS] = NULL;
+
+    execve(argv[0], bigargv, envp);
+    printf("argshuge: execve: %s\n", strerror(errno));
+    return 1;
+}
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <syscall.h>
+#include <sys/bench.h>
+
+#define NUM_READS   1000000
+
+/**
+ * Read the clock nreads times, through libc or straight through the
+ * system call, and print how long one read took. Fails if the clock ever
+ * went backwards.
+ */
+static int measure(const char *what, int nreads, int use_syscall) {
+    struct timespec ts;
+    uint64_t start, ns, t, last = 0;
+    int i;
+
+    start = now_ns();
+    for(i = 0; i < nreads; i++) {
+        if(use_syscall)
+            syscall_2(SYS_clock_gettime, CLOCK_MONOTONIC, (uint64_t)&ts);
+        else
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+        t = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        if(t < last) {
+            printf("clockbench: %s: went back %lu ns\n", what, last - t);
+            return 1;
+        }
+        last = t;
+    }
+    ns = now_ns() - start;
+    printf("clockbench: %s: %d reads in %lu us, %lu ns each\n", what, nreads,
+           ns / 1000, ns / nreads);
+    return 0;
+}
+
+/**
+ * Compare clock_gettime(), which reads the kernel's time page, with the
+ * clock_gettime system call it replaces.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    struct timespec ts;
+    int nreads = NUM_READS, err = 0;
+
+    if(argc > 1)
+        nreads = atoi(argv[1]);
+    if(nreads <= 0) {
+        printf("usage: clockbench [NUM_READS]\n");
+        return 1;
+    }
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+        printf("clockbench: clock_gettime: %s\n", strerror(errno));
+        return 1;
+    }
+    err |= measure("time page", nreads, 0);
+    err |= measure("syscall", nreads, 1);
+    return err;
+}
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/bench.h>
+#include <sys/wait.h>
+
+#define NUM_EXITS   50
+#define PAGE_SIZE   4096
+
+/**
+ * Fork a child that touches kb KB of fresh memory and exits, NUM_EXITS
+ * times, printing how long it took from the child's exit() until the
+ * parent returned from waitpid(), on average and in the worst case.
+ * The child sends the time it read just before exiting through a pipe.
+ */
+static int measure(size_t kb) {
+    uint64_t stamp, lat, total = 0, worst = 0;
+    int fds[2], i, status;
+    size_t off;
+    char *mem;
+    pid_t pid;
+
+    if(pipe(fds) < 0) {
+        printf("exitlat: pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    for(i = 0; i < NUM_EXITS; i++) {
+        pid = fork();
+        if(pid == 0) {
+            close(fds[0]);
+            mem = malloc(kb * 1024 + 1);
+            if(!mem)
+                exit(1);
+            for(off = 0; off < kb * 1024; off += PAGE_SIZE)
+                mem[off] = 1;
+            stamp = now_ns();
+            write(fds[1], &stamp, sizeof(stamp));
+            exit(0);
+        } else if(pid < 0) {
+            printf("exitlat: fork: %s\n", strerror(errno));
+            return 1;
+        }
+        if(read(fds[0], &stamp, sizeof(stamp)) != sizeof(stamp)) {
+            printf("exitlat: child %d sent no timestamp\n", pid);
+            return 1;
+        }
+        if(waitpid(pid, &status, 0) != pid || status) {
+            printf("exitlat: child %d failed\n", pid);
+            return 1;
+        }
+        lat = now_ns() - stamp;
+        total += lat;
+        if(lat > worst)
+            worst = lat;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    printf("exitlat: %lu KB: exit to waitpid avg %lu us, max %lu us\n", kb,
+           total / NUM_EXITS / 1000, worst / 1000);
+    return 0;
+}
+
+/**
+ * Report the latency from a child's exit until its parent is woken, for
+ * children with growing address spaces. Freeing the address space is
+ * deferred to a kworker, so it should not grow with the size.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    size_t sizes[] = {0, 1024, 8192, 32768};
+    int i, err = 0;
+
+    for(i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+        err |= measure(sizes[i]);
+    return err;
+}
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/bench.h>
+#include <sys/schedclass.h>
+
+#define MAX_LOOPS 4   /* at nice 0, 5, 10, 15 */
+#define RUN_SECS  5
+
+/**
+ * Spin like bin/loop until the deadline, counting iterations.
+ * Sends {id, count} to the parent.
+ */
+static void spin(int fd, int id, uint64_t deadline) {
+    uint64_t msg[2] = {id, 0};
+
+    nice(id * 5);
+    while(now_ns() < deadline)
+        msg[1]++;
+    write(fd, msg, sizeof(msg));
+    exit(0);
+}
+
+/**
+ * Run N spinning tasks at nice 0, 5, 10, ... under CFS and report the share
+ * of the CPU each one got. Each 5 nice levels should be ~3x less CPU.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    uint64_t count[MAX_LOOPS] = {0}, msg[2], total = 0, deadline;
+    int pipefd[2], n = 4, orig, i;
+
+    if(argc > 1)
+        n = atoi(argv[1]);
+    if(n <= 0 || n > MAX_LOOPS) {
+        printf("usage: fairness [NUM_LOOPS <= %d]\n", MAX_LOOPS);
+        return 1;
+    }
+    if(pipe(pipefd) < 0) {
+        printf("fairness: pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    orig = schedclass(SCHED_CLASS_CFS);
+    if(orig < 0) {
+        printf("fairness: schedclass: %s\n", strerror(errno));
+        return 1;
+    }
+
+    deadline = now_ns() + RUN_SECS * 1000000000UL;
+
+    for(i = 0; i < n; i++) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            spin(pipefd[1], i, deadline);
+        } else if(pid < 0) {
+            printf("fairness: fork: %s\n", strerror(errno));
+            n = i;
+            break;
+        }
+    }
+    close(pipefd[1]);
+
+    /* Results arrive in the order the loops finish */
+    for(i = 0; i < n; i++) {
+        if(read(pipefd[0], msg, sizeof(msg)) != sizeof(msg) || msg[0] >= n)
+            break;
+        count[msg[0]] = msg[1];
+        total += msg[1];
+    }
+    while(waitpid(-1, NULL, 0) > 0) {}
+    schedclass(orig);
+
+    for(i = 0; i < n; i++) {
+        printf("fairness: nice %d: %lu iterations, %lu%%\n", i * 5,
+               count[i], total? count[i] * 100 / total : 0);
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/bench.h>
+#include <sys/futex.h>
+
+#define MAX_THREADS     16
+#define LOCK_ITERS      20000   /* lock/unlock pairs per thread */
+#define SOLO_ITERS      1000000
+#define PINGPONG_ITERS  10000
+
+/*
+ * The two locks compared: a futex pthread mutex, and a pipe holding one
+ * token that a locker reads and an unlocker writes back, the way user
+ * space had to block before futex(2).
+ */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static int lockpipe[2];
+static long counter;
+
+static void pipe_lock(void) {
+    char c;
+    read(lockpipe[0], &c, 1);
+}
+
+static void pipe_unlock(void) {
+    write(lockpipe[1], "t", 1);
+}
+
+static void *count_mutex(void *arg) {
+    int i;
+
+    for(i = 0; i < LOCK_ITERS; i++) {
+        pthread_mutex_lock(&mutex);
+        counter++;
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+static void *count_pipe(void *arg) {
+    int i;
+
+    for(i = 0; i < LOCK_ITERS; i++) {
+        pipe_lock();
+        counter++;
+        pipe_unlock();
+    }
+    return NULL;
+}
+
+/**
+ * Run n threads of fn incrementing counter under a lock and print the
+ * nanoseconds per lock/unlock pair.
+ * @return: 0 if no increment was lost
+ */
+static int contend(const char *name, int n, void *(*fn)(void *)) {
+    pthread_t threads[MAX_THREADS];
+    uint64_t start, ns;
+    int i, started = 0;
+
+    counter = 0;
+    start = now_ns();
+    for(i = 0; i < n; i++) {
+        if(pthread_create(&threads[i], NULL, fn, NULL))
+            break;
+        started++;
+    }
+    for(i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    ns = now_ns() - start;
+    printf("futexbench: %s, %d threads: %lu ns per lock\n", name, n,
+           ns / ((uint64_t)n * LOCK_ITERS));
+    if(started != n || counter != (long)n * LOCK_ITERS) {
+        printf("futexbench: %s: counter %ld, expected %ld\n", name, counter,
+               (long)n * LOCK_ITERS);
+        return 1;
+    }
+    return 0;
+}
+
+/* Ping-pong between two threads, with a condition variable and pipes */
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static volatile int turn;
+static int ping[2], pong[2];
+
+static void *pong_cond(void *arg) {
+    int i;
+
+    pthread_mutex_lock(&mutex);
+    for(i = 0; i < PINGPONG_ITERS; i++) {
+        while(turn != 1)
+            pthread_cond_wait(&cond, &mutex);
+        turn = 0;
+        pthread_cond_signal(&cond);
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+static void *pong_pipe(void *arg) {
+    char c;
+    int i;
+
+    for(i = 0; i < PINGPONG_ITERS; i++) {
+        read(ping[0], &c, 1);
+        write(pong[1], &c, 1);
+    }
+    return NULL;
+}
+
+static uint64_t pingpong_cond(void) {
+    uint64_t start;
+    pthread_t t;
+    int i;
+
+    turn = 0;
+    if(pthread_create(&t, NULL, pong_cond, NULL))
+        return 0;
+    start = now_ns();
+    pthread_mutex_lock(&mutex);
+    for(i = 0; i < PINGPONG_ITERS; i++) {
+        turn = 1;
+        pthread_cond_signal(&cond);
+        while(turn != 0)
+            pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+    pthread_join(t, NULL);
+    return (now_ns() - start) / PINGPONG_ITERS;
+}
+
+static uint64_t pingpong_pipe(void) {
+    uint64_t start;
+    pthread_t t;
+    char c = 'p';
+    int i;
+
+    if(pthread_create(&t, NULL, pong_pipe, NULL))
+        return 0;
+    start = now_ns();
+    for(i = 0; i < PINGPONG_ITERS; i++) {
+        write(ping[1], &c, 1);
+        read(pong[0], &c, 1);
+    }
+    pthread_join(t, NULL);
+    return (now_ns() - start) / PINGPONG_ITERS;
+}
+
+/**
+ * Check the futex syscall's own semantics: a wrong value does not sleep,
+ * and a timeout ends a wait nobody wakes.
+ */
+static int check_futex(void) {
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = 20000000 };
+    uint32_t word = 1;
+    int err = 0;
+
+    if(futex(&word, FUTEX_WAIT, 0, NULL) != -1 || errno != EAGAIN) {
+        printf("futexbench: FUTEX_WAIT on a changed value slept\n");
+        err = 1;
+    }
+    if(futex(&word, FUTEX_WAIT, 1, &ts) != -1 || errno != ETIMEDOUT) {
+        printf("futexbench: FUTEX_WAIT did not time out\n");
+        err = 1;
+    }
+    if(futex(&word, FUTEX_WAKE, 1, NULL) != 0) {
+        printf("futexbench: FUTEX_WAKE woke a task that was not waiting\n");
+        err = 1;
+    }
+    return err;
+}
+
+/**
+ * Compare a futex mutex with a pipe used as a lock, uncontended and with
+ * 1, 2, 4, ... threads fighting for it, then compare waking a thread with
+ * a condition variable and with a pipe.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    uint64_t start, ns;
+    int max = 4, n, i, err = 0;
+
+    if(argc > 1)
+        max = atoi(argv[1]);
+    if(max < 1 || max > MAX_THREADS) {
+        printf("usage: futexbench [MAX_THREADS <= %d]\n", MAX_THREADS);
+        return 1;
+    }
+    if(pipe(lockpipe) < 0 || pipe(ping) < 0 || pipe(pong) < 0) {
+        printf("futexbench: pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    pipe_unlock(); /* the token */
+
+    err |= check_futex();
+
+    /* Uncontended, the mutex never enters the kernel */
+    start = now_ns();
+    for(i = 0; i < SOLO_ITERS; i++) {
+        pthread_mutex_lock(&mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+    ns = now_ns() - start;
+    printf("futexbench: uncontended mutex: %lu ns per lock\n",
+           ns / SOLO_ITERS);
+    start = now_ns();
+    for(i = 0; i < SOLO_ITERS / 100; i++) {
+        pipe_lock();
+        pipe_unlock();
+    }
+    ns = now_ns() - start;
+    printf("futexbench: uncontended pipe: %lu ns per lock\n",
+           ns / (SOLO_ITERS / 100));
+
+    for(n = 1; n <= max; n *= 2) {
+        err |= contend("mutex", n, count_mutex);
+        err |= contend("pipe", n, count_pipe);
+    }
+
+    ns = pingpong_cond();
+    printf("futexbench: condvar ping-pong %lu, ", ns);
+    printf("pipe ping-pong %lu ns per round trip\n", pingpong_pipe());
+
+    printf("futexbench: %s\n", err? "FAILED" : "passed");
+    return err;
+}
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/bench.h>
+
+#define MAX_SIZE    (1024 * 1024)
+#define TOTAL_BYTES (64UL * 1024 * 1024)  /* copied per size and routine */
+#define CHECK_ITERS 20000000UL
+
+/**
+ * True if the CPU has AVX and the kernel enabled the YMM state in XCR0.
+ */
+static int avx_usable(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    __asm__ __volatile__ ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                          : "a"(1), "c"(0));
+    /* AVX and OSXSAVE */
+    if(((ecx >> 28) & 1) == 0 || ((ecx >> 27) & 1) == 0)
+        return 0;
+    __asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (eax & 0x6) == 0x6;
+}
+
+/**
+ * Copy 64 bytes at a time through four XMM registers.
+ */
+static void *sse2_memcpy(void *dest, const void *src, size_t n) {
+    char *d = dest;
+    const char *s = src;
+
+    for(; n >= 64; n -= 64, d += 64, s += 64) {
+        __asm__ __volatile__ (
+            "movdqu   (%1), %%xmm0;"
+            "movdqu 16(%1), %%xmm1;"
+            "movdqu 32(%1), %%xmm2;"
+            "movdqu 48(%1), %%xmm3;"
+            "movdqu %%xmm0,   (%0);"
+            "movdqu %%xmm1, 16(%0);"
+            "movdqu %%xmm2, 32(%0);"
+            "movdqu %%xmm3, 48(%0);"
+            :: "r"(d), "r"(s) : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+    }
+    memcpy(d, s, n);
+    return dest;
+}
+
+/**
+ * Copy 128 bytes at a time through four YMM registers.
+ */
+static void *avx_memcpy(void *dest, const void *src, size_t n) {
+    char *d = dest;
+    const char *s = src;
+
+    for(; n >= 128; n -= 128, d += 128, s += 128) {
+        __asm__ __volatile__ (
+            "vmovdqu   (%1), %%ymm0;"
+            "vmovdqu 32(%1), %%ymm1;"
+            "vmovdqu 64(%1), %%ymm2;"
+            "vmovdqu 96(%1), %%ymm3;"
+            "vmovdqu %%ymm0,   (%0);"
+            "vmovdqu %%ymm1, 32(%0);"
+            "vmovdqu %%ymm2, 64(%0);"
+            "vmovdqu %%ymm3, 96(%0);"
+            :: "r"(d), "r"(s) : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+    }
+    __asm__ __volatile__ ("vzeroupper" ::: "memory");
+    memcpy(d, s, n);
+    return dest;
+}
+
+struct copier {
+    const char *name;
+    void *(*copy)(void *, const void *, size_t);
+};
+
+/**
+ * Copy size bytes over and over, TOTAL_BYTES in all, and print the
+ * throughput in MB/s.
+ */
+static int bench(struct copier *c, char *dst, char *src, size_t size) {
+    uint64_t start, ns, iters = TOTAL_BYTES / size, i;
+
+    memset(dst, 0, size);
+    start = now_ns();
+    for(i = 0; i < iters; i++)
+        c->copy(dst, src, size);
+    ns = now_ns() - start;
+    if(memcmp(dst, src, size)) {
+        printf("memcpybench: %s: copy of %lu bytes is wrong\n", c->name, size);
+        return 1;
+    }
+    printf("memcpybench: %s %lu bytes: %lu MB/s\n", c->name,
+           size, TOTAL_BYTES * 1000 / (ns? ns : 1));
+    return 0;
+}
+
+/**
+ * Fill XMM0-XMM7 with val, spin long enough to be preempted by the other
+ * task a few times, and check the registers still hold val.
+ */
+static int check_xmm(uint32_t val) {
+    uint32_t out[8][4];
+    uint64_t iters = CHECK_ITERS;
+    int r, j;
+
+    /* One asm block, so the compiler can not use the registers meanwhile */
+    __asm__ __volatile__ (
+        "movd %2, %%xmm0; pshufd $0, %%xmm0, %%xmm0;"
+        "movdqa %%xmm0, %%xmm1; movdqa %%xmm0, %%xmm2; movdqa %%xmm0, %%xmm3;"
+        "movdqa %%xmm0, %%xmm4; movdqa %%xmm0, %%xmm5; movdqa %%xmm0, %%xmm6;"
+        "movdqa %%xmm0, %%xmm7;"
+        "1: pause; decq %0; jnz 1b;"
+        "movdqu %%xmm0,    (%1); movdqu %%xmm1,  16(%1);"
+        "movdqu %%xmm2,  32(%1); movdqu %%xmm3,  48(%1);"
+        "movdqu %%xmm4,  64(%1); movdqu %%xmm5,  80(%1);"
+        "movdqu %%xmm6,  96(%1); movdqu %%xmm7, 112(%1);"
+        : "+r"(iters)
+        : "r"(out), "r"(val)
+        : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+          "xmm6", "xmm7");
+    for(r = 0; r < 8; r++) {
+        for(j = 0; j < 4; j++) {
+            if(out[r][j] != val)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Compare the scalar libc memcpy with SSE2 and AVX copies for a few sizes,
+ * then check that two tasks using the XMM registers at once do not see
+ * each other's values.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    struct copier copiers[] = {
+        {"scalar", memcpy},
+        {"sse2",   sse2_memcpy},
+        {"avx",    avx_memcpy},
+    };
+    size_t sizes[] = {4096, 64 * 1024, MAX_SIZE};
+    int ncopiers = avx_usable()? 3 : 2;
+    int i, j, status, err = 0;
+    char *src, *dst;
+    pid_t pid;
+
+    src = malloc(MAX_SIZE);
+    dst = malloc(MAX_SIZE);
+    if(!src || !dst) {
+        printf("memcpybench: malloc failed\n");
+        return 1;
+    }
+    for(i = 0; i < MAX_SIZE; i++)
+        src[i] = (char)(i * 7);
+
+    for(i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        for(j = 0; j < ncopiers; j++)
+            err |= bench(&copiers[j], dst, src, sizes[i]);
+    }
+    if(ncopiers < 3)
+        printf("memcpybench: no AVX\n");
+
+    pid = fork();
+    if(pid < 0) {
+        printf("memcpybench: fork: %s\n", strerror(errno));
+        return 1;
+    }
+    if(pid == 0)
+        exit(check_xmm(0xC0FFEE00));
+    err |= check_xmm(0x5EED0000);
+    waitpid(pid, &status, 0);
+    err |= status;
+    printf("memcpybench: XMM registers %s across task switches\n",
+           err? "CORRUPTED" : "preserved");
+    return err? 1 : 0;
+}
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/bench.h>
+#include <sys/wait.h>
+
+#define NUM_PROCS   10000
+#define PID_LIMIT   32768   /* PID_MAX of the kernel */
+
+/* One bit per PID, to catch a PID handed out twice */
+static uint64_t seen[PID_LIMIT / 64];
+
+static int test_and_set(pid_t pid) {
+    uint64_t bit = 1UL << (pid % 64);
+    int was_set = (seen[pid / 64] & bit) != 0;
+
+    seen[pid / 64] |= bit;
+    return was_set;
+}
+
+/**
+ * Fork and reap one child at a time until a PID is handed out twice,
+ * which must happen once the kernel wraps around.
+ * @return: the number of forks it took, or -1 on error
+ */
+static int pid_reuse(void) {
+    pid_t pid;
+    int i;
+
+    memset(seen, 0, sizeof(seen));
+    for(i = 0; i <= PID_LIMIT; i++) {
+        pid = fork();
+        if(pid == 0)
+            exit(0);
+        if(pid < 0) {
+            printf("pidstress: fork: %s\n", strerror(errno));
+            return -1;
+        }
+        if(waitpid(pid, NULL, 0) != pid) {
+            printf("pidstress: waitpid %d: %s\n", pid, strerror(errno));
+            return -1;
+        }
+        if(pid >= PID_LIMIT) {
+            printf("pidstress: PID %d is over the limit\n", pid);
+            return -1;
+        }
+        if(test_and_set(pid))
+            return i + 1;
+    }
+    printf("pidstress: no PID reused after %d forks\n", i);
+    return -1;
+}
+
+/**
+ * Run nprocs processes at once, all blocked reading a pipe, then time
+ * looking each one up with kill(pid, 0) and reaping them with waitpid.
+ * Every child exits with its PID's low bits so the parent can check it
+ * reaped the right one. Then check that the kernel reuses freed PIDs.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    int nprocs = NUM_PROCS, nforked, i, status, err = 0, forks;
+    uint64_t start, fork_ns, kill_ns, wait_ns;
+    pid_t *pids, pid;
+    int fds[2];
+    char c;
+
+    if(argc > 1)
+        nprocs = atoi(argv[1]);
+    if(nprocs <= 0 || nprocs >= PID_LIMIT) {
+        printf("usage: pidstress [NUM_PROCS < %d]\n", PID_LIMIT);
+        return 1;
+    }
+    pids = malloc(nprocs * sizeof(*pids));
+    if(!pids) {
+        printf("pidstress: malloc failed\n");
+        return 1;
+    }
+    if(pipe(fds) < 0) {
+        printf("pidstress: pipe: %s\n", strerror(errno));
+        return 1;
+    }
+
+    start = now_ns();
+    for(nforked = 0; nforked < nprocs; nforked++) {
+        pid = fork();
+        if(pid == 0) {
+            /* Block until the parent closes the write end */
+            close(fds[1]);
+            read(fds[0], &c, 1);
+            exit(getpid() & 0x7f);
+        } else if(pid < 0) {
+            printf("pidstress: fork %d: %s\n", nforked, strerror(errno));
+            err = 1;
+            break;
+        }
+        if(pid >= PID_LIMIT || test_and_set(pid)) {
+            printf("pidstress: bad or duplicate PID %d\n", pid);
+            err = 1;
+        }
+        pids[nforked] = pid;
+    }
+    fork_ns = now_ns() - start;
+    printf("pidstress: %d processes running\n", nforked + 1);
+
+    start = now_ns();
+    for(i = 0; i < nforked; i++) {
+        if(kill(pids[i], 0) < 0) {
+            printf("pidstress: kill %d: %s\n", pids[i], strerror(errno));
+            err = 1;
+        }
+    }
+    kill_ns = now_ns() - start;
+
+    /* Wake them all up, they exit in about the order they were forked */
+    close(fds[1]);
+    close(fds[0]);
+    start = now_ns();
+    for(i = 0; i < nforked; i++) {
+        pid = waitpid(-1, &status, 0);
+        if(pid < 0) {
+            printf("pidstress: waitpid: %s\n", strerror(errno));
+            err = 1;
+            break;
+        }
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != (pid & 0x7f)) {
+            printf("pidstress: child %d exited with %d\n", pid, status);
+            err = 1;
+        }
+    }
+    wait_ns = now_ns() - start;
+    if(waitpid(-1, &status, WNOHANG) != -1 || errno != ECHILD) {
+        printf("pidstress: children left after reaping %d\n", nforked);
+        err = 1;
+    }
+
+    if(nforked) {
+        printf("pidstress: fork %lu, kill(pid, 0) %lu, waitpid %lu ns each\n",
+               fork_ns / nforked, kill_ns / nforked, wait_ns / nforked);
+    }
+
+    forks = pid_reuse();
+    if(forks < 0)
+        err = 1;
+    else
+        printf("pidstress: a PID was reused after %d forks\n", forks);
+
+    printf("pidstress: %s\n", err? "FAILED" : "passed");
+    return err;
+}
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/bench.h>
+#include <sys/wait.h>
+#include <sys/schedstat.h>
+
+#define MAX_HOGS      16
+#define TOTAL_BYTES   (16UL * 1024 * 1024)
+#define CHUNK         4000    /* the kernel's pipe buffer size */
+#define NUM_ROUNDS    2000
+
+/**
+ * Stream TOTAL_BYTES from a child through a pipe, like ls | cat, and print
+ * the throughput in KB per millisecond.
+ */
+static int throughput(const char *what) {
+    static char buf[CHUNK];
+    uint64_t start, total = 0, us;
+    int fds[2], status;
+    ssize_t n;
+    pid_t pid;
+
+    if(pipe(fds) < 0) {
+        printf("pipebench: pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    start = now_ns();
+    pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        for(total = 0; total < TOTAL_BYTES; total += CHUNK) {
+            if(write(fds[1], buf, CHUNK) != CHUNK)
+                exit(1);
+        }
+        exit(0);
+    } else if(pid < 0) {
+        printf("pipebench: fork: %s\n", strerror(errno));
+        return 1;
+    }
+    close(fds[1]);
+    while((n = read(fds[0], buf, sizeof(buf))) > 0)
+        total += n;
+    us = (now_ns() - start) / 1000;
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    if(status || total < TOTAL_BYTES) {
+        printf("pipebench: only %lu bytes arrived\n", total);
+        return 1;
+    }
+    printf("pipebench: %s: %lu KB/ms\n", what, total / (us? us : 1) * 1000 / 1024);
+    return 0;
+}
+
+/**
+ * Bounce a byte between us and a child through two pipes NUM_ROUNDS
+ * times, and print the average round trip in microseconds.
+ */
+static int latency(const char *what) {
+    int to_child[2], to_parent[2], i, status;
+    uint64_t start, ns;
+    pid_t pid;
+    char c = 'x';
+
+    if(pipe(to_child) < 0 || pipe(to_parent) < 0) {
+        printf("pipebench: pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    pid = fork();
+    if(pid == 0) {
+        for(i = 0; i < NUM_ROUNDS; i++) {
+            if(read(to_child[0], &c, 1) != 1 || write(to_parent[1], &c, 1) != 1)
+                exit(1);
+        }
+        exit(0);
+    } else if(pid < 0) {
+        printf("pipebench: fork: %s\n", strerror(errno));
+        return 1;
+    }
+    start = now_ns();
+    for(i = 0; i < NUM_ROUNDS; i++) {
+        if(write(to_child[1], &c, 1) != 1 || read(to_parent[0], &c, 1) != 1) {
+            printf("pipebench: round %d failed\n", i);
+            break;
+        }
+    }
+    ns = now_ns() - start;
+    waitpid(pid, &status, 0);
+    close(to_child[0]);
+    close(to_child[1]);
+    close(to_parent[0]);
+    close(to_parent[1]);
+    if(i < NUM_ROUNDS || status)
+        return 1;
+    printf("pipebench: %s: round trip %lu us\n", what,
+           ns / NUM_ROUNDS / 1000);
+    return 0;
+}
+
+/**
+ * Measure pipe throughput and round trip latency on a quiet system, then
+ * with nhogs CPU hogs running. The kernel hands the CPU straight to the
+ * woken end of the pipe, so the hogs should cost little; compare with a
+ * kernel built with -DSCHED_HANDOFF=0. The number of handoffs comes from
+ * schedstat(2).
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    pid_t hogs[MAX_HOGS];
+    struct schedstat st;
+    uint64_t handoffs;
+    int nhogs = 4, i, err = 0;
+    char what[64];
+
+    if(argc > 1)
+        nhogs = atoi(argv[1]);
+    if(nhogs < 0 || nhogs > MAX_HOGS) {
+        printf("usage: pipebench [NUM_HOGS <= %d]\n", MAX_HOGS);
+        return 1;
+    }
+    if(schedstat(0, &st) < 0) {
+        printf("pipebench: schedstat: %s\n", strerror(errno));
+        return 1;
+    }
+    handoffs = st.handoffs;
+
+    err |= throughput("quiet");
+    err |= latency("quiet");
+
+    for(i = 0; i < nhogs; i++) {
+        hogs[i] = fork();
+        if(hogs[i] == 0) {
+            while(1)
+                ;
+        } else if(hogs[i] < 0) {
+            printf("pipebench: fork: %s\n", strerror(errno));
+            nhogs = i;
+            break;
+        }
+    }
+    snprintf(what, sizeof(what), "%d hogs", nhogs);
+    err |= throughput(what);
+    err |= latency(what);
+
+    for(i = 0; i < nhogs; i++) {
+        kill(hogs[i], SIGKILL);
+        waitpid(hogs[i], NULL, 0);
+    }
+    if(schedstat(0, &st) == 0)
+        printf("pipebench: %lu handoffs\n", st.handoffs - handoffs);
+    return err;
+}
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/bench.h>
+
+#define MAX_LOADERS 16
+#define NUM_WAKES   200
+#define SLEEP_MS    5
+
+/**
+ * Sleep and wake up NUM_WAKES times, printing how late we ran on average
+ * and in the worst case, in microseconds.
+ */
+static void measure(const char *what) {
+    struct lateness late;
+
+    measure_lateness(SLEEP_MS, NUM_WAKES, 0, &late);
+    printf("preemptlat: %s: avg %lu us, max %lu us\n", what, late.avg_us,
+           late.max_us);
+}
+
+/**
+ * Fork and exec ourselves as fast as possible, the kernel spends most of
+ * its time copying page tables and loading the ELF.
+ */
+static void fork_exec_loop(char *self, char *envp[]) {
+    char *args[] = {self, "-x", NULL};
+    pid_t pid;
+
+    while(1) {
+        pid = fork();
+        if(pid == 0) {
+            execve(self, args, envp);
+            exit(1);
+        } else if(pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+    }
+}
+
+/**
+ * Report the worst case wakeup latency of a sleeping task, first on a
+ * quiet system and then while nloaders processes fork and exec in a loop.
+ * Without kernel preemption a wakeup can wait for a whole fork or exec.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    pid_t loaders[MAX_LOADERS];
+    char what[64];
+    int nloaders = 4, i;
+
+    /* Exec'ed by a loader, exit right away */
+    if(argc > 1 && !strcmp(argv[1], "-x"))
+        return 0;
+
+    if(argc > 1)
+        nloaders = atoi(argv[1]);
+    if(nloaders < 0 || nloaders > MAX_LOADERS) {
+        printf("usage: preemptlat [NUM_LOADERS <= %d]\n", MAX_LOADERS);
+        return 1;
+    }
+
+    measure("idle");
+
+    for(i = 0; i < nloaders; i++) {
+        loaders[i] = fork();
+        if(loaders[i] == 0) {
+            fork_exec_loop("/bin/preemptlat", envp);
+        } else if(loaders[i] < 0) {
+            printf("preemptlat: fork: %s\n", strerror(errno));
+            nloaders = i;
+            break;
+        }
+    }
+
+    snprintf(what, sizeof(what), "%d fork/exec loops", nloaders);
+    measure(what);
+
+    for(i = 0; i < nloaders; i++) {
+        kill(loaders[i], SIGKILL);
+        waitpid(loaders[i], NULL, 0);
+    }
+    return 0;
+}
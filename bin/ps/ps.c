@@ -28,11 +28,13 @@ int main(int argc, char **argv, char **envp) {
     if(wrote < 0)
         handle_error("getprocs");
 
-    printf("PID\tCMD\n");
+    /* CPU time in milliseconds */
+    printf("PID\tUSER\tSYS\tCMD\n");
     while(loc < wrote) {
         procp = (void*)(loc + (char*)procbuf);
-        printf("%d\t%s\n", procp->pid, procp->cmd);
-        loc += sizeof(pid_t) + strlen(procp->cmd) + 1;
+        printf("%d\t%lums\t%lums\t%s\n", procp->pid, procp->utime / 1000,
+               procp->stime / 1000, procp->cmd);
+        loc += PROC_STRUCT_SIZE(strlen(procp->cmd));
     }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/bench.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/cpuquota.h>
+
+#define MAX_LOOPS   16
+#define QUOTA_MS    20
+#define PERIOD_MS   100
+#define RUN_MS      2000
+#define SLEEP_MS    1
+
+/**
+ * Limit ourselves to QUOTA_MS every PERIOD_MS, check that a child gets
+ * the same limit, then become /bin/loop. Exits 2 if the limit is wrong.
+ */
+static void quota_loop(char *envp[]) {
+    struct cpu_quota set = {QUOTA_MS, PERIOD_MS}, got;
+    char *args[] = {"/bin/loop", NULL};
+    int status;
+    pid_t pid;
+
+    if(cpuquota(0, &set, NULL) < 0) {
+        printf("quotatest: cpuquota: %s\n", strerror(errno));
+        exit(2);
+    }
+    pid = fork();
+    if(pid == 0) {
+        if(cpuquota(0, NULL, &got) < 0 || got.quota_ms != QUOTA_MS ||
+                got.period_ms != PERIOD_MS)
+            exit(2);
+        exit(0);
+    }
+    if(pid < 0 || waitpid(pid, &status, 0) != pid || status) {
+        printf("quotatest: the quota was not inherited across fork\n");
+        exit(2);
+    }
+    execve(args[0], args, envp);
+    exit(1);
+}
+
+/**
+ * Check that cpuquota(2) rejects a bad limit.
+ */
+static int check_invalid(void) {
+    struct cpu_quota bad[] = {
+        {QUOTA_MS, CPUQUOTA_PERIOD_MIN - 1},
+        {QUOTA_MS, CPUQUOTA_PERIOD_MAX + 1},
+        {PERIOD_MS + 1, PERIOD_MS},
+    };
+    int i, err = 0;
+
+    for(i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++) {
+        if(cpuquota(0, &bad[i], NULL) == 0 || errno != EINVAL) {
+            printf("quotatest: quota %u ms per %u ms was accepted\n",
+                   bad[i].quota_ms, bad[i].period_ms);
+            err = 1;
+        }
+    }
+    return err;
+}
+
+/**
+ * Run nloops copies of bin/loop limited to QUOTA_MS of CPU every
+ * PERIOD_MS, while we keep sleeping 1 ms to see how responsive the system
+ * is. Then check from their rusage that none used more than its quota,
+ * give or take a period.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    uint64_t start, wall_ms, used_ms, allowed_ms;
+    struct lateness late;
+    pid_t loops[MAX_LOOPS];
+    struct rusage ru;
+    int nloops = 4, i, status, err = 0;
+
+    if(argc > 1)
+        nloops = atoi(argv[1]);
+    if(nloops < 0 || nloops > MAX_LOOPS) {
+        printf("usage: quotatest [NUM_LOOPS <= %d]\n", MAX_LOOPS);
+        return 1;
+    }
+    err |= check_invalid();
+
+    start = now_ns();
+    for(i = 0; i < nloops; i++) {
+        loops[i] = fork();
+        if(loops[i] == 0) {
+            quota_loop(envp);
+        } else if(loops[i] < 0) {
+            printf("quotatest: fork: %s\n", strerror(errno));
+            nloops = i;
+            break;
+        }
+    }
+    /* Sleep SLEEP_MS over and over for RUN_MS to see how late we run */
+    measure_lateness(SLEEP_MS, 0, RUN_MS, &late);
+    printf("quotatest: %d loops with %d/%d ms: sleep %d ms late avg %lu us, "
+           "max %lu us\n", nloops, QUOTA_MS, PERIOD_MS, SLEEP_MS,
+           late.avg_us, late.max_us);
+
+    for(i = 0; i < nloops; i++)
+        kill(loops[i], SIGKILL);
+    wall_ms = (now_ns() - start) / 1000000;
+    allowed_ms = wall_ms * QUOTA_MS / PERIOD_MS + QUOTA_MS;
+    for(i = 0; i < nloops; i++) {
+        if(wait4(loops[i], &status, 0, &ru) != loops[i]) {
+            printf("quotatest: wait4 %d: %s\n", loops[i], strerror(errno));
+            err = 1;
+            continue;
+        }
+        if(!WIFSIGNALED(status)) {
+            printf("quotatest: loop %d exited with %d\n", loops[i], status);
+            err = 1;
+            continue;
+        }
+        used_ms = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000 +
+                  (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+        printf("quotatest: loop %d used %lu ms of %lu ms, allowed %lu ms\n",
+               loops[i], used_ms, wall_ms, allowed_ms);
+        if(used_ms > allowed_ms)
+            err = 1;
+    }
+    printf("quotatest: %s\n", err? "FAILED" : "passed");
+    return err;
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/bench.h>
+#include <sys/schedclass.h>
+
+#define MAX_HOGS  16
+#define NUM_WAKES 50
+#define SLEEP_MS  10
+
+static const char *class_names[SCHED_CLASS_NUM] = {"rr", "mlfq", "cfs"};
+
+/**
+ * Stand-in for the shell: sleep, wake up, and measure how late we ran.
+ * Prints the average and worst wakeup latency in microseconds.
+ */
+static void measure(int class_id, int nhogs) {
+    struct lateness late;
+
+    measure_lateness(SLEEP_MS, NUM_WAKES, 0, &late);
+    printf("resptime: %s, %d hogs: avg %lu us, max %lu us\n",
+           class_names[class_id], nhogs, late.avg_us, late.max_us);
+}
+
+/**
+ * Report how quickly an interactive task gets the CPU back while nhogs
+ * CPU bound tasks (like bin/loop) run, under each scheduler class.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    pid_t hogs[MAX_HOGS];
+    int nhogs = 4, orig, cls, i;
+
+    if(argc > 1)
+        nhogs = atoi(argv[1]);
+    if(nhogs < 0 || nhogs > MAX_HOGS) {
+        printf("usage: resptime [NUM_HOGS <= %d]\n", MAX_HOGS);
+        return 1;
+    }
+
+    orig = schedclass(-1);
+    if(orig < 0) {
+        printf("resptime: schedclass: %s\n", strerror(errno));
+        return 1;
+    }
+
+    for(i = 0; i < nhogs; i++) {
+        hogs[i] = fork();
+        if(hogs[i] == 0) {
+            while(1) {}
+        } else if(hogs[i] < 0) {
+            printf("resptime: fork: %s\n", strerror(errno));
+            nhogs = i;
+            break;
+        }
+    }
+
+    for(cls = 0; cls < SCHED_CLASS_NUM; cls++) {
+        if(schedclass(cls) < 0) {
+            printf("resptime: schedclass: %s\n", strerror(errno));
+            break;
+        }
+        measure(cls, nhogs);
+    }
+    schedclass(orig);
+
+    for(i = 0; i < nhogs; i++) {
+        kill(hogs[i], SIGKILL);
+        waitpid(hogs[i], NULL, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/bench.h>
+
+#define MAX_LOOPS   16
+#define NUM_WAKES   500
+#define SLEEP_MS    1
+#define RT_PRIO     50
+#define NUM_SPIN    8       /* SCHED_FIFO hogs, enough for every CPU */
+#define SPIN_MS     3000    /* longer than a throttling period */
+
+static int set_policy(int policy, int prio) {
+    struct sched_param param = {prio};
+
+    if(sched_setscheduler(0, policy, &param) < 0) {
+        printf("rtjitter: sched_setscheduler %d: %s\n", policy, strerror(errno));
+        return -1;
+    }
+    if(sched_getscheduler(0) != policy) {
+        printf("rtjitter: policy is not %d\n", policy);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sleep SLEEP_MS and wake up NUM_WAKES times, printing how late we ran
+ * on average and in the worst case, in microseconds.
+ * @return: the worst case
+ */
+static uint64_t measure(const char *what) {
+    struct lateness late;
+
+    measure_lateness(SLEEP_MS, NUM_WAKES, 0, &late);
+    printf("rtjitter: %s: avg %lu us, max %lu us\n", what, late.avg_us,
+           late.max_us);
+    return late.max_us;
+}
+
+static void spin_ms(uint64_t ms) {
+    uint64_t end = now_ns() + ms * 1000000;
+
+    while(now_ns() < end)
+        ;
+}
+
+/**
+ * Start NUM_SPIN SCHED_FIFO tasks that never sleep, then check that this
+ * SCHED_OTHER task still gets to run before they are done. Without the
+ * throttle it would wait all of SPIN_MS.
+ */
+static int check_throttle(void) {
+    pid_t spinners[NUM_SPIN];
+    uint64_t start, waited;
+    int i, n, err = 0;
+
+    /* Fork above them, they inherit the policy and start when we drop it */
+    if(set_policy(SCHED_FIFO, RT_PRIO + 1) < 0)
+        return 1;
+    for(n = 0; n < NUM_SPIN; n++) {
+        spinners[n] = fork();
+        if(spinners[n] == 0) {
+            spin_ms(SPIN_MS);
+            exit(0);
+        } else if(spinners[n] < 0) {
+            printf("rtjitter: fork: %s\n", strerror(errno));
+            break;
+        }
+    }
+    start = now_ns();
+    if(set_policy(SCHED_OTHER, 0) < 0)
+        err = 1;
+    sleep_ms(SLEEP_MS);
+    waited = (now_ns() - start) / 1000000;
+    printf("rtjitter: SCHED_OTHER ran after %lu ms with %d SCHED_FIFO hogs\n",
+           waited, n);
+    if(waited >= SPIN_MS) {
+        printf("rtjitter: real-time tasks were not throttled\n");
+        err = 1;
+    }
+    for(i = 0; i < n; i++)
+        waitpid(spinners[i], NULL, 0);
+    return err;
+}
+
+/**
+ * Measure the wakeup jitter of a task sleeping 1 ms while nloops bin/loop
+ * processes keep every CPU busy, first as a SCHED_OTHER task and then as
+ * SCHED_FIFO. The real-time task should preempt the loops right away.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    char *args[] = {"/bin/loop", NULL};
+    pid_t loops[MAX_LOOPS];
+    uint64_t other, fifo;
+    char what[64];
+    int nloops = 4, i, err = 0;
+
+    if(argc > 1)
+        nloops = atoi(argv[1]);
+    if(nloops < 0 || nloops > MAX_LOOPS) {
+        printf("usage: rtjitter [NUM_LOOPS <= %d]\n", MAX_LOOPS);
+        return 1;
+    }
+    if(sched_get_priority_min(SCHED_FIFO) > RT_PRIO ||
+            sched_get_priority_max(SCHED_FIFO) < RT_PRIO + 1) {
+        printf("rtjitter: bad SCHED_FIFO priority range\n");
+        return 1;
+    }
+
+    for(i = 0; i < nloops; i++) {
+        loops[i] = fork();
+        if(loops[i] == 0) {
+            execve(args[0], args, envp);
+            exit(1);
+        } else if(loops[i] < 0) {
+            printf("rtjitter: fork: %s\n", strerror(errno));
+            nloops = i;
+            break;
+        }
+    }
+
+    snprintf(what, sizeof(what), "SCHED_OTHER, %d loops", nloops);
+    other = measure(what);
+
+    if(set_policy(SCHED_FIFO, RT_PRIO) < 0) {
+        err = 1;
+    } else {
+        snprintf(what, sizeof(what), "SCHED_FIFO %d, %d loops", RT_PRIO, nloops);
+        fifo = measure(what);
+        if(fifo > other)
+            printf("rtjitter: SCHED_FIFO was not better than SCHED_OTHER\n");
+        err |= check_throttle();
+    }
+
+    for(i = 0; i < nloops; i++) {
+        kill(loops[i], SIGKILL);
+        waitpid(loops[i], NULL, 0);
+    }
+    printf("rtjitter: %s\n", err? "FAILED" : "passed");
+    return err;
+}
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/schedstat.h>
+
+#define usage_exit() do{printf("schedstat [pid]\n"); exit(1);}while(0)
+
+static uint64_t khz;
+
+static uint64_t cycles_to_ns(uint64_t cycles) {
+    return khz? cycles * 1000000 / khz : 0;
+}
+
+/**
+ * Print the number of samples, average and maximum in microseconds, and
+ * every non-empty bucket by the lower bound of its range.
+ */
+static void print_hist(const char *name, struct sched_hist *hist) {
+    uint64_t samples = 0;
+    int i;
+
+    for(i = 0; i < SCHEDSTAT_BUCKETS; i++)
+        samples += hist->count[i];
+    printf("%s: %lu samples", name, samples);
+    if(!samples) {
+        printf("\n");
+        return;
+    }
+    printf(", avg %lu us, max %lu us\n",
+           cycles_to_ns(hist->total / samples) / 1000,
+           cycles_to_ns(hist->max) / 1000);
+    for(i = 0; i < SCHEDSTAT_BUCKETS; i++) {
+        if(hist->count[i])
+            printf("  >= %lu ns\t%u\n", cycles_to_ns(1UL << i), hist->count[i]);
+    }
+}
+
+/**
+ * Print the scheduler's latency histograms, system wide or of one task.
+ */
+int main(int argc, char **argv, char **envp) {
+    struct schedstat stat;
+    pid_t pid = 0;
+
+    if(argc > 2)
+        usage_exit();
+    if(argc == 2)
+        pid = atoi(argv[1]);
+
+    if(schedstat(pid, &stat) < 0) {
+        printf("schedstat: %s\n", strerror(errno));
+        exit(1);
+    }
+    khz = stat.tsc_khz;
+
+    if(pid) {
+        printf("pid %d\n", pid);
+    } else {
+        printf("switches %lu, rr queue exchanges %lu, steals %lu, "
+               "handoffs %lu, quota throttles %lu, cr3 loads %lu\n",
+               stat.switches, stat.rr_exchanges, stat.steals,
+               stat.handoffs, stat.quota_throttles, stat.cr3_loads);
+    }
+    print_hist("wakeup to run", &stat.wakeup);
+    print_hist("runnable wait", &stat.runwait);
+    print_hist("timeslice used", &stat.slice);
+    if(!pid)
+        print_hist("tick interrupts off", &stat.tick_irqoff);
+    return 0;
+}
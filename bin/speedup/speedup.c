@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/bench.h>
+
+#define MAX_WORKERS 16
+#define WORK_ITERS  50000000UL  /* per worker, like a bounded bin/loop */
+
+static void work(void) {
+    unsigned long i;
+    for(i = 0; i < WORK_ITERS; i++)
+        __asm__ __volatile__ ("nop");
+}
+
+/**
+ * Run n CPU bound workers at once and return the nanoseconds until the
+ * last one exits, or 0 on error.
+ */
+static uint64_t run_workers(int n) {
+    pid_t pids[MAX_WORKERS];
+    uint64_t start;
+    int i, started = 0;
+
+    start = now_ns();
+    for(i = 0; i < n; i++) {
+        pids[i] = fork();
+        if(pids[i] == 0) {
+            work();
+            exit(0);
+        } else if(pids[i] < 0) {
+            printf("speedup: fork: %s\n", strerror(errno));
+            break;
+        }
+        started++;
+    }
+    for(i = 0; i < started; i++)
+        waitpid(pids[i], NULL, 0);
+    return (started == n)? now_ns() - start : 0;
+}
+
+/**
+ * Measure how the throughput of independent CPU bound tasks scales with
+ * the number of tasks, boot with qemu -smp 1, 2 and 4 to compare.
+ * The speedup is the work done per second relative to a single worker.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    uint64_t one, ns, speedup;
+    int max = 8, n;
+
+    if(argc > 1)
+        max = atoi(argv[1]);
+    if(max < 1 || max > MAX_WORKERS) {
+        printf("usage: speedup [MAX_WORKERS <= %d]\n", MAX_WORKERS);
+        return 1;
+    }
+
+    one = run_workers(1);
+    if(!one)
+        return 1;
+    for(n = 1; n <= max; n *= 2) {
+        ns = (n == 1)? one : run_workers(n);
+        if(!ns)
+            return 1;
+        /* n times the work in the time, relative to one worker, x100 */
+        speedup = (uint64_t)n * one * 100 / ns;
+        printf("speedup: %d workers: %lu ms, speedup %lu.%02lu\n",
+               n, ns / 1000000, speedup / 100, speedup % 100);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/bench.h>
+#include <sys/wait.h>
+#include <sys/schedstat.h>
+
+#define NUM_ROUNDS  20000
+
+/**
+ * Bounce a byte between two processes through two pipes, each blocking
+ * until the other answers, and print how many context switches per second
+ * the kernel did and how long one took. With both on one CPU every round
+ * trip is two switches; with more CPUs some rounds are wakeups of an idle
+ * CPU instead, the switch count from schedstat(2) tells.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    int to_child[2], to_parent[2], rounds = NUM_ROUNDS, i, status;
+    struct schedstat before, after;
+    uint64_t start, ns, switches, us;
+    pid_t pid;
+    char c = 'x';
+
+    if(argc > 1)
+        rounds = atoi(argv[1]);
+    if(rounds <= 0) {
+        printf("usage: switchbench [NUM_ROUNDS]\n");
+        return 1;
+    }
+    if(schedstat(0, &before) < 0) {
+        printf("switchbench: schedstat: %s\n", strerror(errno));
+        return 1;
+    }
+    if(pipe(to_child) < 0 || pipe(to_parent) < 0) {
+        printf("switchbench: pipe: %s\n", strerror(errno));
+        return 1;
+    }
+    pid = fork();
+    if(pid == 0) {
+        for(i = 0; i < rounds; i++) {
+            if(read(to_child[0], &c, 1) != 1 || write(to_parent[1], &c, 1) != 1)
+                exit(1);
+        }
+        exit(0);
+    } else if(pid < 0) {
+        printf("switchbench: fork: %s\n", strerror(errno));
+        return 1;
+    }
+
+    schedstat(0, &before);
+    start = now_ns();
+    for(i = 0; i < rounds; i++) {
+        if(write(to_child[1], &c, 1) != 1 || read(to_parent[0], &c, 1) != 1) {
+            printf("switchbench: round %d failed\n", i);
+            break;
+        }
+    }
+    ns = now_ns() - start;
+    schedstat(0, &after);
+    waitpid(pid, &status, 0);
+    if(i < rounds || status)
+        return 1;
+
+    us = ns / 1000;
+    switches = after.switches - before.switches;
+    printf("switchbench: %d round trips in %lu us, %lu per second\n", rounds,
+           us, (uint64_t)rounds * 1000000 / (us? us : 1));
+    printf("switchbench: %lu switches, %lu per second, %lu ns each\n",
+           switches, switches * 1000000 / (us? us : 1),
+           ns / (switches? switches : 1));
+    return 0;
+}
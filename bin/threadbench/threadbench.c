@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/bench.h>
+
+#define MAX_THREADS     16
+#define WORK_ITERS      50000000UL  /* per thread, like bin/speedup */
+#define LOCK_ITERS      100000      /* mutex increments per thread */
+#define CREATE_ITERS    200
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile long counter;
+static unsigned long work_done[MAX_THREADS];
+
+static void *work(void *arg) {
+    unsigned long i, *done = arg;
+
+    for(i = 0; i < WORK_ITERS; i++)
+        __asm__ __volatile__ ("nop");
+    *done = i;  /* seen by the main thread, the memory is shared */
+    return NULL;
+}
+
+static void *count(void *arg) {
+    int i;
+
+    for(i = 0; i < LOCK_ITERS; i++) {
+        pthread_mutex_lock(&lock);
+        counter++;
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/* Each thread has its own errno, set it and see no one else changes it */
+static void *check_errno(void *arg) {
+    long id = (long)arg;
+    int i;
+
+    errno = 1000 + id;
+    for(i = 0; i < 100; i++) {
+        sched_yield();
+        if(errno != 1000 + id)
+            return (void *)1;
+    }
+    /* and a failing syscall sets only ours */
+    if(close(-1) != -1 || errno != EBADF)
+        return (void *)1;
+    return (void *)0;
+}
+
+static void *open_pipe(void *arg) {
+    return (void *)(long)pipe(arg);
+}
+
+static void *nothing(void *arg) {
+    return arg;
+}
+
+/**
+ * Run n threads with fn at once, work gets its work_done slot, others i.
+ * Sets *failed if a thread returned non-NULL.
+ * @return: the nanoseconds until the last one is joined, or 0 on error
+ */
+static uint64_t run_threads(int n, void *(*fn)(void *), int *failed) {
+    pthread_t threads[MAX_THREADS];
+    uint64_t start;
+    void *rv;
+    int i, err, started = 0;
+
+    start = now_ns();
+    for(i = 0; i < n; i++) {
+        void *arg = (fn == work)? (void *)&work_done[i] : (void *)(long)i;
+        err = pthread_create(&threads[i], NULL, fn, arg);
+        if(err) {
+            printf("threadbench: pthread_create: %s\n", strerror(err));
+            break;
+        }
+        started++;
+    }
+    for(i = 0; i < started; i++) {
+        if(pthread_join(threads[i], &rv) == 0 && rv && failed)
+            *failed = 1;
+    }
+    return (started == n)? now_ns() - start : 0;
+}
+
+/**
+ * Run a CPU bound loop in 1, 2, 4, ... threads of one process and print
+ * the speedup over one thread, boot with qemu -smp 1, 2 and 4 to compare.
+ * Then check the mutex and the per-thread errno, that threads share the
+ * open files, and compare creating and joining a thread with fork+wait.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    uint64_t one, ns, speedup, start;
+    int max = 8, n, i, err = 0, failed = 0, fds[2] = {-1, -1};
+    pthread_t t;
+    pid_t pid;
+    char c;
+
+    if(argc > 1)
+        max = atoi(argv[1]);
+    if(max < 1 || max > MAX_THREADS) {
+        printf("usage: threadbench [MAX_THREADS <= %d]\n", MAX_THREADS);
+        return 1;
+    }
+
+    one = run_threads(1, work, NULL);
+    if(!one)
+        return 1;
+    for(n = 1; n <= max; n *= 2) {
+        ns = (n == 1)? one : run_threads(n, work, NULL);
+        if(!ns)
+            return 1;
+        for(i = 0; i < n; i++) {
+            if(work_done[i] != WORK_ITERS)
+                err = 1;
+            work_done[i] = 0;
+        }
+        /* n times the work in the time, relative to one thread, x100 */
+        speedup = (uint64_t)n * one * 100 / ns;
+        printf("threadbench: %d threads: %lu ms, speedup %lu.%02lu\n",
+               n, ns / 1000000, speedup / 100, speedup % 100);
+    }
+    if(err)
+        printf("threadbench: a thread's work was not seen by main\n");
+
+    ns = run_threads(max, count, NULL);
+    printf("threadbench: mutex counter %ld of %ld, %lu ns per lock\n",
+           counter, (long)max * LOCK_ITERS,
+           ns / ((uint64_t)max * LOCK_ITERS));
+    if(counter != (long)max * LOCK_ITERS)
+        err = 1;
+
+    errno = 0;
+    run_threads(max, check_errno, &failed);
+    if(failed || errno != 0) {
+        printf("threadbench: errno is not per thread\n");
+        err = 1;
+    }
+
+    /* The pipe opened by the thread is in our file table too */
+    if(pthread_create(&t, NULL, open_pipe, fds) || pthread_join(t, NULL) ||
+       write(fds[1], "x", 1) != 1 || read(fds[0], &c, 1) != 1 || c != 'x') {
+        printf("threadbench: threads do not share open files\n");
+        err = 1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    start = now_ns();
+    for(i = 0; i < CREATE_ITERS; i++) {
+        if(pthread_create(&t, NULL, nothing, NULL) || pthread_join(t, NULL))
+            err = 1;
+    }
+    ns = now_ns() - start;
+    start = now_ns();
+    for(i = 0; i < CREATE_ITERS; i++) {
+        pid = fork();
+        if(pid == 0)
+            exit(0);
+        if(pid < 0 || waitpid(pid, NULL, 0) != pid)
+            err = 1;
+    }
+    printf("threadbench: pthread_create+join %lu, fork+waitpid %lu ns\n",
+           ns / CREATE_ITERS, (now_ns() - start) / CREATE_ITERS);
+
+    printf("threadbench: %s\n", err? "FAILED" : "passed");
+    return err;
+}
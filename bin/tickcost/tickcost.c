@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/bench.h>
+#include <sys/schedstat.h>
+
+#define RUN_MS      2000
+#define GAP_NS      300     /* a longer gap between two reads is an interrupt */
+
+/**
+ * Return the number of samples in hist.
+ */
+static uint64_t hist_samples(struct sched_hist *hist) {
+    uint64_t samples = 0;
+    int i;
+
+    for(i = 0; i < SCHEDSTAT_BUCKETS; i++)
+        samples += hist->count[i];
+    return samples;
+}
+
+/**
+ * Spin for run_ms reading the clock, which does not enter the kernel, and
+ * take every gap longer than GAP_NS as an interrupt. Print how many there
+ * were per second and how long they took from user space, then how long
+ * the kernel says timer ticks kept interrupts off. Compare kernels built
+ * with each -DTIMER_MODE.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    uint64_t start, end, last, t, gap, gaps = 0, total = 0, worst = 0;
+    uint64_t ticks, cycles;
+    struct schedstat before, after;
+    int run_ms = RUN_MS;
+
+    if(argc > 1)
+        run_ms = atoi(argv[1]);
+    if(run_ms <= 0) {
+        printf("usage: tickcost [RUN_MS]\n");
+        return 1;
+    }
+    if(schedstat(0, &before) < 0) {
+        printf("tickcost: schedstat: %s\n", strerror(errno));
+        return 1;
+    }
+
+    start = last = now_ns();
+    end = start + (uint64_t)run_ms * 1000000;
+    while((t = now_ns()) < end) {
+        gap = t - last;
+        last = t;
+        if(gap < GAP_NS)
+            continue;
+        gaps++;
+        total += gap;
+        if(gap > worst)
+            worst = gap;
+    }
+    schedstat(0, &after);
+
+    printf("tickcost: %lu interrupts per second, avg %lu ns, max %lu ns\n",
+           gaps * 1000 / run_ms, total / (gaps? gaps : 1), worst);
+    ticks = hist_samples(&after.tick_irqoff) - hist_samples(&before.tick_irqoff);
+    cycles = after.tick_irqoff.total - before.tick_irqoff.total;
+    if(ticks && after.tsc_khz)
+        printf("tickcost: %lu ticks, interrupts off avg %lu ns\n", ticks,
+               cycles / ticks * 1000000 / after.tsc_khz);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#define usage_exit() do{printf("time: command [args...]\n"); exit(1);}while(0)
+
+static unsigned long tv_to_ms(struct timeval *tv) {
+    return (unsigned long)tv->tv_sec * 1000 + (unsigned long)tv->tv_usec / 1000;
+}
+
+/**
+ * Run a command and print the time it took, and the CPU time and events
+ * wait4() reports for it.
+ * The command must be a path, e.g. time /bin/ls
+ */
+int main(int argc, char **argv, char **envp) {
+    struct timeval start, end;
+    struct rusage ru;
+    int status;
+    pid_t pid;
+
+    if(argc < 2)
+        usage_exit();
+
+    gettimeofday(&start, NULL);
+    pid = fork();
+    if(pid < 0) {
+        printf("time: fork: %s\n", strerror(errno));
+        exit(1);
+    } else if(pid == 0) {
+        execve(argv[1], argv + 1, envp);
+        printf("time: execve '%s': %s\n", argv[1], strerror(errno));
+        exit(127);
+    }
+    if(wait4(pid, &status, 0, &ru) < 0) {
+        printf("time: wait4: %s\n", strerror(errno));
+        exit(1);
+    }
+    gettimeofday(&end, NULL);
+
+    printf("real\t%lums\n", tv_to_ms(&end) - tv_to_ms(&start));
+    printf("user\t%lums\n", tv_to_ms(&ru.ru_utime));
+    printf("sys\t%lums\n", tv_to_ms(&ru.ru_stime));
+    printf("faults\t%ld minor, %ld major\n", ru.ru_minflt, ru.ru_majflt);
+    printf("switches\t%ld voluntary, %ld involuntary\n", ru.ru_nvcsw,
+           ru.ru_nivcsw);
+    return WEXITSTATUS(status);
+}
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/bench.h>
+#include <sys/schedstat.h>
+
+#define PAGE_SIZE   4096
+#define NUM_PAGES   256     /* fits the second level TLB of most CPUs */
+#define NUM_ROUNDS  200
+#define SLEEP_MS    1
+
+static void spin_ms(uint64_t ms) {
+    uint64_t end = now_ns() + ms * 1000000;
+
+    while(now_ns() < end)
+        ;
+}
+
+/**
+ * Read one byte of every page, return how many nanoseconds it took.
+ */
+static uint64_t touch(volatile char *mem) {
+    uint64_t start = now_ns();
+    int i;
+
+    for(i = 0; i < NUM_PAGES; i++)
+        (void)mem[i * PAGE_SIZE];
+    return now_ns() - start;
+}
+
+/**
+ * Wait SLEEP_MS NUM_ROUNDS times, by sleeping or spinning, and print the
+ * average nanoseconds per page to touch mem right after.
+ */
+static void measure(volatile char *mem, int sleep) {
+    uint64_t total = 0;
+    int i;
+
+    for(i = 0; i < NUM_ROUNDS; i++) {
+        if(sleep)
+            sleep_ms(SLEEP_MS);
+        else
+            spin_ms(SLEEP_MS);
+        total += touch(mem);
+    }
+    printf("tlbwarm: after %s %d ms: %lu ns per page\n",
+           sleep? "sleeping" : "spinning", SLEEP_MS,
+           total / NUM_ROUNDS / NUM_PAGES);
+}
+
+/**
+ * Show whether a task that sleeps briefly on an idle system comes back to
+ * a warm TLB. The idle task runs on our page tables instead of loading
+ * kernel_mm, so touching our pages after a sleep should cost about the
+ * same as after spinning. Compare with a kernel built with -DLAZY_TLB=0.
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    struct schedstat before, after;
+    char *mem;
+    int i;
+
+    if(schedstat(0, &before) < 0) {
+        printf("tlbwarm: schedstat: %s\n", strerror(errno));
+        return 1;
+    }
+    mem = malloc(NUM_PAGES * PAGE_SIZE);
+    if(!mem) {
+        printf("tlbwarm: malloc failed\n");
+        return 1;
+    }
+    for(i = 0; i < NUM_PAGES; i++)
+        mem[i * PAGE_SIZE] = 1;
+
+    measure(mem, 0);
+    schedstat(0, &before);
+    measure(mem, 1);
+    schedstat(0, &after);
+    printf("tlbwarm: %lu cr3 loads in %d sleeps\n",
+           after.cr3_loads - before.cr3_loads, NUM_ROUNDS);
+    return 0;
+}
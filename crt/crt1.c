@@ -1,6 +1,8 @@
 char **__environ = 0;
 __thread int errno;
 
+void __libc_setup_tls(void); /* libc/pthread.c */
+
 void _start(void) {
     __asm__ volatile (
         "xorq %%rbp, %%rbp;"            /* ABI: zero rbp */
@@ -20,6 +22,8 @@ void _start(void) {
 }
 
 void _init_sblibc(int argc, char **argv, char **envp) {
+    /* Give the main thread its TLS (errno) first */
+    __libc_setup_tls();
     /* initialize __environ which is used by getenv(3)/setenv(3) */
     __environ = envp;
 }
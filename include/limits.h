@@ -5,5 +5,7 @@
 
 #define HOST_NAME_MAX 64
 
+#define ARG_MAX (8 * 1024 * 1024) /* bytes of argv/envp strings and pointers */
+
 
 #endif
\ No newline at end of file
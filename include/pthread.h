@@ -0,0 +1,60 @@
+#ifndef _PTHREAD_H
+#define _PTHREAD_H
+
+#include <sys/types.h>
+
+/*
+ * Minimal POSIX threads: every thread is a task made by clone(2) that
+ * shares the address space and the open files, see libc/pthread.c.
+ * Attributes are not supported and must be NULL.
+ */
+
+typedef struct pthread *pthread_t;
+typedef struct { int unused; } pthread_attr_t;
+
+/* A futex: 0 unlocked, 1 locked, 2 locked and maybe waited on */
+typedef struct {
+    volatile int locked;
+} pthread_mutex_t;
+typedef struct { int unused; } pthread_mutexattr_t;
+
+#define PTHREAD_MUTEX_INITIALIZER { 0 }
+
+/* A futex counting signals, waiters sleep until it changes */
+typedef struct {
+    volatile int seq;
+} pthread_cond_t;
+typedef struct { int unused; } pthread_condattr_t;
+
+#define PTHREAD_COND_INITIALIZER { 0 }
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start_routine)(void *), void *arg);
+
+int pthread_join(pthread_t thread, void **retval);
+
+void pthread_exit(void *retval) __attribute__((noreturn));
+
+pthread_t pthread_self(void);
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr);
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex);
+
+int pthread_mutex_lock(pthread_mutex_t *mutex);
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex);
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+
+int pthread_cond_destroy(pthread_cond_t *cond);
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+
+int pthread_cond_signal(pthread_cond_t *cond);
+
+int pthread_cond_broadcast(pthread_cond_t *cond);
+
+#endif //_PTHREAD_H
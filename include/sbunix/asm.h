@@ -3,41 +3,6 @@
 
 /* Header for common assembly routines. */
 
-#define PUSHQALL \
-        "pushq %%rax;" \
-        "pushq %%rbx;" \
-        "pushq %%rcx;" \
-        "pushq %%rdx;" \
-        "pushq %%rsi;" \
-        "pushq %%rdi;" \
-        "pushq %%r8;"  \
-        "pushq %%r9;"  \
-        "pushq %%r10;" \
-        "pushq %%r11;" \
-        "pushq %%r12;" \
-        "pushq %%r13;" \
-        "pushq %%r14;" \
-        "pushq %%r15;" \
-        "pushq %%rbp;"
-
-
-#define POPQALL \
-        "popq %%rbp;" \
-        "popq %%r15;" \
-        "popq %%r14;" \
-        "popq %%r13;" \
-        "popq %%r12;" \
-        "popq %%r11;" \
-        "popq %%r10;" \
-        "popq %%r9;"  \
-        "popq %%r8;"  \
-        "popq %%rdi;" \
-        "popq %%rsi;" \
-        "popq %%rdx;" \
-        "popq %%rcx;" \
-        "popq %%rbx;" \
-        "popq %%rax;"
-
 #define halt_loop(fmt, ...) \
             do { \
                 printk(fmt, ##__VA_ARGS__); \
@@ -94,6 +59,23 @@ static inline void sti(void) {
     __asm__ __volatile__ ("sti");
 }
 
+/**
+ * Disable interrupts
+ * @return: the previous RFLAGS, for local_irq_restore()
+ */
+static inline uint64_t local_irq_save(void) {
+    uint64_t flags;
+    __asm__ __volatile__ ("pushfq; popq %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+/**
+ * Restore the interrupt flag saved by local_irq_save()
+ */
+static inline void local_irq_restore(uint64_t flags) {
+    __asm__ __volatile__ ("pushq %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
 
 /**
  * Read a 64-bit value from a MSR. The A constraint stands for concatenation
@@ -116,6 +98,25 @@ static inline void wrmsr(uint32_t msr_id, uint64_t msr_val) {
     __asm__ __volatile__ ("wrmsr" : : "a"(msr_lo), "d"(msr_hi), "c"(msr_id));
 }
 
+/**
+ * Read the Time Stamp Counter.
+ */
+static inline uint64_t read_tsc(void) {
+    uint32_t tsc_lo, tsc_hi;
+    __asm__ __volatile__ ("rdtsc" : "=a"(tsc_lo), "=d"(tsc_hi));
+    return (uint64_t) tsc_hi <<32 | (uint64_t) tsc_lo;
+}
+
+/**
+ * Execute cpuid for the given leaf.
+ */
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx,
+                         uint32_t *ecx, uint32_t *edx) {
+    __asm__ __volatile__ ("cpuid"
+                          : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                          : "a"(leaf), "c"(0));
+}
+
 static inline uint64_t read_cr0(void) {
     uint64_t ret;
     __asm__ __volatile__ ("movq %%cr0, %0;":"=r"(ret));
@@ -152,17 +153,47 @@ static inline uint64_t read_cr8(void) {
     return ret;
 }
 
+static inline void write_cr0(uint64_t val) {
+    __asm__ __volatile__ ("movq %0, %%cr0;"::"r"(val):"memory");
+}
+
 static inline void write_cr3(uint64_t pml4e_ptr) {
     __asm__ __volatile__ ("movq %0, %%cr3;"::"r"(pml4e_ptr):"memory");
 }
 
+static inline void write_cr4(uint64_t val) {
+    __asm__ __volatile__ ("movq %0, %%cr4;"::"r"(val):"memory");
+}
+
+/**
+ * Clear CR0.TS, the next FPU/SSE instruction will not trap with #NM
+ */
+static inline void clts(void) {
+    __asm__ __volatile__ ("clts");
+}
+
+/* Control register bits */
+#define CR0_MP          0x2      /* WAIT/FWAIT trap with #NM when TS is set */
+#define CR0_EM          0x4      /* emulate the FPU, every use traps with #UD */
+#define CR0_TS          0x8      /* task switched, FPU/SSE use traps with #NM */
+#define CR0_NE          0x20     /* native x87 errors, #MF not IRQ 13 */
+#define CR4_OSFXSR      0x200    /* FXSAVE/FXRSTOR and SSE enabled */
+#define CR4_OSXMMEXCPT  0x400    /* unmasked SSE exceptions raise #XM */
+#define CR4_OSXSAVE     0x40000  /* XSAVE/XRSTOR and XCR0 enabled */
+
 /* Intel/AMD Machine Specific Registers (MSR's) */
 #define MSR_EFER    0xC0000080
 #define MSR_STAR    0xC0000081
 #define MSR_LSTAR   0xC0000082
 #define MSR_CSTAR   0xC0000083
 #define MSR_SFMASK  0xC0000084
+#define MSR_FS_BASE 0xC0000100
+#define MSR_GS_BASE 0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102 /* exchanged with GS base by swapgs */
+#define MSR_APIC_BASE 0x1B
+#define MSR_TSC_DEADLINE 0x6E0 /* LAPIC timer fires when the TSC reaches it */
 
 #define MSR_EFER_SCE    0x1
+#define MSR_EFER_LMA    0x400
 
 #endif
@@ -13,6 +13,8 @@ void writec_glyph(char c);
 void clear_console(void);
 
 
+void keyboard_init(void);
+void sc_queue(uint8_t scan_code);
 void sc_add(uint8_t scan_code);
 int sc_getch(uint8_t scan_code);
 
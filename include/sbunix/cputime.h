@@ -0,0 +1,39 @@
+#ifndef _SBUNIX_CPUTIME_H
+#define _SBUNIX_CPUTIME_H
+
+#include <sbunix/asm.h>
+#include <sbunix/sched.h>
+#include <sys/resource.h>
+
+/*
+ * CPU time accounting. The TSC is read every time a task crosses between
+ * user mode and the kernel (syscalls, interrupts and exceptions from user
+ * mode, enter_usermode()) and when it is switched in or out, and the cycles
+ * since the last reading are added to its user or system time. Interrupts
+ * are charged to the task they interrupt, the timer tick included.
+ */
+
+/**
+ * Charge the time since the last accounting point to user time, on entry
+ * to the kernel from user mode.
+ */
+static inline void account_user_time(struct task_struct *task) {
+    uint64_t now = read_tsc();
+    task->acct.utime += now - task->acct_stamp;
+    task->acct_stamp = now;
+}
+
+/**
+ * Charge the time since the last accounting point to system time, on the
+ * way back to user mode or when switching out.
+ */
+static inline void account_system_time(struct task_struct *task) {
+    uint64_t now = read_tsc();
+    task->acct.stime += now - task->acct_stamp;
+    task->acct_stamp = now;
+}
+
+void acct_add(struct task_acct *sum, struct task_acct *acct);
+void acct_to_rusage(struct task_acct *acct, struct rusage *ru);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _SBUNIX_FPU_H
+#define _SBUNIX_FPU_H
+
+#include <sys/defs.h>
+
+/*
+ * Lazy switching of the x87/SSE/AVX register state of user tasks.
+ *
+ * The kernel itself never uses these registers (-msoft-float -mno-sse),
+ * only user space does. A task's state is kept in a page (task->fpu)
+ * allocated on its first use of the FPU, in FXSAVE or XSAVE format.
+ *
+ * CR0.TS is set when switching to a task, unless the CPU's registers still
+ * hold that task's state. Its first FPU instruction then traps with #NM and
+ * fpu_trap() loads its state. On the way out a task's registers are saved
+ * only if it used them during that run, i.e. TS is clear. Tasks that never
+ * touch the FPU cost one CR0 write per switch.
+ */
+
+struct task_struct;
+
+void fpu_init(void);
+void fpu_cpu_init(void);
+void fpu_switch(struct task_struct *prev, struct task_struct *next);
+void fpu_trap(void);
+int fpu_fork(struct task_struct *parent, struct task_struct *child);
+void fpu_release(struct task_struct *task);
+
+#endif
@@ -9,17 +9,19 @@
 #define _USER_DS	0x23
 #define _USER64_CS	0x2B
 
+/* Entries used in each CPU's GDT, the TSS descriptor takes two */
+#define GDT_ENTRIES	8
+
 /* See http://forum.osdev.org/viewtopic.php?t=13678 for explanation */
 struct tss_t {
 	uint32_t reserved;
 	uint64_t rsp0;  /* Stores val wanted in RSP when entering kernel from ring3 */
 	uint32_t unused[11];
 }__attribute__((packed));
-extern struct tss_t tss;
 
-extern uint64_t gdt[];
+struct cpu;
 
-void reload_gdt();
-void setup_tss();
+void reload_gdt(struct cpu *cpu);
+void setup_tss(struct cpu *cpu);
 
 #endif
@@ -37,5 +37,6 @@ enum pf_error_code {
 };
 
 void load_idt(void);
+void reload_idt(void);
 
 #endif
@@ -0,0 +1,83 @@
+#ifndef _SBUNIX_INTERRUPT_LAPIC_H
+#define _SBUNIX_INTERRUPT_LAPIC_H
+
+#include <sys/defs.h>
+
+struct cpu;
+
+/* Kernel virtual address the local APIC registers are mapped at */
+#define LAPIC_VIRT      0xFFFFFFFFC0000000UL
+
+/* Local APIC registers, offsets from the base */
+#define LAPIC_ID        0x020
+#define LAPIC_TPR       0x080  /* task priority */
+#define LAPIC_EOI       0x0B0
+#define LAPIC_SVR       0x0F0  /* spurious interrupt vector */
+#define LAPIC_ICR_LO    0x300  /* interrupt command */
+#define LAPIC_ICR_HI    0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR 0x390
+#define LAPIC_TIMER_DIV 0x3E0
+
+#define LAPIC_SVR_ENABLE     0x100
+#define LAPIC_LVT_MASKED     0x10000
+#define LAPIC_LVT_EXTINT     0x700   /* the 8259 PIC, virtual wire mode */
+#define LAPIC_LVT_NMI        0x400
+#define LAPIC_TIMER_ONESHOT  0x0
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_TIMER_TSC_DEADLINE 0x40000
+#define LAPIC_TIMER_DIV16    0x3
+
+/* ICR fields */
+#define LAPIC_ICR_INIT       0x500
+#define LAPIC_ICR_STARTUP    0x600
+#define LAPIC_ICR_ASSERT     0x4000
+#define LAPIC_ICR_LEVEL      0x8000
+#define LAPIC_ICR_PENDING    0x1000  /* delivery status */
+#define LAPIC_ICR_ALL_BUT_SELF 0xC0000
+
+/* Interrupt vectors */
+#define LAPIC_TIMER_VECTOR   48
+#define IPI_RESCHED_VECTOR   49
+#define IPI_TLB_VECTOR       50
+#define LAPIC_SPURIOUS_VECTOR 255
+
+/*
+ * What drives the tick, build with -DTIMER_MODE=<mode>. Without a local
+ * APIC the BSP falls back to the PIT, without TSC-deadline support to
+ * one-shot. The APs always use their LAPIC timer, periodic in PIT mode.
+ */
+#define TIMER_MODE_PIT       0  /* 8254 PIT on the BSP, EOI to the 8259 */
+#define TIMER_MODE_PERIODIC  1  /* LAPIC timer reloads itself each tick */
+#define TIMER_MODE_ONESHOT   2  /* LAPIC timer re-armed each tick */
+#define TIMER_MODE_DEADLINE  3  /* re-armed each tick, with a TSC deadline */
+#ifndef TIMER_MODE
+#define TIMER_MODE    TIMER_MODE_DEADLINE
+#endif
+
+extern uint32_t lapic_ticks_per_jiffy;
+extern int timer_mode;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return *(volatile uint32_t *)(LAPIC_VIRT + reg);
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    *(volatile uint32_t *)(LAPIC_VIRT + reg) = val;
+}
+
+int lapic_present(void);
+void lapic_init(void);
+void lapic_calibrate(void);
+void lapic_timer_init(void);
+void lapic_timer_start(void);
+uint64_t lapic_timer_rearm(struct cpu *cpu);
+void lapic_timer_stop(struct cpu *cpu, uint64_t ticks);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr);
+
+#endif
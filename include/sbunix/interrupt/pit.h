@@ -21,9 +21,52 @@
 #define RTC_MONTH      0x08
 #define RTC_YEAR       0x09
 
+#define PIT_FREQ      1193182    /* PIT input clock in HZ */
+#define PIT_MAX_COUNT 0xFFFF
+#define PIT_PORT_CH0  0x40
+#define PIT_PORT_CMD  0x43
+#define PIT_CMD_PERIODIC        0x36 /* channel 0, lo/hi byte, mode 3 */
+#define PIT_CMD_ONESHOT         0x30 /* channel 0, lo/hi byte, mode 0 */
+#define PIT_CMD_LATCH           0x00 /* latch channel 0's count */
+#define PIT_CMD_READBACK_STATUS 0xE2 /* read-back channel 0's status */
+#define PIT_STATUS_OUT          0x80 /* output pin state */
+
+/* Stop the periodic tick while idle, build with -DNOHZ_IDLE=0 to keep it */
+#ifndef NOHZ_IDLE
+#define NOHZ_IDLE     1
+#endif
+
+#define TIMER_HZ      1000       /* start() sets the PIT to this frequency */
+#define TICK_NSEC     (1000000000L / TIMER_HZ)
+#define NOHZ_MAX_TICKS TIMER_HZ  /* longest idle one-shot of the LAPIC timer */
+
 extern volatile uint64_t system_time; /* number of seconds since boot */
+extern volatile uint64_t jiffies;     /* number of timer ticks since boot */
+extern volatile uint64_t idle_wakeups; /* number of times idle left hlt */
+extern uint64_t tsc_khz;              /* TSC frequency, from tsc_calibrate() */
+extern uint64_t tsc_mult;             /* ns = cycles * tsc_mult >> TSC_SHIFT */
+extern uint64_t vtime_phys;           /* the time page, see <sys/vtime.h> */
+
+#define TSC_SHIFT     32
+#define TSC_CALIBRATE_TICKS 50   /* 50 ms at boot */
+
+/**
+ * Convert TSC cycles to nanoseconds, without overflowing for any uptime.
+ */
+static inline uint64_t tsc_to_ns(uint64_t cycles) {
+    return (uint64_t)(((__uint128_t)cycles * tsc_mult) >> TSC_SHIFT);
+}
 
 void timer_sleep(int seconds);
 void pit_set_freq(unsigned int hz);
+void pit_stop(void);
+void timer_tick(uint64_t ticks);
+void tick_nohz_idle_enter(void);
+void tick_nohz_idle_exit(void);
+void tsc_calibrate(void);
+void vtime_init(void);
+uint64_t tsc_to_usec(uint64_t cycles);
+uint64_t clock_monotonic_ns(void);
+uint64_t clock_realtime_ns(void);
 
 #endif
@@ -0,0 +1,34 @@
+#ifndef _SBUNIX_INTERRUPT_SOFTIRQ_H
+#define _SBUNIX_INTERRUPT_SOFTIRQ_H
+
+#include <sys/types.h>
+
+/*
+ * Bottom halves. An interrupt handler only acknowledges the device, saves
+ * what it must, and raises a softirq. Raised softirqs run on the same CPU
+ * in irq_exit(), with interrupts enabled, unless the interrupt came in
+ * the middle of another interrupt or softirq. The kernel lock is held.
+ *
+ * Softirq handlers can be interrupted, so they disable interrupts around
+ * anything an interrupt handler also touches (the run queues, via
+ * sched_tick()). Build with -DSOFTIRQ_IRQS_ON=0 to run them with
+ * interrupts disabled, as the handlers used to, for comparison.
+ */
+#ifndef SOFTIRQ_IRQS_ON
+#define SOFTIRQ_IRQS_ON 1
+#endif
+
+/* In order of priority, lowest number runs first */
+enum {
+    TIMER_SOFTIRQ,     /* wake expired sleepers, redraw the clock */
+    KEYBOARD_SOFTIRQ,  /* hand scan codes to the terminal */
+    NR_SOFTIRQS
+};
+
+typedef void (*softirq_action_t)(void);
+
+void open_softirq(int nr, softirq_action_t action);
+void raise_softirq(int nr);
+void do_softirq(void);
+
+#endif
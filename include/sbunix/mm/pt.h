@@ -113,6 +113,8 @@ int map_page(uint64_t virt_addr, uint64_t phy_addr, uint64_t pte_flags);
 int map_page_into(uint64_t virt_addr, uint64_t phy_addr, uint64_t pte_flags,
                   uint64_t other_pml4);
 void init_kernel_pt(uint64_t phys_free_page);
+int pt_map_low_identity(void);
+void pt_unmap_low_identity(void);
 
 void free_pml4(uint64_t pml4);
 
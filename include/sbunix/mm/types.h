@@ -2,6 +2,7 @@
 #define SBUNIX_MM_TYPES_H
 
 #include <sys/types.h>
+#include <sbunix/workqueue.h>
 
 /* TODO: Remove all of these and just add VM_NO_CLOBBER*/
 typedef enum {
@@ -63,6 +64,7 @@ struct mm_struct {
     uint64_t         env_end;      /* end of environment */
     uint64_t         rss;          /* pages allocated */
     uint64_t         total_vm;     /* total number of pages */
+    struct work_struct free_work;  /* mm_destroy_async() */
 };
 
 
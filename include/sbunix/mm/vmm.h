@@ -5,6 +5,8 @@
 #include <sbunix/mm/types.h>
 #include <sbunix/mm/pt.h>
 #include <sbunix/fs/vfs.h>
+#include <limits.h> /* ARG_MAX */
+#include <sys/vtime.h> /* VTIME_ADDR */
 
 
 /* Start stack for users, maps to pml4[255]->pdpt[511]->pd[511]->pt[511] */
@@ -14,11 +16,41 @@
 
 #define USER_MMAP_START  0x00002aaaaaaaa000ULL /* 1/3 of USER_STACK_START */
 
+/* Highest user stack page, the argv/envp strings end at USER_STACK_START */
+#define USER_STACK_TOP_PAGE ALIGN_DOWN(USER_STACK_START - 1, PAGE_SIZE)
+
+/* Limits on the argument block staged by execve */
+#define ARG_PAGES_PER_DIR (PAGE_SIZE / sizeof(uint64_t))
+#define ARG_MAX_PAGES     (ARG_MAX / PAGE_SIZE)
+#define ARG_MAX_DIRS      (ARG_MAX_PAGES / ARG_PAGES_PER_DIR)
+#define ARG_INTERP_MAX    127
+
+/*
+ * The argv/envp of a new process image. The strings and pointers are
+ * written into the staged pages exactly as they will appear at the top of
+ * the new user stack, add_stack() then maps the pages without another copy.
+ */
+struct exec_args {
+    int       argc;      /* number of argv strings, including the interpreter */
+    int       envc;      /* number of envp strings */
+    int       npages;    /* number of staged pages */
+    uint64_t  user_rsp;  /* entry user stack pointer, points at argc */
+    uint64_t  arg_start; /* user address of the first argv string */
+    uint64_t  arg_end;   /* user address after the last argv string */
+    uint64_t  env_start; /* user address of the first envp string */
+    uint64_t  env_end;   /* user address after the last envp string */
+    /* Pages of kernel virtual page addresses, page i holds user address
+     * USER_STACK_TOP_PAGE - i * PAGE_SIZE. Mapped pages are set to 0. */
+    uint64_t *pages[ARG_MAX_DIRS];
+    char      interp[ARG_INTERP_MAX + 1]; /* "#!" interpreter, if any */
+};
+
 
 /* mm_struct functions */
 
 struct mm_struct *mm_create(void);
 void              mm_destroy(struct mm_struct *mm);
+void              mm_destroy_async(struct mm_struct *mm);
 struct mm_struct *mm_deep_copy(void);
 int               mmap_area(struct mm_struct *mm, struct file *filep,
                             off_t fstart, size_t fsize, uint64_t prot,
@@ -27,7 +59,14 @@ int  mm_add_vma(struct mm_struct *mm, struct vm_area *vma);
 void mm_remove_vma(struct mm_struct *mm, struct vm_area *vma);
 
 int add_heap(struct mm_struct *user);
-int add_stack(struct mm_struct *user, const char **argv, const char **envp);
+int add_stack(struct mm_struct *user, struct exec_args *args);
+
+/* exec_args functions */
+
+struct exec_args *exec_args_create(void);
+void              exec_args_destroy(struct exec_args *args);
+int               exec_args_copy(struct exec_args *args, const char **argv,
+                                 const char **envp);
 
 /* vm_area functions */
 
@@ -43,6 +82,7 @@ uint64_t        find_mmap_space(struct mm_struct *mm, size_t length);
 /* onfault's */
 int onfault_mmap_file(struct vm_area *vma, uint64_t addr);
 int onfault_mmap_anon(struct vm_area *vma, uint64_t addr);
+int onfault_vtime(struct vm_area *vma, uint64_t addr);
 
 
 /* Also called from the page fault handler. */
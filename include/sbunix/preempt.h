@@ -0,0 +1,62 @@
+#ifndef _SBUNIX_PREEMPT_H
+#define _SBUNIX_PREEMPT_H
+
+#include <sbunix/sched.h>
+
+/*
+ * Kernel preemption.
+ *
+ * Syscalls run with interrupts enabled, so the tick that ends a task's
+ * timeslice can arrive while the task is in the kernel. The tick only sets
+ * need_resched, the switch happens as soon as the task allows it:
+ *  - on return from an interrupt, when its preempt count is 0 (user mode)
+ *  - at a cond_resched() point in a long running kernel loop
+ *  - on return from the syscall
+ *
+ * The preempt count is per task and is PREEMPT_KERNEL while running kernel
+ * code. The kernel relies on cli rather than locks to protect what it
+ * shares with interrupt handlers and other tasks, so it can not be switched
+ * out at any instruction, only at the points that say so.
+ * preempt_disable() nests on top of it to keep cond_resched() points in
+ * called code from switching, e.g. while borrowing another mm's page table.
+ * Interrupt handlers add HARDIRQ_OFFSET, and softirqs run from irq_exit()
+ * add SOFTIRQ_OFFSET, see <sbunix/interrupt/softirq.h>.
+ */
+#define PREEMPT_KERNEL  1
+#define SOFTIRQ_OFFSET  0x100
+#define SOFTIRQ_MASK    0xFF00
+#define HARDIRQ_OFFSET  0x10000
+#define HARDIRQ_MASK    0xFFFF0000
+
+void preempt_schedule(void);
+void irq_enter(void);
+void irq_exit(void);
+
+/**
+ * True while running an interrupt or exception handler, or a softirq.
+ */
+static inline int in_interrupt(void) {
+    return curr_task->preempt_count & (HARDIRQ_MASK | SOFTIRQ_MASK);
+}
+
+static inline void preempt_disable(void) {
+    curr_task->preempt_count++;
+    __asm__ __volatile__ ("" ::: "memory");
+}
+
+static inline void preempt_enable(void) {
+    __asm__ __volatile__ ("" ::: "memory");
+    curr_task->preempt_count--;
+}
+
+/**
+ * A preemption point, for long loops in syscalls. Switches out the current
+ * task if its timeslice ran out and nothing disabled preemption.
+ */
+static inline void cond_resched(void) {
+    struct task_struct *curr = curr_task;
+    if(curr->need_resched && curr->preempt_count == PREEMPT_KERNEL)
+        preempt_schedule();
+}
+
+#endif
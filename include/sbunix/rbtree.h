@@ -0,0 +1,38 @@
+#ifndef _SBUNIX_RBTREE_H
+#define _SBUNIX_RBTREE_H
+
+#include <sys/defs.h>
+
+/* Intrusive red-black tree, embed a struct rb_node in the keyed object */
+struct rb_node {
+    struct rb_node *rb_parent;
+    struct rb_node *rb_left;
+    struct rb_node *rb_right;
+    int rb_red;
+};
+
+struct rb_root {
+    struct rb_node *rb_node;
+};
+
+/* Get the struct containing the rb_node */
+#define rb_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - __builtin_offsetof(type, member)))
+
+/**
+ * Link a new node into the tree at *link, below parent. The caller does the
+ * search for link, then must call rb_insert_color() to rebalance.
+ */
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+                                struct rb_node **link) {
+    node->rb_parent = parent;
+    node->rb_left = node->rb_right = NULL;
+    node->rb_red = 1;
+    *link = node;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+void rb_erase(struct rb_node *node, struct rb_root *root);
+struct rb_node *rb_first(struct rb_root *root);
+
+#endif //_SBUNIX_RBTREE_H
@@ -3,16 +3,12 @@
 
 #include <sys/defs.h>
 #include <sys/signal.h>
+#include <sys/schedstat.h>
 #include <sbunix/mm/types.h> /* mm_struct */
 #include <sbunix/fs/vfs.h>   /* file */
 #include <sbunix/time.h>
-
-/* For description of queues see sched.c */
-extern struct queue run_queue;
-extern struct queue just_ran_queue;
-extern struct queue block_queue;
-extern struct queue sleep_queue;
-extern struct queue wait_queue;
+#include <sbunix/rbtree.h>
+#include <sbunix/smp.h>
 
 /* These two are the kernel's, after exec'ing /bin/init these describe
  * the idle task, because kmain just calls halt. */
@@ -22,31 +18,101 @@ extern struct task_struct   kernel_task;
 /* The init task is created in kmain, it is PID 1 */
 extern struct task_struct   *init_task;
 
-/* The current task that we are executing */
-extern struct task_struct   *curr_task;
+/* The current task that we are executing, on this CPU */
+#define curr_task (this_cpu()->curr)
+/* This CPU's idle task, kernel_task on the BSP */
+#define idle_task (this_cpu()->idle)
+
+/* Run-Queue, a doubly linked list through the tasks' next_rq/prev_rq */
+struct queue {
+    ulong num_tasks;    /* number of tasks on the queue */
+    struct task_struct *tasks; /* task queue, head */
+    struct task_struct *tail;  /* last task in the queue */
+};
+
+/* Tasks waiting on an object (a pipe, the terminal, a parent's children),
+ * embedded in the object. Waiters are linked through next_rq/prev_rq. */
+struct wait_queue_head {
+    struct queue waiters;
+};
+
+/* CPU time and events of a task, see <sbunix/cputime.h> */
+struct task_acct {
+    uint64_t utime;  /* TSC cycles in user mode */
+    uint64_t stime;  /* TSC cycles in the kernel, syscalls and interrupts */
+    ulong minflt;    /* page faults served from memory */
+    ulong majflt;    /* page faults that read a file */
+    ulong nvcsw;     /* switched out to block, sleep or wait */
+    ulong nivcsw;    /* switched out while still runnable */
+};
+
+/* Scheduler statistics of a task, see <sbunix/schedstat.h> */
+struct task_sched_info {
+    uint64_t queued;     /* TSC when queued runnable, 0 once running */
+    uint64_t run_start;  /* TSC when last switched in */
+    int woken;           /* queued by a wakeup */
+    struct sched_hist wakeup, runwait, slice;
+};
 
 #define TASK_CMDLINE_MAX 128
 #define TASK_FILES_MAX   64
 #define TASK_CWD_MAX   99
 
+/* Open files of a task, shared by the tasks cloned with CLONE_FILES */
+struct files_struct {
+    int count;                        /* tasks using this table */
+    struct file *fd[TASK_FILES_MAX];
+};
+
 /* Kernel thread or user process */
 struct task_struct {
     int type;             /* See enum task_type */
     int state;            /* See enum task_state */
-    int first_switch;     /* Flag for tricks to kick start a task */
     int foreground;       /* True if this task controls the terminal */
     int in_syscall;       /* Set to 1 if this task is in a system call */
     int timeslice;        /* User timeslices */
-    struct timespec sleepts; /* time left to sleep */
-    pid_t pid;            /* Process ID, monotonically increasing. 0 is not valid */
+    int cpu;              /* CPU this task last ran on, index into cpus[] */
+    int on_cpu;           /* True while running on some CPU */
+    int lock_depth;       /* Nesting of lock_kernel(), 0 if not held */
+    int preempt_count;    /* 0 if preemptible, see <sbunix/preempt.h> */
+    int need_resched;     /* Set by the tick, switch at the next chance */
+    int killed;           /* Killed while running on another CPU */
+    int sched_level;      /* MLFQ priority level, 0 is the highest */
+    int nice;             /* -20 (most CPU) to 19 (least CPU) */
+    int policy;           /* SCHED_OTHER, or SCHED_FIFO/SCHED_RR for rt_sched_class */
+    int rt_priority;      /* 1 to 99 for real-time tasks, higher runs first */
+    uint32_t quota;       /* ticks of CPU per quota_period, 0 for no limit */
+    uint32_t quota_period;/* ticks, see cpuquota(2) */
+    uint32_t quota_used;  /* ticks run in the current period */
+    uint64_t quota_start; /* jiffies the current period started at */
+    uint64_t vruntime;    /* CFS weighted run time in nanoseconds */
+    struct rb_node run_node; /* CFS timeline node */
+    struct task_acct acct;  /* this task's usage */
+    struct task_acct cacct; /* usage of the children it has waited for */
+    uint64_t acct_stamp;  /* TSC at the last switch between user and kernel */
+    struct task_sched_info sched_info; /* latency histograms */
+    uint64_t sleep_until; /* jiffies to wake up at, from nanosleep */
+    struct rb_node sleep_node; /* sleep timeline node */
+    int timeout;          /* TIMEOUT_* of a wait_on_timeout() */
+    uint64_t futex_key;   /* user address waited on in futex(), 0 once woken */
+    pid_t pid;            /* Process ID, 0 only for the idle tasks */
+    struct task_struct *pid_hash_next; /* PID hash chain, see sys/sched/pid.c */
     int exit_code;        /* Exit code of a process, returned by wait() */
-    void *blocked_on;     /* Pointer to data structure that this task is waiting on */
-    uint64_t kernel_rsp;  /* Kernel's 4KB stack */
+    struct wait_queue_head *blocked_on; /* wait queue this task is waiting on */
+    int wait_exclusive;   /* Only one exclusive waiter is woken at a time */
+    struct wait_queue_head child_exit;  /* wait4() waits here for children */
+    struct queue zombies; /* dead children to reap, linked through next_rq */
+    uint64_t kernel_rsp;  /* Kernel's 4KB stack, saved by switch_to() */
+    uint64_t kstack_top;  /* rsp0 while running, top of the stack minus 16 */
+    void *fpu;            /* FPU/SSE state page, NULL until used, see <sbunix/fpu.h> */
+    int fpu_cpu;          /* CPU whose registers last loaded the FPU state */
     struct mm_struct *mm; /* virtual memory info, kernel tasks all share &kernel_mm */
+    uint64_t fs_base;     /* user FS base (TLS), set with arch_prctl() */
     struct task_struct *next_task, *prev_task; /* for traversing all tasks */
-    struct task_struct *next_rq;               /* for traversing a queue */
-    struct task_struct *parent, *chld, *sib;   /* parent/child/sibling pointers */
-    struct file *files[TASK_FILES_MAX];
+    struct task_struct *next_rq, *prev_rq;     /* for traversing a queue */
+    struct queue *rq;                          /* queue this task is on, NULL if none */
+    struct task_struct *parent, *chld, *sib, *prev_sib; /* parent/children/siblings */
+    struct files_struct *files; /* NULL until task_files_init() or fork */
     char cmdline[TASK_CMDLINE_MAX + 1];
     char cwd[TASK_CWD_MAX + 1];
 };
@@ -65,30 +131,118 @@ enum task_state {
     TASK_WAITING    = 32  /* waiting on children */
 };
 
+/* task->timeout, a blocked task may also be on the sleep timeline */
+#define TIMEOUT_NONE     0
+#define TIMEOUT_ARMED    1  /* on the timeline until woken */
+#define TIMEOUT_EXPIRED  2  /* woken by the timeline */
+
+/* PIDs are 1 to PID_MAX - 1 and are reused once freed */
+#define PID_MAX         32768
+
 /* Exit Codes */
 #define EXIT_FATALSIG   128  /* Added to fatal signal for exit codes */
 
 /* Base timeslice in number of interrupts */
 #define TIMESLICE_BASE  30
 
-/* Run-Queue */
-struct queue {
-    ulong num_switches; /* num context switches */
-    struct task_struct *tasks; /* task queue */
+/* Let a task blocking on a pipe switch straight to the peer it woke, see
+ * sched_handoff(). Build with -DSCHED_HANDOFF=0 to compare without it. */
+#ifndef SCHED_HANDOFF
+#define SCHED_HANDOFF   1
+#endif
+
+/* Run kernel threads on the page tables of whatever ran before, see
+ * switch_mm(). Build with -DLAZY_TLB=0 to load kernel_mm for them. */
+#ifndef LAZY_TLB
+#define LAZY_TLB        1
+#endif
+
+/* Flags for sched_class->enqueue() */
+#define ENQUEUE_WAKEUP  1  /* task is waking from a block, sleep, or wait */
+
+/**
+ * A scheduling policy. The active one is pointed to by sched_class, all
+ * hooks are called with interrupts disabled.
+ */
+struct sched_class {
+    const char *name;
+    /* Return the next task to run, the idle task if there are none
+     * (NULL for rt_sched_class, the system's class runs next) */
+    struct task_struct *(*pick_next)(void);
+    /* Add a TASK_RUNNABLE task to the class' queues */
+    void (*enqueue)(struct task_struct *task, int flags);
+    /* Remove a TASK_RUNNABLE task from the class' queues */
+    void (*dequeue)(struct task_struct *task);
+    /* Timer tick while curr is running, return true to reschedule */
+    int (*tick)(struct task_struct *curr);
+    /* Parent has forked child, child is still an exact copy */
+    void (*fork)(struct task_struct *parent, struct task_struct *child);
 };
 
+extern struct sched_class *sched_class;
+/* Real-time tasks, ahead of the system's sched_class, see sys/sched/rt.c */
+extern struct sched_class rt_sched_class;
+
+static inline int rt_task(struct task_struct *task) {
+    return task->policy != 0; /* not SCHED_OTHER */
+}
+
+/**
+ * The class that queues and ticks task.
+ */
+static inline struct sched_class *task_sched_class(struct task_struct *task) {
+    return rt_task(task)? &rt_sched_class : sched_class;
+}
+
+/* Range of nice values */
+#define NICE_MIN  -20
+#define NICE_MAX   19
+
+int sched_set_class(int class_id);
+int sched_setscheduler_task(struct task_struct *task, int policy, int prio);
+int rt_tick_preempt(struct task_struct *curr);
+void sched_yield_curr(void);
+void sched_handoff(struct task_struct *task);
+void task_set_quota(struct task_struct *task, uint32_t quota, uint32_t period);
+struct mm_struct *switch_mm(struct cpu *cpu, struct mm_struct *next);
+void task_set_start(struct task_struct *task, uint64_t sp, void (*start)(void));
+void post_context_switch(void);
+void task_set_nice(struct task_struct *task, int nice);
+void sleep_add(struct task_struct *task);
+void sleep_remove(struct task_struct *task);
+void sleep_add_timeout(struct task_struct *task);
+void sleep_cancel_timeout(struct task_struct *task);
+void sleep_wakeup_expired(uint64_t now);
+uint64_t sleep_next_deadline(void);
+pid_t alloc_pid(void);
+void free_pid(pid_t pid);
+void pid_hash_add(struct task_struct *task);
+void pid_hash_remove(struct task_struct *task);
+struct task_struct *lookup_pid(pid_t pid);
+struct task_struct *find_task_by_pid(pid_t pid);
+void sched_tick(void);
 struct task_struct *foreground_task(void);
-void task_block(void *block_on);
 void task_wakeup(struct queue *from_queue, struct task_struct *task);
-void task_unblock(void *blocked_on);
-void task_unblock_foreground(void *blocked_on);
+void wait_queue_init(struct wait_queue_head *wq);
+void wait_on(struct wait_queue_head *wq, int state, int exclusive);
+int wait_on_timeout(struct wait_queue_head *wq, int state, uint64_t deadline);
+void task_block(struct wait_queue_head *wq);
+void task_block_exclusive(struct wait_queue_head *wq);
+struct task_struct *wake_up(struct wait_queue_head *wq);
+void wake_up_all(struct wait_queue_head *wq);
+void wake_up_foreground(struct wait_queue_head *wq);
+
+static inline int wait_queue_active(struct wait_queue_head *wq) {
+    return wq->waiters.tasks != NULL;
+}
 void schedule(void);
 void scheduler_init(void);
 struct task_struct *ktask_create(void (*start)(void), const char *name);
+struct task_struct *idle_task_create(int cpu_id, uint64_t *stack);
 void task_set_cmdline(struct task_struct *task, const char *cmdline);
-pid_t get_next_pid(void);
 void debug_task(struct task_struct *task);
-struct task_struct *fork_curr_task(void);
+struct task_struct *fork_curr_task(int clone_flags);
+void task_set_fs_base(struct task_struct *task, uint64_t base);
 int task_files_init(struct task_struct *task);
 int cleanup_child(struct task_struct *task);
 void kill_curr_task(int exit_code);
@@ -99,21 +253,32 @@ static inline void reset_timeslice(struct task_struct *task) {
     task->timeslice = TIMESLICE_BASE;
 }
 
-#define switch_to(prev, next)                                              \
-	__asm__ __volatile__ (                                                 \
-         PUSHQALL                                                          \
-	     "movq %%rsp, %P0(%1);"  /* save prev stack ptr */                 \
-	     "movq %P0(%2), %%rsp;"  /* switch to next's stack */	           \
-	     "cmpl $0x0, %P3(%2);"    /* check flags for first_switch */   \
-	     "jne _skip_popqall;"    /* If first switch skip the pops */       \
-         POPQALL                                                           \
-         "_skip_popqall:;"                                                 \
-         : /* none */                                                      \
-         : "i" (__builtin_offsetof(struct task_struct, kernel_rsp)),       \
-	       "r" (prev),                                                     \
-           "r" (next),            	                                       \
-           "i" (__builtin_offsetof(struct task_struct, first_switch))      \
-	     : "memory", "cc", "rax", "rcx", "rbx", "rdx", "r8", "r9", "r10",  \
-           "r11", "r12", "r13", "r14", "r15", "flags")
+/* What switch_stack() leaves on a switched out task's kernel stack */
+struct switch_frame {
+    uint64_t r15, r14, r13, r12, rbx, rbp;
+    uint64_t rip;         /* switch_stack() returns here */
+};
+
+/* sys/sched/switch.s */
+void switch_stack(uint64_t *prev_rsp, uint64_t next_rsp);
+void switch_first(void);
+
+/**
+ * Continue running next where it last called switch_to(), or at its start
+ * function if it never ran. Only the callee-saved registers are kept, the
+ * compiler saved whatever else it needs around the call.
+ */
+static inline void switch_to(struct task_struct *prev, struct task_struct *next) {
+    switch_stack(&prev->kernel_rsp, next->kernel_rsp);
+}
+
+/**
+ * Enter the kernel on task's stack for interrupts and syscalls from user
+ * mode on this CPU.
+ */
+static inline void load_kernel_stack(struct cpu *cpu, struct task_struct *task) {
+    cpu->tss.rsp0 = task->kstack_top;
+    cpu->kernel_rsp = task->kstack_top;
+}
 
 #endif //_SBUNIX_SCHED_H
@@ -0,0 +1,93 @@
+#ifndef _SBUNIX_SCHEDSTAT_H
+#define _SBUNIX_SCHEDSTAT_H
+
+#include <sys/schedstat.h>
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+
+/*
+ * Scheduler latency histograms, per task and system wide, read with
+ * schedstat(2). Build with -DSCHEDSTATS=0 to leave them out. The hot path
+ * cost is a TSC read when a task is queued and a bsr per sample, the
+ * switch reuses the TSC reads of the CPU time accounting.
+ */
+#ifndef SCHEDSTATS
+#define SCHEDSTATS 1
+#endif
+
+extern struct schedstat sched_stats;
+
+static inline void sched_hist_add(struct sched_hist *hist, uint64_t cycles) {
+    uint64_t bucket;
+
+    __asm__ ("bsrq %1, %0" : "=r"(bucket) : "r"(cycles | 1));
+    hist->count[MIN(bucket, SCHEDSTAT_BUCKETS - 1)]++;
+    hist->total += cycles;
+    if(cycles > hist->max)
+        hist->max = cycles;
+}
+
+/**
+ * The task was queued runnable, woken up if wakeup is set.
+ */
+static inline void schedstat_enqueue(struct task_struct *task, int wakeup) {
+    if(!SCHEDSTATS)
+        return;
+    task->sched_info.queued = read_tsc();
+    task->sched_info.woken = wakeup;
+}
+
+/**
+ * The task was switched in at TSC now.
+ */
+static inline void schedstat_switch_in(struct task_struct *task, uint64_t now) {
+    struct task_sched_info *si = &task->sched_info;
+
+    if(!SCHEDSTATS)
+        return;
+    si->run_start = now;
+    if(!si->queued)
+        return;     /* the idle task, or still running */
+    sched_hist_add(&si->runwait, now - si->queued);
+    sched_hist_add(&sched_stats.runwait, now - si->queued);
+    if(si->woken) {
+        sched_hist_add(&si->wakeup, now - si->queued);
+        sched_hist_add(&sched_stats.wakeup, now - si->queued);
+    }
+    si->queued = 0;
+}
+
+/**
+ * The task was switched out at TSC now.
+ */
+static inline void schedstat_switch_out(struct task_struct *task, uint64_t now) {
+    struct task_sched_info *si = &task->sched_info;
+
+    if(!SCHEDSTATS || !si->run_start)
+        return;
+    sched_hist_add(&si->slice, now - si->run_start);
+    sched_hist_add(&sched_stats.slice, now - si->run_start);
+}
+
+/**
+ * A timer interrupt started, its time with interrupts off is sampled by
+ * schedstat_tick_irqs_on().
+ */
+static inline void schedstat_tick(struct cpu *cpu) {
+    if(!SCHEDSTATS)
+        return;
+    cpu->tick_stamp = cpu->irq_stamp;
+}
+
+/**
+ * Interrupts are enabled again, or the interrupt returns: record how long
+ * a timer tick kept them disabled, from irq_enter() on.
+ */
+static inline void schedstat_tick_irqs_on(struct cpu *cpu) {
+    if(!SCHEDSTATS || !cpu->tick_stamp)
+        return;
+    sched_hist_add(&sched_stats.tick_irqoff, read_tsc() - cpu->tick_stamp);
+    cpu->tick_stamp = 0;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _SBUNIX_SMP_H
+#define _SBUNIX_SMP_H
+
+#include <sys/defs.h>
+#include <sbunix/gdt.h>
+
+/* Most CPUs brought up, build with -DMAX_CPUS=1 to only run the BSP */
+#ifndef MAX_CPUS
+#define MAX_CPUS 8
+#endif
+
+/* Physical page the APs start executing at, SIPI vector 0x08 */
+#define TRAMPOLINE_PHYS 0x8000
+
+struct task_struct;
+struct mm_struct;
+
+/**
+ * Per-CPU data, each CPU's GS base points at its own struct cpu while in
+ * the kernel (swapgs on every entry from and exit to ring 3).
+ * The first three fields are used by syscall_entry.s, do not move them.
+ */
+struct cpu {
+    struct cpu *self;          /* %gs:0, so this_cpu() is one load */
+    uint64_t user_rsp;         /* %gs:8, user stack saved on syscall */
+    uint64_t kernel_rsp;       /* %gs:16, kernel stack loaded on syscall */
+    struct task_struct *curr;  /* the task running on this CPU */
+    struct task_struct *idle;  /* runs when there is nothing else */
+    struct task_struct *last;  /* previous task, cleaned up after a switch */
+    struct task_struct *handoff; /* run next if the current task blocks */
+    struct task_struct *fpu_owner; /* task whose FPU state is in the registers */
+    struct mm_struct *active_mm; /* loaded in CR3, NULL until the first switch */
+    struct mm_struct *mm_drop;   /* active_mm reference to drop after a switch */
+    uint64_t fs_base;          /* user FS base loaded in MSR_FS_BASE */
+    volatile int tlb_flush;    /* set by smp_flush_tlb_mm(), see smp.c */
+    int id;                    /* index into cpus[] */
+    int apic_id;               /* local APIC ID, for IPIs */
+    volatile int online;       /* set once the CPU is up */
+    uint32_t softirq_pending;  /* raised softirqs, bit per SOFTIRQ number */
+    uint64_t irq_stamp;        /* TSC at the last irq_enter() */
+    uint64_t tick_stamp;       /* irq_stamp of a timer tick still running */
+    uint64_t tick_next;        /* TSC of the next tick, one-shot LAPIC timer */
+    uint64_t gdt[GDT_ENTRIES];
+    struct tss_t tss;
+};
+
+extern struct cpu cpus[MAX_CPUS];
+extern int smp_num_cpus;
+
+/**
+ * Return this CPU's struct cpu. Volatile so that it is re-read after a
+ * context switch, the task may resume on another CPU.
+ */
+static inline struct cpu *this_cpu(void) {
+    struct cpu *cpu;
+    __asm__ __volatile__ ("movq %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+void cpu_init(struct cpu *cpu);
+void smp_init(void);
+void smp_start(void);
+void smp_kick_cpu(struct cpu *cpu);
+void smp_resched_cpu(struct cpu *cpu);
+int smp_others_idle(void);
+void smp_flush_tlb_mm(struct mm_struct *mm);
+void smp_tlb_flush_check(void);
+void lock_kernel(void);
+void unlock_kernel(void);
+
+#endif
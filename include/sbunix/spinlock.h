@@ -0,0 +1,66 @@
+#ifndef _SBUNIX_SPINLOCK_H
+#define _SBUNIX_SPINLOCK_H
+
+#include <sys/defs.h>
+#include <sbunix/asm.h>
+
+/* A busy-waiting lock for mutual exclusion between CPUs */
+typedef struct {
+    volatile int locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+/**
+ * Hint to the CPU that we are in a spin-wait loop.
+ */
+static inline void cpu_relax(void) {
+    __asm__ __volatile__ ("pause" ::: "memory");
+}
+
+static inline void spin_lock_init(spinlock_t *lock) {
+    lock->locked = 0;
+}
+
+/**
+ * Try once to take the lock, return true if we got it.
+ */
+static inline int spin_trylock(spinlock_t *lock) {
+    int old = 1;
+    __asm__ __volatile__ ("xchgl %0, %1"
+                          : "+r"(old), "+m"(lock->locked) :: "memory");
+    return old == 0;
+}
+
+/**
+ * Take the lock, spinning on a plain read until it looks free so the
+ * cache line is not bounced between waiting CPUs.
+ */
+static inline void spin_lock(spinlock_t *lock) {
+    while(!spin_trylock(lock)) {
+        while(lock->locked)
+            cpu_relax();
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    __asm__ __volatile__ ("" ::: "memory"); /* x86 stores are not reordered */
+    lock->locked = 0;
+}
+
+/**
+ * Disable interrupts and take the lock.
+ * @return: the previous RFLAGS, for spin_unlock_irqrestore()
+ */
+static inline uint64_t spin_lock_irqsave(spinlock_t *lock) {
+    uint64_t flags = local_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+    spin_unlock(lock);
+    local_irq_restore(flags);
+}
+
+#endif
@@ -5,17 +5,24 @@
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <sys/resource.h>
+#include <sys/schedstat.h>
+#include <sys/cpuquota.h>
 #include <sbunix/time.h>
 #include <dirent.h>
+#include <sched.h>
 #include <errno.h>
 
 struct mm_struct; /* forward declarations (from vmm.h) */
 
 pid_t do_fork(void);
 
+pid_t do_clone(int clone_flags, uint64_t newsp, uint64_t tls);
+
+int do_arch_prctl(int code, uint64_t addr);
+
 uint64_t do_brk(struct mm_struct *mm, uint64_t newbrk);
 
-long do_execve(char *filename, const char **argv, const char **envp, int rec);
+long do_execve(const char *filename, const char **argv, const char **envp);
 
 pid_t do_wait4(pid_t pid, int *status, int options, struct rusage *rusage);
 
@@ -23,6 +30,13 @@ int do_kill(pid_t pid, int sig);
 
 int do_nanosleep(const struct timespec *req, struct timespec *rem);
 
+int do_clock_gettime(clockid_t clk, struct timespec *tp);
+
+int do_gettimeofday(struct timeval *tv, void *tz);
+
+long do_futex(uint32_t *uaddr, int op, uint32_t val,
+              const struct timespec *timeout);
+
 long do_getcwd(char *buf, size_t size);
 
 long do_chdir(const char *path);
@@ -54,4 +68,22 @@ int do_munmap(void *addr, size_t length);
 
 ssize_t do_getprocs(void *procbuf, size_t length);
 
+int do_getpriority(int which, int who);
+
+int do_setpriority(int which, int who, int prio);
+
+int do_sched_setscheduler(pid_t pid, int policy, struct sched_param *param);
+
+int do_sched_setparam(pid_t pid, struct sched_param *param);
+
+int do_sched_getscheduler(pid_t pid);
+
+int do_sched_getparam(pid_t pid, struct sched_param *param);
+
+int do_cpuquota(pid_t pid, const struct cpu_quota *set, struct cpu_quota *old);
+
+int do_getrusage(int who, struct rusage *usage);
+
+int do_schedstat(pid_t pid, struct schedstat *stat);
+
 #endif //_SBUNIX_SYSCALL_H
@@ -26,6 +26,12 @@ struct tm {
     int tm_yday;
 };
 
+/* Clocks for clock_gettime(2), as in <time.h> */
+#define CLOCK_REALTIME   0
+#define CLOCK_MONOTONIC  1
+
+#define NSEC_PER_SEC     1000000000UL
+
 extern struct timespec unix_time;     /* real (UNIX) time */
 
 
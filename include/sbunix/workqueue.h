@@ -0,0 +1,39 @@
+#ifndef _SBUNIX_WORKQUEUE_H
+#define _SBUNIX_WORKQUEUE_H
+
+#include <sys/types.h>
+
+/*
+ * Deferred work, run by a few kernel worker threads.
+ *
+ * Slow work that does not have to be done before returning to the task
+ * that triggered it (tearing down an address space on exit) is queued
+ * here instead. The workers hold the kernel lock like a syscall, run the
+ * work with interrupts enabled, and give up the CPU at cond_resched()
+ * points when their timeslice runs out.
+ */
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+    work_func_t func;          /* may free the work_struct */
+    struct work_struct *next;  /* on the list of pending work */
+    int pending;               /* queued and not started yet */
+};
+
+/* Get the struct containing the work_struct */
+#define work_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - __builtin_offsetof(type, member)))
+
+static inline void init_work(struct work_struct *work, work_func_t func) {
+    work->func = func;
+    work->next = NULL;
+    work->pending = 0;
+}
+
+void workqueue_init(void);
+int queue_work(struct work_struct *work);
+void flush_work(struct work_struct *work);
+
+#endif
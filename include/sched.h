@@ -0,0 +1,64 @@
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include <sys/types.h>
+
+/* Scheduling policies for sched_setscheduler(2) */
+#define SCHED_OTHER     0  /* the system's time sharing class, see schedclass(2) */
+#define SCHED_FIFO      1  /* real-time, runs until it blocks or yields */
+#define SCHED_RR        2  /* real-time, round robin with a timeslice */
+
+/* Real-time priorities, higher runs first, SCHED_OTHER uses 0 */
+#define SCHED_RT_PRIO_MIN   1
+#define SCHED_RT_PRIO_MAX   99
+
+struct sched_param {
+    int sched_priority;
+};
+
+/* Flags for clone(2), the low byte is the exit signal and is ignored */
+#define CLONE_VM        0x00000100  /* share the address space */
+#define CLONE_FILES     0x00000400  /* share the open file table */
+#define CLONE_SETTLS    0x00080000  /* set the child's FS base to tls */
+
+/**
+ * Create a child task that runs fn(arg) on stack and exits with its return
+ * value. With CLONE_VM|CLONE_FILES the child is a thread of the caller.
+ * @stack: top of the child's stack, required with CLONE_VM
+ * @tls: the child's thread pointer, if CLONE_SETTLS
+ * @return: the child's pid, or -1 with errno set
+ */
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, void *tls);
+
+/**
+ * Give up the CPU to another runnable task.
+ */
+int sched_yield(void);
+
+/**
+ * Set the policy and real-time priority of a task. Real-time tasks always
+ * run before SCHED_OTHER tasks, but together may use at most 95% of each
+ * CPU per second so the rest of the system keeps running.
+ * @pid: the task, 0 for the caller
+ * @param: sched_priority 1 to 99 for SCHED_FIFO/SCHED_RR, 0 for SCHED_OTHER
+ * @return: 0, or -1 with errno set
+ */
+int sched_setscheduler(pid_t pid, int policy, const struct sched_param *param);
+
+/**
+ * @return: the policy of the task, or -1 with errno set
+ */
+int sched_getscheduler(pid_t pid);
+
+/**
+ * Change the real-time priority of a task, keeping its policy.
+ */
+int sched_setparam(pid_t pid, const struct sched_param *param);
+
+int sched_getparam(pid_t pid, struct sched_param *param);
+
+int sched_get_priority_max(int policy);
+
+int sched_get_priority_min(int policy);
+
+#endif //_SCHED_H
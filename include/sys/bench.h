@@ -0,0 +1,32 @@
+#ifndef SBUNIX_BENCH_H
+#define SBUNIX_BENCH_H
+
+#include <sys/types.h>
+
+/* Helpers shared by the benchmarks in bin/ */
+
+/* How late a task woke up from its sleeps, see measure_lateness() */
+struct lateness {
+    uint64_t avg_us;
+    uint64_t max_us;
+};
+
+/**
+ * Read the monotonic clock, see clock_gettime().
+ * @return: nanoseconds since boot
+ */
+uint64_t now_ns(void);
+
+/**
+ * Sleep for ms milliseconds with nanosleep().
+ */
+void sleep_ms(long ms);
+
+/**
+ * Sleep ms over and over and measure how late each wakeup was.
+ * @nwakes: the number of sleeps, or 0 to keep sleeping for run_ms
+ * @late: filled in with the average and worst lateness
+ */
+void measure_lateness(long ms, int nwakes, long run_ms, struct lateness *late);
+
+#endif //SBUNIX_BENCH_H
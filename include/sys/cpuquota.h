@@ -0,0 +1,26 @@
+#ifndef SBUNIX_CPUQUOTA_H
+#define SBUNIX_CPUQUOTA_H
+
+#include <sys/types.h>
+
+/* Limits of cpuquota(2), in milliseconds */
+#define CPUQUOTA_PERIOD_MIN  10
+#define CPUQUOTA_PERIOD_MAX  10000
+
+struct cpu_quota {
+    uint32_t quota_ms;   /* CPU time allowed per period, 0 for no limit */
+    uint32_t period_ms;  /* length of a period */
+};
+
+/**
+ * Cap the CPU time of a task. Once it has run quota_ms in the current
+ * period it is parked until the next period starts. The limit is kept
+ * across exec and inherited by children.
+ * @pid: the task, 0 for the caller
+ * @set: the new limit, or NULL to only query
+ * @old: if not NULL, filled in with the previous limit
+ * @return: 0, or -1 with errno set
+ */
+int cpuquota(pid_t pid, const struct cpu_quota *set, struct cpu_quota *old);
+
+#endif //SBUNIX_CPUQUOTA_H
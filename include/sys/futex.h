@@ -0,0 +1,21 @@
+#ifndef _SYS_FUTEX_H
+#define _SYS_FUTEX_H
+
+#include <sys/defs.h>
+
+struct timespec; /* from <time.h> */
+
+/* Operations for futex(2) */
+#define FUTEX_WAIT          0
+#define FUTEX_WAKE          1
+#define FUTEX_PRIVATE_FLAG  128  /* accepted, every futex is private to its mm */
+
+/**
+ * FUTEX_WAIT: sleep if *uaddr == val, until woken or timeout (relative,
+ *             NULL for none) runs out. Fails with EAGAIN if *uaddr != val
+ *             and ETIMEDOUT.
+ * FUTEX_WAKE: wake up to val tasks waiting on uaddr, return how many.
+ */
+int futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout);
+
+#endif //_SYS_FUTEX_H
@@ -6,9 +6,16 @@
 /* For getprocs(2) */
 struct proc_struct {
     pid_t pid;
+    uint64_t utime;  /* user CPU time in microseconds */
+    uint64_t stime;  /* system CPU time in microseconds */
     char cmd[];
 };
 
+/* Bytes taken by a proc_struct with a cmd of cmdlen characters, each
+ * proc_struct in the buffer starts 8 byte aligned */
+#define PROC_STRUCT_SIZE(cmdlen) \
+    ((sizeof(struct proc_struct) + (cmdlen) + 1 + 7) & ~(size_t)7)
+
 /**
  * The syscall to enable ps(1)
  * @procbuf: buffer into which proc_struct's will be stored
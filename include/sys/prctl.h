@@ -0,0 +1,18 @@
+#ifndef _SYS_PRCTL_H
+#define _SYS_PRCTL_H
+
+/* Codes for arch_prctl(2) */
+#define ARCH_SET_GS     0x1001
+#define ARCH_SET_FS     0x1002
+#define ARCH_GET_FS     0x1003
+#define ARCH_GET_GS     0x1004
+
+/**
+ * Set or get the FS base, the thread pointer of the calling task.
+ * ARCH_SET_FS sets it to addr, ARCH_GET_FS stores it in *(unsigned long *)addr.
+ * The GS base belongs to the kernel, ARCH_*_GS fail with EINVAL.
+ * @return: 0, or -1 with errno set
+ */
+int arch_prctl(int code, unsigned long addr);
+
+#endif //_SYS_PRCTL_H
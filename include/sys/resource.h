@@ -3,11 +3,37 @@
 
 #include <sys/time.h>
 
+/* Same layout as Linux, the fields without a comment are always 0 */
 struct rusage {
-    /* at least the following members */
     struct timeval ru_utime;  /* User time used */
     struct timeval ru_stime;  /* System time used */
-
+    long ru_maxrss;
+    long ru_ixrss;
+    long ru_idrss;
+    long ru_isrss;
+    long ru_minflt;           /* Page faults served from memory */
+    long ru_majflt;           /* Page faults that read a file */
+    long ru_nswap;
+    long ru_inblock;
+    long ru_oublock;
+    long ru_msgsnd;
+    long ru_msgrcv;
+    long ru_nsignals;
+    long ru_nvcsw;            /* Voluntary context switches */
+    long ru_nivcsw;           /* Involuntary context switches */
 };
 
+/* For getrusage(2) */
+#define RUSAGE_SELF      0
+#define RUSAGE_CHILDREN -1
+
+/* For getpriority(2) and setpriority(2) */
+#define PRIO_PROCESS 0
+#define PRIO_PGRP    1
+#define PRIO_USER    2
+
+int getpriority(int which, int who);
+int setpriority(int which, int who, int prio);
+int getrusage(int who, struct rusage *usage);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef SBUNIX_SCHEDCLASS_H
+#define SBUNIX_SCHEDCLASS_H
+
+/* Scheduler classes for schedclass(2) */
+#define SCHED_CLASS_RR     0  /* round robin with fixed timeslices */
+#define SCHED_CLASS_MLFQ   1  /* multi-level feedback queue */
+#define SCHED_CLASS_CFS    2  /* fair share by virtual runtime, uses nice */
+#define SCHED_CLASS_NUM    3
+
+/**
+ * Select the scheduler class used by the whole system.
+ * @class_id: one of SCHED_CLASS_*, or -1 to only query the current class
+ * @return: the previous class, or -1 with errno set
+ */
+int schedclass(int class_id);
+
+
+#endif //SBUNIX_SCHEDCLASS_H
@@ -0,0 +1,39 @@
+#ifndef SBUNIX_SCHEDSTAT_H
+#define SBUNIX_SCHEDSTAT_H
+
+#include <sys/types.h>
+
+/* Histogram bucket i counts samples of [2^i, 2^(i+1)) TSC cycles, the last
+ * bucket also counts everything larger */
+#define SCHEDSTAT_BUCKETS 32
+
+struct sched_hist {
+    uint32_t count[SCHEDSTAT_BUCKETS];
+    uint64_t total;  /* sum of the samples in TSC cycles */
+    uint64_t max;    /* largest sample in TSC cycles */
+};
+
+/* For schedstat(2) */
+struct schedstat {
+    uint64_t tsc_khz;         /* TSC cycles per millisecond */
+    uint64_t switches;        /* context switches, system wide only */
+    uint64_t rr_exchanges;    /* rr run_queue/just_ran_queue exchanges */
+    uint64_t steals;          /* tasks taken from another CPU's queues */
+    uint64_t handoffs;        /* switches straight to a woken peer */
+    uint64_t quota_throttles; /* tasks parked for running out of cpuquota(2) */
+    uint64_t cr3_loads;       /* page table switches, see LAZY_TLB */
+    struct sched_hist wakeup; /* woken up until running */
+    struct sched_hist runwait;/* queued runnable until running */
+    struct sched_hist slice;  /* running until switched out */
+    struct sched_hist tick_irqoff; /* timer tick with interrupts off, system wide */
+};
+
+/**
+ * Read the scheduler statistics.
+ * @pid: the task to read, or 0 for the whole system
+ * @stat: filled in, the system wide counters are 0 for a single task
+ * @return: 0, or -1 with errno set
+ */
+int schedstat(pid_t pid, struct schedstat *stat);
+
+#endif //SBUNIX_SCHEDSTAT_H
@@ -324,5 +324,8 @@
 #define SYS_kexec_file_load 320
 #define SYS_bpf 321
 #define SYS_getprocs 322
+#define SYS_schedclass 323
+#define SYS_schedstat 324
+#define SYS_cpuquota 325
 
 #endif
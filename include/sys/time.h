@@ -15,4 +15,7 @@ struct itimerval {
     struct timeval it_value;    /* Current value */
 };
 
+/* There are no time zones, tz is ignored */
+int gettimeofday(struct timeval *tv, void *tz);
+
 #endif
\ No newline at end of file
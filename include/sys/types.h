@@ -13,6 +13,7 @@ typedef unsigned long ino_t;
 
 typedef long int time_t;
 typedef long int suseconds_t;
+typedef int clockid_t;
 
 typedef void * userptr_t;
 
@@ -0,0 +1,25 @@
+#ifndef SBUNIX_VTIME_H
+#define SBUNIX_VTIME_H
+
+#include <sys/types.h>
+
+/* The kernel maps the time page read-only here in every user process,
+ * the page right below the stack area */
+#define VTIME_ADDR  0x0000555555553000ULL
+
+/*
+ * The clock parameters of the time page, enough for clock_gettime() to
+ * turn the TSC into nanoseconds without a system call:
+ *      ns = ((tsc - tsc_base) * tsc_mult >> tsc_shift) + clock base
+ * The kernel makes seq odd while it updates the rest, a reader retries
+ * if seq was odd or changed while it read.
+ */
+struct vtime {
+    volatile uint32_t seq;
+    uint32_t tsc_shift;
+    uint64_t tsc_mult;      /* 0 until the TSC is calibrated, then use it */
+    uint64_t tsc_base;      /* TSC at monotonic time 0 */
+    uint64_t realtime_base; /* ns since the epoch at monotonic time 0 */
+};
+
+#endif //SBUNIX_VTIME_H
@@ -31,6 +31,16 @@ struct tm {
     int tm_yday;
 };
 
+/* Clocks for clock_gettime() */
+#define CLOCK_REALTIME   0  /* since the epoch */
+#define CLOCK_MONOTONIC  1  /* since boot, never steps */
+
 int nanosleep(const struct timespec *req, struct timespec *rem);
 
+/**
+ * Read a clock, with nanosecond resolution.
+ * @return: 0, or -1 with errno set to EINVAL for an unknown clock
+ */
+int clock_gettime(clockid_t clk, struct timespec *tp);
+
 #endif
\ No newline at end of file
@@ -12,6 +12,8 @@ extern char **__environ;
 
 unsigned int sleep(unsigned int seconds);
 
+int nice(int inc);
+
 typedef long intptr_t;
 void *sbrk(intptr_t increment);
 
@@ -0,0 +1,33 @@
+#include <time.h>
+#include <sys/bench.h>
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, ms % 1000 * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+void measure_lateness(long ms, int nwakes, long run_ms, struct lateness *late) {
+    uint64_t start, ns, total = 0, worst = 0, n = 0, end;
+    uint64_t expect = (uint64_t)ms * 1000000;
+
+    end = now_ns() + (uint64_t)run_ms * 1000000;
+    while(nwakes? n < (uint64_t)nwakes : now_ns() < end) {
+        start = now_ns();
+        sleep_ms(ms);
+        ns = now_ns() - start;
+        ns = (ns > expect)? ns - expect : 0;
+        total += ns;
+        if(ns > worst)
+            worst = ns;
+        n++;
+    }
+    late->avg_us = total / (n? n : 1) / 1000;
+    late->max_us = worst / 1000;
+}
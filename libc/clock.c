@@ -0,0 +1,65 @@
+#include <time.h>
+#include <sys/time.h>
+#include <sys/vtime.h>
+#include <syscall.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+    return (uint64_t)hi << 32 | lo;
+}
+
+/**
+ * Read the monotonic clock from the kernel's time page, see <sys/vtime.h>.
+ * @return: 0, or -1 if the kernel has no TSC clock yet
+ */
+static int vtime_monotonic(uint64_t *ns, uint64_t *realtime_base) {
+    const struct vtime *vt = (const struct vtime *)VTIME_ADDR;
+    uint64_t mult, base, tsc;
+    uint32_t seq, shift;
+
+    do {
+        seq = vt->seq;
+        __asm__ __volatile__ ("" ::: "memory"); /* x86 loads are not reordered */
+        shift = vt->tsc_shift;
+        mult = vt->tsc_mult;
+        base = vt->tsc_base;
+        *realtime_base = vt->realtime_base;
+        tsc = rdtsc();
+        __asm__ __volatile__ ("" ::: "memory");
+    } while((seq & 1) || seq != vt->seq);
+
+    if(!mult)
+        return -1;
+    *ns = (uint64_t)(((__uint128_t)(tsc - base) * mult) >> shift);
+    return 0;
+}
+
+/**
+ * Read the clock without a system call when the kernel's time page has
+ * the TSC scale, otherwise ask the kernel.
+ */
+int clock_gettime(clockid_t clk, struct timespec *tp) {
+    uint64_t ns, realtime_base;
+
+    if((clk != CLOCK_REALTIME && clk != CLOCK_MONOTONIC) ||
+            vtime_monotonic(&ns, &realtime_base) < 0)
+        return (int) syscall_2(SYS_clock_gettime, (uint64_t)clk, (uint64_t)tp);
+    if(clk == CLOCK_REALTIME)
+        ns += realtime_base;
+    tp->tv_sec = (time_t)(ns / NSEC_PER_SEC);
+    tp->tv_nsec = (long)(ns % NSEC_PER_SEC);
+    return 0;
+}
+
+int gettimeofday(struct timeval *tv, void *tz) {
+    struct timespec ts;
+
+    if(clock_gettime(CLOCK_REALTIME, &ts) < 0)
+        return -1;
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = (suseconds_t)(ts.tv_nsec / 1000);
+    return 0;
+}
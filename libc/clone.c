@@ -0,0 +1,56 @@
+#include <sched.h>
+#include <errno.h>
+#include <sys/syscall.h>
+
+#define __STR(x)    #x
+#define STR(x)      __STR(x)
+
+/*
+ * int _clone(int (*fn)(void *), void *stack, int flags, void *arg, void *tls)
+ *                   rdi           rsi          edx        rcx        r8
+ *
+ * fn and arg are pushed on the child's stack before the syscall, the child
+ * returns from it with that stack, pops them and calls fn(arg). The child
+ * never returns from here: it exits with fn's return value.
+ * Returns the raw syscall result in the parent.
+ */
+int _clone(int (*fn)(void *), void *stack, int flags, void *arg, void *tls);
+__asm__ (
+    ".global _clone\n"
+    "_clone:\n"
+    "    andq $-16, %rsi\n"         /* ABI: align stack to 16 bytes */
+    "    subq $16, %rsi\n"
+    "    movq %rdi, (%rsi)\n"       /* fn */
+    "    movq %rcx, 8(%rsi)\n"      /* arg */
+    "    movslq %edx, %rdi\n"       /* flags */
+    "    xorl %edx, %edx\n"         /* no parent_tid */
+    "    xorl %r10d, %r10d\n"       /* no child_tid, tls is already in r8 */
+    "    movl $" STR(SYS_clone) ", %eax\n"
+    "    syscall\n"
+    "    testq %rax, %rax\n"
+    "    jnz 1f\n"
+    "    xorl %ebp, %ebp\n"         /* child: outermost frame */
+    "    popq %rax\n"
+    "    popq %rdi\n"
+    "    call *%rax\n"
+    "    movl %eax, %edi\n"
+    "    movl $" STR(SYS_exit) ", %eax\n"
+    "    syscall\n"
+    "    hlt\n"
+    "1:  ret\n"
+);
+
+int clone(int (*fn)(void *), void *stack, int flags, void *arg, void *tls) {
+    int rv;
+
+    if(!fn || !stack) {
+        errno = EINVAL;
+        return -1;
+    }
+    rv = _clone(fn, stack, flags, arg, tls);
+    if(rv < 0) {
+        errno = -rv;
+        return -1;
+    }
+    return rv;
+}
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #define MAX(a, b)           (((a)>(b))?(a):(b))
 #define MIN(a, b)           (((a)<(b))?(a):(b))
@@ -15,6 +16,8 @@
 
 /* todo: extern struct __freeblk *_freehd;*/
 static struct _freeblk *_freehd = NULL;
+/* Threads share the heap, malloc and free hold this while using it */
+static pthread_mutex_t _malloc_lock = PTHREAD_MUTEX_INITIALIZER;
 
 struct _freeblk {
     size_t blocklen;  /* Always >= sizeof(struct _freeblk) */
@@ -201,6 +204,7 @@ void *malloc(size_t size) {
         return NULL;
     }
 
+    pthread_mutex_lock(&_malloc_lock);
     target = _find_freeblk(reqsize);
     if(target != NULL) {
         if(target->blocklen == reqsize) {
@@ -219,6 +223,7 @@ void *malloc(size_t size) {
         target = sbrk(increment);
         if(target == (struct _freeblk*)-1) {
             /* errno = ENOMEM;  Set by sbrk() */
+            pthread_mutex_unlock(&_malloc_lock);
             return NULL;
         } else {
             target->blocklen = reqsize;
@@ -230,6 +235,7 @@ void *malloc(size_t size) {
         }
     }
     _printfreelist();
+    pthread_mutex_unlock(&_malloc_lock);
     return retptr;
 }
 
@@ -247,8 +253,10 @@ void free(void *ptr) {
     block->prev = NULL;
     /* zero fill free'd space */
     memset(INC_PTR(block, sizeof(size_t)), 0, block->blocklen - sizeof(size_t));
+    pthread_mutex_lock(&_malloc_lock);
     _append_freelist(block);
     _printfreelist();
+    pthread_mutex_unlock(&_malloc_lock);
 }
 
 /**
@@ -0,0 +1,29 @@
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+/* Nice values, the kernel clamps to these (see task_set_nice()) */
+#define NICE_MIN  -20
+#define NICE_MAX   19
+
+/**
+ * Add inc to the nice value of the calling process.
+ * @return: the new nice value, or -1 with errno set. -1 is also a valid
+ *          nice value, check errno after setting it to 0.
+ */
+int nice(int inc) {
+    int prio;
+
+    errno = 0;
+    prio = getpriority(PRIO_PROCESS, 0);
+    if(prio == -1 && errno)
+        return -1;
+    prio += inc;
+    if(prio < NICE_MIN)
+        prio = NICE_MIN;
+    else if(prio > NICE_MAX)
+        prio = NICE_MAX;
+    if(setpriority(PRIO_PROCESS, 0, prio) < 0)
+        return -1;
+    return prio;
+}
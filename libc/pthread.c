@@ -0,0 +1,269 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syscall.h>
+#include <sys/prctl.h>
+#include <sys/futex.h>
+
+/*
+ * Threads are tasks created by clone(2) sharing the address space and the
+ * open files. Each thread gets one malloc'd block holding its stack, its
+ * copy of the TLS segment (.tdata/.tbss) and its struct pthread:
+ *
+ *   | stack ... | TLS block | struct pthread |
+ *                           ^ thread pointer, the FS base
+ *
+ * This is the x86_64 TLS layout (variant II), the linker resolves
+ * __thread variables to negative offsets from %fs, and %fs:0 must point
+ * to itself.
+ *
+ * A thread is a child of the thread that created it, so only that thread
+ * can join it. exit() ends only the calling thread.
+ *
+ * Mutexes and condition variables are futexes, they only enter the kernel
+ * to sleep when contended and to wake a sleeper.
+ */
+
+#define THREAD_STACK_SIZE   (64 * 1024)
+#define ALIGN_UP(x, a)      (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+#define PT_TLS  7
+
+/* Just the fields of the ELF headers we need to find PT_TLS */
+struct elf_ehdr {
+    unsigned char e_ident[16];
+    uint16_t e_type, e_machine;
+    uint32_t e_version;
+    uint64_t e_entry, e_phoff, e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize, e_phentsize, e_phnum, e_shentsize, e_shnum, e_shstrndx;
+};
+
+struct elf_phdr {
+    uint32_t p_type, p_flags;
+    uint64_t p_offset, p_vaddr, p_paddr, p_filesz, p_memsz, p_align;
+};
+
+struct pthread {
+    struct pthread *self;   /* %fs:0 */
+    pid_t tid;
+    void *(*start)(void *);
+    void *arg;
+    void *retval;
+    void *map;              /* the malloc'd block, NULL for the main thread */
+};
+
+/* Defined by the linker, our ELF header is mapped with the first segment */
+extern const char __ehdr_start[];
+
+static const char *tls_image;   /* initial values of .tdata */
+static size_t tls_filesz;
+static size_t tls_size;         /* memsz rounded up to tls_align */
+static size_t tls_align = 16;
+
+/* The main thread's TLS, unless it is too large */
+static char main_tls[256 + sizeof(struct pthread)] __attribute__((aligned(64)));
+
+/**
+ * Copy the TLS image below tp and make tp the thread pointer of struct
+ * pthread at tp.
+ */
+static struct pthread *tls_init(char *tp) {
+    struct pthread *self = (struct pthread *)tp;
+
+    memcpy(tp - tls_size, tls_image, tls_filesz);
+    memset(tp - tls_size + tls_filesz, 0, tls_size - tls_filesz);
+    memset(self, 0, sizeof(*self));
+    self->self = self;
+    return self;
+}
+
+/**
+ * Find the PT_TLS segment and give the main thread its TLS, called from
+ * crt1 before main() and before anything uses errno.
+ */
+void __libc_setup_tls(void) {
+    const struct elf_ehdr *ehdr = (const struct elf_ehdr *)__ehdr_start;
+    const struct elf_phdr *phdr;
+    struct pthread *self;
+    char *tp, *block;
+    int i;
+
+    for(i = 0; i < ehdr->e_phnum; i++) {
+        phdr = (const struct elf_phdr *)(__ehdr_start + ehdr->e_phoff +
+                                         i * ehdr->e_phentsize);
+        if(phdr->p_type != PT_TLS)
+            continue;
+        tls_image = (const char *)phdr->p_vaddr;
+        tls_filesz = phdr->p_filesz;
+        if(phdr->p_align > tls_align)
+            tls_align = phdr->p_align;
+        tls_size = ALIGN_UP(phdr->p_memsz, tls_align);
+        break;
+    }
+
+    if(tls_size + sizeof(struct pthread) <= sizeof(main_tls) && tls_align <= 64) {
+        block = main_tls;
+    } else {
+        block = malloc(tls_size + sizeof(struct pthread) + tls_align);
+        if(!block)
+            syscall_1(SYS_exit, 127); /* can not even set errno */
+    }
+    tp = (char *)ALIGN_UP((uint64_t)block + tls_size, tls_align);
+    self = tls_init(tp);
+    self->tid = (pid_t)syscall_0(SYS_getpid);
+    syscall_2(SYS_arch_prctl, ARCH_SET_FS, (uint64_t)tp);
+}
+
+pthread_t pthread_self(void) {
+    struct pthread *self;
+
+    __asm__ ("movq %%fs:0, %0" : "=r"(self));
+    return self;
+}
+
+static int start_thread(void *arg) {
+    struct pthread *self = arg;
+
+    self->retval = self->start(self->arg);
+    return 0;
+}
+
+/**
+ * @attr: must be NULL
+ * @return: 0, or an error number
+ */
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start_routine)(void *), void *arg) {
+    struct pthread *t;
+    char *map, *tp;
+    int tid;
+
+    if(attr)
+        return EINVAL;
+    map = malloc(THREAD_STACK_SIZE + tls_size + sizeof(struct pthread) +
+                 tls_align);
+    if(!map)
+        return EAGAIN;
+    tp = (char *)ALIGN_UP((uint64_t)map + THREAD_STACK_SIZE + tls_size,
+                          tls_align);
+    t = tls_init(tp);
+    t->start = start_routine;
+    t->arg = arg;
+    t->map = map;
+
+    tid = clone(start_thread, map + THREAD_STACK_SIZE,
+                CLONE_VM | CLONE_FILES | CLONE_SETTLS, t, tp);
+    if(tid < 0) {
+        free(map);
+        return errno;
+    }
+    /* The thread does not use its tid, so setting it here is no race */
+    t->tid = tid;
+    *thread = t;
+    return 0;
+}
+
+/**
+ * Wait for a thread made by this thread to exit and free it.
+ * @return: 0, or an error number
+ */
+int pthread_join(pthread_t thread, void **retval) {
+    if(!thread || thread == pthread_self() || !thread->map)
+        return EINVAL;
+    if(waitpid(thread->tid, NULL, 0) != thread->tid)
+        return errno;
+    if(retval)
+        *retval = thread->retval;
+    free(thread->map);
+    return 0;
+}
+
+void pthread_exit(void *retval) {
+    pthread_self()->retval = retval;
+    for(;;)
+        syscall_1(SYS_exit, 0);
+}
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr) {
+    mutex->locked = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+    return mutex->locked? EBUSY : 0;
+}
+
+/**
+ * Take the lock, marking it contended (2) so the holder wakes us.
+ * From "Futexes Are Tricky", Ulrich Drepper.
+ */
+static void mutex_lock_contended(pthread_mutex_t *mutex, int c) {
+    if(c != 2)
+        c = __sync_lock_test_and_set(&mutex->locked, 2);
+    while(c != 0) {
+        futex((uint32_t *)&mutex->locked, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 2,
+              NULL);
+        c = __sync_lock_test_and_set(&mutex->locked, 2);
+    }
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    int c = __sync_val_compare_and_swap(&mutex->locked, 0, 1);
+
+    if(c != 0)
+        mutex_lock_contended(mutex, c);
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+    return __sync_bool_compare_and_swap(&mutex->locked, 0, 1)? 0 : EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+    /* 1 -> 0 without a syscall, unless someone may be waiting */
+    if(__sync_fetch_and_sub(&mutex->locked, 1) != 1) {
+        mutex->locked = 0;
+        futex((uint32_t *)&mutex->locked, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1,
+              NULL);
+    }
+    return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr) {
+    cond->seq = 0;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond) {
+    return 0;
+}
+
+/**
+ * Sleep until signalled, a signal after we read seq changes it so the
+ * futex wait returns at once. May wake up spuriously, like POSIX allows.
+ */
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    int seq = cond->seq;
+
+    pthread_mutex_unlock(mutex);
+    futex((uint32_t *)&cond->seq, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, seq, NULL);
+    /* Other waiters may have been woken too, keep the mutex contended */
+    mutex_lock_contended(mutex, 1);
+    return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t *cond) {
+    __sync_fetch_and_add(&cond->seq, 1);
+    futex((uint32_t *)&cond->seq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL);
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+    __sync_fetch_and_add(&cond->seq, 1);
+    futex((uint32_t *)&cond->seq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 0x7fffffff,
+          NULL);
+    return 0;
+}
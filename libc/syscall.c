@@ -2,6 +2,13 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/utsname.h>
+#include <sys/schedclass.h>
+#include <sys/resource.h>
+#include <sys/schedstat.h>
+#include <sys/prctl.h>
+#include <sched.h>
+#include <sys/futex.h>
+#include <sys/cpuquota.h>
 
 #define SYSCALL_ERROR_RETURN(rv) do { \
         if(rv < 0 && rv > -4096) {    \
@@ -253,3 +260,79 @@ int munmap(void *addr, size_t length) {
 ssize_t getprocs(void *procbuf, size_t length) {
     return (int) syscall_2(SYS_getprocs, (uint64_t)procbuf, (uint64_t)length);
 }
+
+int schedclass(int class_id) {
+    return (int) syscall_1(SYS_schedclass, (uint64_t)class_id);
+}
+
+/* The kernel returns 20 - nice, so errors can not be confused with it */
+int getpriority(int which, int who) {
+    int rv = (int) syscall_2(SYS_getpriority, (uint64_t)which, (uint64_t)who);
+    return rv < 0? rv : 20 - rv;
+}
+
+int setpriority(int which, int who, int prio) {
+    return (int) syscall_3(SYS_setpriority, (uint64_t)which, (uint64_t)who,
+            (uint64_t)prio);
+}
+
+int schedstat(pid_t pid, struct schedstat *stat) {
+    return (int) syscall_2(SYS_schedstat, (uint64_t)pid, (uint64_t)stat);
+}
+
+int getrusage(int who, struct rusage *usage) {
+    return (int) syscall_2(SYS_getrusage, (uint64_t)who, (uint64_t)usage);
+}
+
+int sched_yield(void) {
+    return (int) syscall_0(SYS_sched_yield);
+}
+
+int sched_setscheduler(pid_t pid, int policy, const struct sched_param *param) {
+    return (int) syscall_3(SYS_sched_setscheduler, (uint64_t)pid,
+            (uint64_t)policy, (uint64_t)param);
+}
+
+int sched_setparam(pid_t pid, const struct sched_param *param) {
+    return (int) syscall_2(SYS_sched_setparam, (uint64_t)pid, (uint64_t)param);
+}
+
+int sched_getscheduler(pid_t pid) {
+    return (int) syscall_1(SYS_sched_getscheduler, (uint64_t)pid);
+}
+
+int sched_getparam(pid_t pid, struct sched_param *param) {
+    return (int) syscall_2(SYS_sched_getparam, (uint64_t)pid, (uint64_t)param);
+}
+
+int cpuquota(pid_t pid, const struct cpu_quota *set, struct cpu_quota *old) {
+    return (int) syscall_3(SYS_cpuquota, (uint64_t)pid, (uint64_t)set, (uint64_t)old);
+}
+
+/* Not syscalls, the kernel's range is fixed */
+int sched_get_priority_max(int policy) {
+    if(policy == SCHED_FIFO || policy == SCHED_RR)
+        return SCHED_RT_PRIO_MAX;
+    if(policy == SCHED_OTHER)
+        return 0;
+    errno = EINVAL;
+    return -1;
+}
+
+int sched_get_priority_min(int policy) {
+    if(policy == SCHED_FIFO || policy == SCHED_RR)
+        return SCHED_RT_PRIO_MIN;
+    if(policy == SCHED_OTHER)
+        return 0;
+    errno = EINVAL;
+    return -1;
+}
+
+int arch_prctl(int code, unsigned long addr) {
+    return (int) syscall_2(SYS_arch_prctl, (uint64_t)code, (uint64_t)addr);
+}
+
+int futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout) {
+    return (int) syscall_4(SYS_futex, (uint64_t)uaddr, (uint64_t)op,
+            (uint64_t)val, (uint64_t)timeout);
+}
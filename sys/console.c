@@ -3,6 +3,7 @@
 #include <sbunix/console.h>
 #include <sbunix/serial.h>
 #include <sbunix/fs/terminal.h>
+#include <sbunix/interrupt/softirq.h>
 
 #define SCRN_BASE ((uint16_t *)kphys_to_virt(0xb8000))
 #define SCRN_WIDTH 80U
@@ -33,8 +34,10 @@ void clear_line(uint8_t lineno) {
  * by Dark Fiber
  */
 void move_csr(void) {
+    uint64_t flags;
     uint16_t temp;
 
+    flags = local_irq_save();
     temp = (uint16_t)((cursor_y * SCRN_WIDTH) + cursor_x);
 
     // cursor LOW port to vga INDEX register
@@ -43,6 +46,7 @@ void move_csr(void) {
     // cursor HIGH port to vga INDEX register
     outb(0x3D4, 0x0E);
     outb(0x3D5, (uint8_t)((temp>>8)&0xFF));
+    local_irq_restore(flags);
 }
 
 void clear_console(void) {
@@ -61,11 +65,7 @@ int curr_tab_to_spaces(void) {
     return ((cursor_x + 4) & ~3) - cursor_x;
 }
 
-/*
- * Put a character at the current cursor
- * does not update the VGA cursor
- */
-void putch(char c) {
+static void __putch(char c) {
     /* uncomment this next line to write to the serial port as well */
     /*serial_write(c);*/
 
@@ -81,7 +81,7 @@ void putch(char c) {
     } else if(c == '\t') {
         int spaces = curr_tab_to_spaces();
         while(spaces--)
-            putch(' ');
+            __putch(' ');
     } else if(c == '\r') {
         cursor_x = 0;
     } else if(c == '\n') {
@@ -110,6 +110,18 @@ void putch(char c) {
     }
 }
 
+/*
+ * Put a character at the current cursor
+ * does not update the VGA cursor
+ * The keyboard interrupt echoes input, so interrupts are disabled while
+ * the cursor moves.
+ */
+void putch(char c) {
+    uint64_t flags = local_irq_save();
+    __putch(c);
+    local_irq_restore(flags);
+}
+
 /*
  * Write a string to the console
  */
@@ -264,6 +276,44 @@ unsigned char sc_to_ascii(uint8_t scan_code, int shift, int control) {
     return c;
 }
 
+/* Scan codes from the keyboard interrupt not yet given to the terminal.
+ * Only the keyboard interrupt adds and only its softirq, on the same CPU,
+ * removes. */
+#define SC_QUEUE_SIZE 64
+static uint8_t sc_queued[SC_QUEUE_SIZE];
+static volatile uint32_t sc_head, sc_tail;
+
+/**
+ * Keyboard bottom half, see <sbunix/interrupt/softirq.h>.
+ */
+static void keyboard_softirq(void) {
+    uint64_t flags;
+    uint8_t scan_code;
+
+    while(sc_tail != sc_head) {
+        scan_code = sc_queued[sc_tail % SC_QUEUE_SIZE];
+        sc_tail++;
+        /* The terminal wakes readers, which touches the run queues */
+        flags = local_irq_save();
+        sc_add(scan_code);
+        local_irq_restore(flags);
+    }
+}
+
+void keyboard_init(void) {
+    open_softirq(KEYBOARD_SOFTIRQ, keyboard_softirq);
+}
+
+/**
+ * Save a scan code for keyboard_softirq(), from the keyboard interrupt.
+ * Key presses are dropped if the softirq falls SC_QUEUE_SIZE behind.
+ */
+void sc_queue(uint8_t scan_code) {
+    if(sc_head - sc_tail < SC_QUEUE_SIZE)
+        sc_queued[sc_head++ % SC_QUEUE_SIZE] = scan_code;
+    raise_softirq(KEYBOARD_SOFTIRQ);
+}
+
 /**
  * Add a scan code
  *
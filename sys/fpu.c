@@ -0,0 +1,208 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/fpu.h>
+#include <sbunix/sched.h>
+#include <sbunix/preempt.h>
+#include <sbunix/smp.h>
+#include <sbunix/string.h>
+#include <errno.h>
+
+/* XCR0 bits, the state components XSAVE saves and restores */
+#define XCR0_X87    0x1
+#define XCR0_SSE    0x2
+#define XCR0_AVX    0x4
+
+/* Control words after FNINIT, all exceptions masked */
+#define FPU_FCW_DEFAULT     0x037F
+#define FPU_MXCSR_DEFAULT   0x1F80
+
+/* Start of the FXSAVE area, and of the legacy region of the XSAVE area */
+struct fxsave_legacy {
+    uint16_t fcw;
+    uint16_t fsw;
+    uint8_t ftw;
+    uint8_t _rsvd;
+    uint16_t fop;
+    uint64_t fip;
+    uint64_t fdp;
+    uint32_t mxcsr;
+    uint32_t mxcsr_mask;
+} __attribute__((packed));
+
+static int use_xsave = 0;
+static uint64_t xcr0 = 0;
+static uint32_t fpu_size = 512; /* bytes of task->fpu in use */
+
+static inline void xsetbv(uint32_t reg, uint64_t val) {
+    __asm__ __volatile__ ("xsetbv" :: "c"(reg), "a"((uint32_t)val),
+                          "d"((uint32_t)(val >> 32)));
+}
+
+static inline void fpu_save(struct task_struct *task) {
+    if(use_xsave)
+        __asm__ __volatile__ ("xsave64 (%0)" :: "r"(task->fpu), "a"(-1),
+                              "d"(-1) : "memory");
+    else
+        __asm__ __volatile__ ("fxsave64 (%0)" :: "r"(task->fpu) : "memory");
+}
+
+static inline void fpu_restore(struct task_struct *task) {
+    if(use_xsave)
+        __asm__ __volatile__ ("xrstor64 (%0)" :: "r"(task->fpu), "a"(-1),
+                              "d"(-1) : "memory");
+    else
+        __asm__ __volatile__ ("fxrstor64 (%0)" :: "r"(task->fpu) : "memory");
+}
+
+/**
+ * True if the registers of this CPU hold task's state and task has used
+ * them since it was last switched in.
+ */
+static inline int fpu_live(struct cpu *cpu, struct task_struct *task) {
+    return cpu->fpu_owner == task && !(read_cr0() & CR0_TS);
+}
+
+/**
+ * Set or clear CR0.TS, writing CR0 only if it changes.
+ */
+static inline void fpu_set_ts(int ts) {
+    uint64_t cr0 = read_cr0();
+
+    if(ts && !(cr0 & CR0_TS))
+        write_cr0(cr0 | CR0_TS);
+    else if(!ts && (cr0 & CR0_TS))
+        clts();
+}
+
+/**
+ * Detect FXSAVE/XSAVE and set up the BSP, called from start() before
+ * smp_init() so the APs copy its CR4.
+ */
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if(!((edx >> 24) & 1))
+        kpanic("FXSAVE/FXRSTOR not supported\n");
+    if((ecx >> 26) & 1) {
+        use_xsave = 1;
+        xcr0 = XCR0_X87 | XCR0_SSE;
+        if((ecx >> 28) & 1)
+            xcr0 |= XCR0_AVX;
+    }
+
+    fpu_cpu_init();
+
+    if(use_xsave) {
+        /* EBX is the size of the area for the components enabled in XCR0 */
+        cpuid(0xD, &eax, &ebx, &ecx, &edx);
+        fpu_size = ebx;
+        if(fpu_size > PAGE_SIZE)
+            kpanic("XSAVE area of %u bytes does not fit in a page\n", fpu_size);
+    }
+    printk("FPU: %s, %s%u byte state\n", use_xsave? "XSAVE" : "FXSAVE",
+           (xcr0 & XCR0_AVX)? "AVX, " : "", fpu_size);
+}
+
+/**
+ * Enable SSE (and AVX) on this CPU, with CR0.TS set so that the first use
+ * traps into fpu_trap().
+ */
+void fpu_cpu_init(void) {
+    uint64_t cr4 = read_cr4();
+
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if(use_xsave)
+        cr4 |= CR4_OSXSAVE;
+    write_cr4(cr4);
+    if(use_xsave)
+        xsetbv(0, xcr0);
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+    this_cpu()->fpu_owner = NULL;
+}
+
+/**
+ * Called by context_switch() with interrupts disabled. Saves prev's state
+ * if it used the FPU, and lets next use the registers without a trap if
+ * they still hold its state.
+ */
+void fpu_switch(struct task_struct *prev, struct task_struct *next) {
+    struct cpu *cpu = this_cpu();
+
+    if(fpu_live(cpu, prev))
+        fpu_save(prev);
+    /* Another CPU may have loaded (and changed) next's state since */
+    fpu_set_ts(!(cpu->fpu_owner == next && next->fpu_cpu == cpu->id));
+}
+
+/**
+ * Device Not Available (#NM): the current task used the FPU with CR0.TS
+ * set. Load its state, or a clean state if this is its first use. The
+ * previous owner of the registers was saved when it was switched out.
+ */
+void fpu_trap(void) {
+    struct task_struct *curr = curr_task;
+    struct cpu *cpu = this_cpu();
+    struct fxsave_legacy *legacy;
+
+    /* Only user mode runs with a preempt count of 0, see irq_enter() */
+    if(curr->preempt_count != HARDIRQ_OFFSET)
+        kpanic("!! FPU used in the kernel by %s !!\n", curr->cmdline);
+
+    if(!curr->fpu) {
+        curr->fpu = (void *)get_free_page(0);
+        if(!curr->fpu) {
+            kill_curr_task(EXIT_FATALSIG + SIGKILL);
+            kpanic("!! kill_curr_task returned!! #NM ENOMEM !!\n");
+        }
+        /* Zeroed, XSTATE_BV of 0 loads the init state of XSAVE components */
+        legacy = curr->fpu;
+        legacy->fcw = FPU_FCW_DEFAULT;
+        legacy->mxcsr = FPU_MXCSR_DEFAULT;
+    }
+
+    clts();
+    fpu_restore(curr);
+    cpu->fpu_owner = curr;
+    curr->fpu_cpu = cpu->id;
+}
+
+/**
+ * Give the forked child a copy of the parent's FPU state, if it has one.
+ * @return: 0 on success, -ENOMEM
+ */
+int fpu_fork(struct task_struct *parent, struct task_struct *child) {
+    child->fpu = NULL;
+    child->fpu_cpu = -1;
+    if(!parent->fpu)
+        return 0;
+
+    child->fpu = (void *)get_free_page(0);
+    if(!child->fpu)
+        return -ENOMEM;
+    if(fpu_live(this_cpu(), parent))
+        fpu_save(parent);
+    memcpy(child->fpu, parent->fpu, fpu_size);
+    return 0;
+}
+
+/**
+ * Free the task's FPU state and forget that any CPU holds it. Called on
+ * task_destroy() and on exec, after which the task starts with a clean
+ * state on its next use of the FPU.
+ */
+void fpu_release(struct task_struct *task) {
+    int i;
+
+    for(i = 0; i < smp_num_cpus; i++) {
+        if(cpus[i].fpu_owner == task)
+            cpus[i].fpu_owner = NULL;
+    }
+    if(task == curr_task)
+        fpu_set_ts(1);
+    if(task->fpu) {
+        free_page((uint64_t)task->fpu);
+        task->fpu = NULL;
+    }
+    task->fpu_cpu = -1;
+}
@@ -1,6 +1,7 @@
 #include <sbunix/fs/pipe.h>
 #include <sbunix/sbunix.h>
 #include <sbunix/sched.h>
+#include <sbunix/preempt.h>
 #include <errno.h>
 #include <sbunix/string.h>
 
@@ -19,6 +20,10 @@ struct pipe_buf {
     char full;                       /* If the buffer is full */
     char read_closed;                /* All the read ends have been closed */
     char write_closed;               /* All the write ends have been closed */
+    struct wait_queue_head read_wait;  /* readers waiting for data */
+    struct wait_queue_head write_wait; /* writers waiting for room */
+    pid_t reader_woken;              /* last reader woken, to hand off to */
+    pid_t writer_woken;              /* last writer woken, to hand off to */
     unsigned char buf[PIPE_BUFSIZE]; /* Holds buffered data */
 };
 
@@ -41,6 +46,32 @@ struct file_ops write_end_ops = {
     .can_mmap = pipe_can_mmap
 };
 
+/**
+ * Wake the first waiter on wq and remember it, so that we can hand the CPU
+ * to it if we have to block before it runs.
+ */
+static void pipe_wake(struct wait_queue_head *wq, pid_t *woken) {
+    struct task_struct *task = wake_up(wq);
+    if(task)
+        *woken = task->pid;
+}
+
+/**
+ * Block on wq. If the peer we last woke is still waiting to run, switch
+ * straight to it: it is the one that can make progress on this pipe.
+ * Looked up by PID, it may have exited since.
+ */
+static void pipe_wait(struct wait_queue_head *wq, pid_t *woken) {
+    uint64_t flags = local_irq_save();
+    struct task_struct *peer = *woken? find_task_by_pid(*woken) : NULL;
+
+    *woken = 0;
+    if(peer)
+        sched_handoff(peer);
+    task_block_exclusive(wq);
+    local_irq_restore(flags);
+}
+
 /**
  * Cannot seek on a pipe
  */
@@ -70,7 +101,6 @@ ssize_t read_end_read(struct file *fp, char *buf, size_t count,
                       off_t *offset) {
     struct pipe_buf *pipe;
     ssize_t num_read;
-    int was_full;
     if(!fp)
         kpanic("file is NULL!");
     if(!buf)
@@ -87,12 +117,11 @@ ssize_t read_end_read(struct file *fp, char *buf, size_t count,
         if(pipe->write_closed) {
             return 0; /* Read the EOF */
         } else {
-            /* block until able to write again */
-            task_block(pipe);
+            /* block until there is data to read */
+            pipe_wait(&pipe->read_wait, &pipe->writer_woken);
         }
     }
     /* pipe has data to read */
-    was_full = pipe->full;
     num_read = 0;
     do {
         *buf++ = pipe->buf[pipe->start];
@@ -102,10 +131,11 @@ ssize_t read_end_read(struct file *fp, char *buf, size_t count,
         /* read either count bytes OR until pipe is empty */
     } while(num_read < count && pipe->start != pipe->end);
 
-    if(was_full) {
-        /* unblock any tasks that may have been waiting to write */
-        task_unblock(pipe);
-    }
+    /* unblock a task that may have been waiting to write */
+    pipe_wake(&pipe->write_wait, &pipe->writer_woken);
+    /* data is left, pass it on to the next reader */
+    if(pipe->start != pipe->end || pipe->full)
+        wake_up(&pipe->read_wait);
     return num_read;
 }
 
@@ -138,7 +168,7 @@ int read_end_close(struct file *fp) {
             fp->private_data = NULL;
         } else {
             /* unblock any task blocking on a write for THIS pipe */
-            task_unblock(pipe);
+            wake_up_all(&pipe->write_wait);
         }
         kfree(fp);
     }
@@ -181,11 +211,12 @@ ssize_t write_end_write(struct file *fp, const char *buf, size_t count,
 
     num_written = 0;
     while(num_written < count) {
-        while(pipe->full) {
-            /* First, unblock any task blocking on a read for THIS pipe */
-            task_unblock(pipe);
-            /* Then, block until someone wakes you up */
-            task_block(pipe);
+        cond_resched();
+        while(pipe->full && !pipe->read_closed) {
+            /* First, unblock a task blocking on a read for THIS pipe */
+            pipe_wake(&pipe->read_wait, &pipe->reader_woken);
+            /* Then, block until someone wakes you up, running it meanwhile */
+            pipe_wait(&pipe->write_wait, &pipe->reader_woken);
         }
         /* pipe may have been closed while waiting */
         if(pipe->read_closed)
@@ -196,6 +227,12 @@ ssize_t write_end_write(struct file *fp, const char *buf, size_t count,
         pipe->full = (pipe->end == pipe->start);
         num_written++;
     }
+    /* unblock a task waiting to read what we wrote */
+    if(num_written)
+        pipe_wake(&pipe->read_wait, &pipe->reader_woken);
+    /* room is left, pass it on to the next writer */
+    if(!pipe->full)
+        wake_up(&pipe->write_wait);
     return num_written;
 }
 
@@ -220,7 +257,7 @@ int write_end_close(struct file *fp) {
             fp->private_data = NULL;
         } else {
             /* unblock any task blocking on a read for THIS pipe */
-            task_unblock(pipe);
+            wake_up_all(&pipe->read_wait);
         }
         kfree(fp);
     }
@@ -249,6 +286,8 @@ int pipe_open(struct file **read_end, struct file **write_end) {
 
     /* Init pipe buffer */
     memset(new_buf, 0, sizeof(struct pipe_buf));
+    wait_queue_init(&new_buf->read_wait);
+    wait_queue_init(&new_buf->write_wait);
     /* Init read end */
     new_read->f_op = &read_end_ops;
     new_read->f_count = 1;
@@ -1,6 +1,7 @@
 #include <sbunix/fs/tarfs.h>
 #include <sbunix/string.h>
 #include <sbunix/sbunix.h>
+#include <sbunix/preempt.h>
 #include <dirent.h>
 #include <errno.h>
 
@@ -258,7 +259,7 @@ off_t tarfs_lseek(struct file *fp, off_t offset, int whence) {
 ssize_t tarfs_read(struct file *fp, char *buf, size_t count, off_t *offset) {
     struct posix_header_ustar *hd;
     char *file_data_start;
-    size_t bytes_left, num_read;
+    size_t bytes_left, num_read, done, chunk;
 
     /* Error checking */
     if(!fp || !buf || !offset || *offset < 0)
@@ -274,10 +275,16 @@ ssize_t tarfs_read(struct file *fp, char *buf, size_t count, off_t *offset) {
         return 0;
     bytes_left = fp->f_size - *offset;
     num_read = MIN(bytes_left, count);
-    file_data_start = (char *)(hd + 1);
+    file_data_start = (char *)(hd + 1) + *offset;
 //    debug("bytes_left=%d, offset=%d, num_read=%d, count=%d\n",
 //          (int)bytes_left, (int)*offset, (int)num_read, (int)count);
-    memcpy(buf, file_data_start + *offset, num_read);
+    /* A page at a time, a big read should not hold up other tasks */
+    for(done = 0; done < num_read; done += chunk) {
+        if(done)
+            cond_resched();
+        chunk = MIN(num_read - done, PAGE_SIZE);
+        memcpy(buf + done, file_data_start + done, chunk);
+    }
     *offset += num_read;
     return num_read;
 }
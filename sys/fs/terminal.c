@@ -2,6 +2,7 @@
 #include <sbunix/console.h>
 #include <sbunix/fs/terminal.h>
 #include <sbunix/sched.h>
+#include <sbunix/preempt.h>
 #include <errno.h>
 #include <sbunix/string.h>
 
@@ -18,6 +19,7 @@ struct terminal_buf {
     char echo;                       /* If local echo is enabled */
     volatile char delims;            /* number of line delimiters in the buffer */
     int  backspace;                  /* number backspaces we can take */
+    struct wait_queue_head read_wait; /* tasks waiting for a line */
     unsigned char buf[TERM_BUFSIZE]; /* Holds buffered characters */
 };
 
@@ -28,6 +30,7 @@ struct terminal_buf term = {
     .echo      = 1,
     .delims    = 0,
     .backspace = 0,
+    .read_wait = { { 0, NULL, NULL } },
     .buf       = {0}
 };
 
@@ -151,7 +154,7 @@ void term_putch(unsigned char c) {
     if(term.full) {
         /* print a bell to notify that we lost a character */
 //        putch('\a');
-        task_unblock_foreground(&term);
+        wake_up_foreground(&term.read_wait);
         return;
     }
 
@@ -160,7 +163,7 @@ void term_putch(unsigned char c) {
         term.backspace = 0;
         /* Add c to the buffer */
         term_push(c);
-        task_unblock_foreground(&term);
+        wake_up_foreground(&term.read_wait);
     } else if(c == '\t') {
         int spaces = curr_tab_to_spaces();
         term.backspace += spaces;
@@ -179,7 +182,7 @@ void term_putch(unsigned char c) {
         move_csr();
     }
     if(term.full) {
-        task_unblock_foreground(&term);
+        wake_up_foreground(&term.read_wait);
     }
 }
 
@@ -210,6 +213,7 @@ int term_readdir(struct file *filep, void *buf, unsigned int count) {
 ssize_t term_read(struct file *fp, char *buf, size_t count, off_t *offset) {
     struct terminal_buf *tb;
     ssize_t num_read;
+    uint64_t flags;
     int c;
 
     /* Error checking */
@@ -226,9 +230,11 @@ ssize_t term_read(struct file *fp, char *buf, size_t count, off_t *offset) {
     if(!curr_task->foreground && curr_task->pid > 2)
         return -EIO; /* should send SIGTTIN as well, but don't have signals */
 
+    /* The keyboard interrupt fills the buffer */
+    flags = local_irq_save();
     /* Block as a line has not been buffered yet */
     while(tb->delims == 0)
-        task_block(tb);
+        task_block(&tb->read_wait);
 
     /* Unblocked! We can read until delim or count bytes are consumed */
     num_read = 0;
@@ -238,6 +244,7 @@ ssize_t term_read(struct file *fp, char *buf, size_t count, off_t *offset) {
             break;
         buf[num_read++] = (char)c;
     }
+    local_irq_restore(flags);
     return num_read;
 }
 
@@ -265,6 +272,7 @@ ssize_t term_write(struct file *fp, const char *buf, size_t count,
     while(count--) {
         putch(*buf++);
         num_written++;
+        cond_resched();
     }
     move_csr();
     return num_written;
@@ -1,10 +1,10 @@
 #include <sbunix/gdt.h>
 #include <sbunix/asm.h>
+#include <sbunix/smp.h>
+#include <sbunix/string.h>
 
 /* adapted from Chris Stones, shovelos */
 
-#define MAX_GDT 32
-
 #define GDT_CS        (0x00180000000000)  /*** code segment descriptor ***/
 #define GDT_DS        (0x00100000000000)  /*** data segment descriptor ***/
 
@@ -33,7 +33,8 @@ struct sys_segment_descriptor {
 	uint64_t sd_xx3:19;    /* reserved */
 }__attribute__((packed));
 
-uint64_t gdt[MAX_GDT] = {
+/* Template copied into each CPU's own GDT, which gets its own TSS */
+static const uint64_t gdt[GDT_ENTRIES] = {
 	0,                      /*** NULL descriptor ***/
 	GDT_CS | P | DPL0 | L,  /*** kernel code segment descriptor ***/
 	GDT_DS | P | W | DPL0,  /*** kernel data segment descriptor ***/
@@ -43,21 +44,23 @@ uint64_t gdt[MAX_GDT] = {
 	0, 0,                   /*** TSS ***/
 };
 
-struct tss_t tss = {0};
-
 struct gdtr_t {
 	uint16_t size;
 	uint64_t addr;
 }__attribute__((packed));
 
-static struct gdtr_t gdtr = {
-	(uint16_t)sizeof(gdt),
-	(uint64_t)gdt,
-};
-
 extern void _x86_64_asm_lgdt(struct gdtr_t* gdtr, uint64_t cs_idx, uint64_t ds_idx); /* gdt.s */
 
-void reload_gdt() {
+/**
+ * Load a fresh copy of the GDT into this CPU.
+ * NOTE: reloading %gs clears the GS base, set it again afterwards.
+ */
+void reload_gdt(struct cpu *cpu) {
+	struct gdtr_t gdtr;
+
+	memcpy(cpu->gdt, gdt, sizeof(gdt));
+	gdtr.size = (uint16_t)sizeof(cpu->gdt);
+	gdtr.addr = (uint64_t)cpu->gdt;
 	_x86_64_asm_lgdt(&gdtr, 8, 16);
 }
 
@@ -80,16 +83,17 @@ void load_tss(void) {
 *
 * Also see: http://wiki.osdev.org/Descriptor
 */
-void setup_tss() {
-	struct sys_segment_descriptor* sd = (struct sys_segment_descriptor*)&gdt[6]; /* 6th&7th entry in GDT */
+void setup_tss(struct cpu *cpu) {
+	struct sys_segment_descriptor* sd = (struct sys_segment_descriptor*)&cpu->gdt[6]; /* 6th&7th entry in GDT */
+	struct tss_t *tss = &cpu->tss;
 	sd->sd_lolimit = sizeof(struct tss_t)-1;
-	sd->sd_lobase = ((uint64_t)&tss);
+	sd->sd_lobase = ((uint64_t)tss);
 	sd->sd_type = 9; /* 80386-TSS, 32 bit */
 	sd->sd_dpl = 0;
 	sd->sd_p = 1;
 	sd->sd_hilimit = 0;
 	sd->sd_gran = 0;
-	sd->sd_hibase = ((uint64_t)&tss) >> 24;
+	sd->sd_hibase = ((uint64_t)tss) >> 24;
 
 	load_tss();
 }
@@ -376,7 +376,7 @@ void ISR_HANDLER(33) {
     uint8_t scan_code = inb(0x60);
     /* Acknowledge interrupt */
     PIC_sendEOI(33);
-    sc_add(scan_code);
+    sc_queue(scan_code);
 }
 
 DUMMY_INTERRUPT(34); /* Cascade (used internally by the two PICs. never raised) */
@@ -399,6 +399,12 @@ DUMMY_INTERRUPT(45); /* FPU / Coprocessor / Inter-processor */
 DUMMY_INTERRUPT(46); /* Primary ATA Hard Disk */
 DUMMY_INTERRUPT(47); /* Secondary ATA Hard Disk */
 
+/* Local APIC, handlers in lapic.c */
+REAL_INTERRUPT(48);  /* LAPIC timer */
+REAL_INTERRUPT(49);  /* Reschedule IPI */
+REAL_INTERRUPT(50);  /* TLB shootdown IPI */
+REAL_INTERRUPT(255); /* LAPIC spurious interrupt */
+
 extern void _x86_64_asm_lidt(void *idtr); /* idt.s */
 
 void load_idt(void) {
@@ -452,6 +458,19 @@ void load_idt(void) {
     SET_ISR(45);    /* FPU / Coprocessor / Inter-processor */
     SET_ISR(46);    /* Primary ATA Hard Disk */
     SET_ISR(47);    /* Secondary ATA Hard Disk */
+
+    /* Local APIC */
+    SET_ISR(48);    /* LAPIC timer */
+    SET_ISR(49);    /* Reschedule IPI */
+    SET_ISR(50);    /* TLB shootdown IPI */
+    SET_ISR(255);   /* LAPIC spurious interrupt */
+    reload_idt();
+}
+
+/**
+ * Load the IDT into this CPU, the table is shared by all CPUs.
+ */
+void reload_idt(void) {
     __asm__ __volatile__ ("lidt (%0)" : : "p"(&idtr));
     /* _x86_64_asm_lidt(&idtr); */
 }
@@ -5,6 +5,7 @@
 #include <sbunix/mm/vmm.h>
 #include <sbunix/sched.h>
 #include <sbunix/mm/pt.h>
+#include <sbunix/fpu.h>
 
 /**
 * This file is for Interrupt Service Routine Handlers for the Reserved
@@ -55,9 +56,8 @@ void ISR_HANDLER(6) {
 }
 
 void ISR_HANDLER(7) {
-    /* Attempt to use the FPU, we don't allow floats (-msoft-float -mno-sse) */
-    kill_curr_task(EXIT_FATALSIG + SIGILL);
-    kpanic("!! Device Not Available Exception (#NM) !!\n");
+    /* First use of the FPU since the task was switched in (CR0.TS) */
+    fpu_trap();
 }
 
 void ISR_HANDLER(8) {
@@ -144,6 +144,7 @@ void _isr_handler_14(uint64_t errorcode, uint64_t fault_rip) {
                 /* BUT! The vm area has Read/Write permission. Must be COW! */
                 if(copy_on_write_pagefault(vma, addr))
                     goto pf_enomem;
+                curr_task->acct.minflt++;
                 return;
             } else {
                 /* BAD! Tried to write to a present page write permission. */
@@ -154,6 +155,10 @@ void _isr_handler_14(uint64_t errorcode, uint64_t fault_rip) {
         /* Normal Page Fault */
         if(vma->onfault(vma, addr))
             goto pf_enomem;
+        if(vma->onfault == onfault_mmap_file)
+            curr_task->acct.majflt++;
+        else
+            curr_task->acct.minflt++;
         return;
     }
 
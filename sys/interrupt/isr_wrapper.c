@@ -36,6 +36,15 @@
         "popq %rbx;" \
         "popq %rax;"
 
+/* Switch to the kernel's GS base (struct cpu) if the interrupt came from
+ * ring 3, and back to the user's before returning to ring 3.
+ * cs_offset is the offset of the interrupted CS from %rsp. */
+#define SWAPGS_IF_USER(cs_offset) \
+        "testb $3, " #cs_offset "(%rsp);" \
+        "jz 1f;" \
+        "swapgs;" \
+        "1:;"
+
 #define DEBUG_IRETQ_NO_ERROR_CODE \
     "movq 120(%rsp), %rdi;"  /* 1st arg: faulting instruction pointer */ \
     "movq 128(%rsp), %rsi;"  /* 2nd arg: iretq CS */                     \
@@ -57,20 +66,42 @@
     __asm__ (                                                            \
         ".global _isr_wrapper_" # vector "\n"                            \
         "_isr_wrapper_" # vector ":\n"                                   \
+            SWAPGS_IF_USER(8)                                            \
             SAVEALL                                                     \
             /* DEBUG_IRETQ_NO_ERROR_CODE */                                 \
+            "call irq_enter;"                                            \
             "call _isr_handler_" # vector ";"                            \
+            "call irq_exit;"                                             \
             RESTOREALL                                                      \
+            SWAPGS_IF_USER(8)                                            \
             "iretq;" )
 
 #define ISR_WRAPPER_ERROR_CODE(vector)                                   \
     __asm__ (                                                            \
         ".global _isr_wrapper_" # vector "\n"                            \
         "_isr_wrapper_" # vector ":\n"                                   \
+            SWAPGS_IF_USER(16)                                           \
             SAVEALL                                                     \
             DEBUG_IRETQ_WITH_ERROR_CODE                                  \
+            "call irq_enter;"                                            \
             "call _isr_handler_" # vector ";"                            \
+            "call irq_exit;"                                             \
             RESTOREALL                                                      \
+            SWAPGS_IF_USER(16)                                           \
+            "iretq;" )
+
+/* For an IPI whose sender spins holding the kernel lock until it is
+ * handled: no irq_enter()/irq_exit(), so the lock is not taken and the
+ * interrupted task is never preempted here. */
+#define ISR_WRAPPER_NOLOCK(vector)                                       \
+    __asm__ (                                                            \
+        ".global _isr_wrapper_" # vector "\n"                            \
+        "_isr_wrapper_" # vector ":\n"                                   \
+            SWAPGS_IF_USER(8)                                            \
+            SAVEALL                                                      \
+            "call _isr_handler_" # vector ";"                            \
+            RESTOREALL                                                   \
+            SWAPGS_IF_USER(8)                                            \
             "iretq;" )
 
 
@@ -102,13 +133,17 @@ ISR_WRAPPER_ERROR_CODE(12);
 __asm__ (
 ".global _isr_wrapper_13\n"
         "_isr_wrapper_13:\n"
+        SWAPGS_IF_USER(16)
         SAVEALL
         DEBUG_IRETQ_WITH_ERROR_CODE
+        "call irq_enter;"
         "movq 120(%rsp), %rdi;" /* 1st arg: Error code into %rdi. */
         "movq 128(%rsp), %rsi;" /* 2nd arg: faulting instruction pointer %rsi. */
         "call _isr_handler_13;"
+        "call irq_exit;"
         RESTOREALL
         "addq $0x8, %rsp;"      /* MUST POP errorcode */
+        SWAPGS_IF_USER(8)
         "iretq;"
 );
 
@@ -122,13 +157,17 @@ __asm__ (
 __asm__ (
     ".global _isr_wrapper_14\n"
     "_isr_wrapper_14:\n"
+        SWAPGS_IF_USER(16)
         SAVEALL
         DEBUG_IRETQ_WITH_ERROR_CODE
+        "call irq_enter;"
         "movq 120(%rsp), %rdi;"  /* 1st arg: Error code into %rsi. */
         "movq 128(%rsp), %rsi;"  /* 2nd arg: faulting instruction pointer */
         "call _isr_handler_14;"
+        "call irq_exit;"
         RESTOREALL
         "addq $0x8, %rsp;"      /* MUST POP errorcode */
+        SWAPGS_IF_USER(8)
         "iretq;"
 );
 
@@ -167,3 +206,9 @@ ISR_WRAPPER(44);    /* PS2 Mouse */
 ISR_WRAPPER(45);    /* FPU / Coprocessor / Inter-processor */
 ISR_WRAPPER(46);    /* Primary ATA Hard Disk */
 ISR_WRAPPER(47);    /* Secondary ATA Hard Disk */
+
+/* Local APIC */
+ISR_WRAPPER(48);    /* LAPIC timer */
+ISR_WRAPPER(49);    /* Reschedule IPI */
+ISR_WRAPPER_NOLOCK(50); /* TLB shootdown IPI */
+ISR_WRAPPER(255);   /* LAPIC spurious interrupt */
@@ -0,0 +1,246 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/interrupt/lapic.h>
+#include <sbunix/interrupt/idt.h>
+#include <sbunix/interrupt/pit.h>
+#include <sbunix/interrupt/pic8259.h>
+#include <sbunix/mm/pt.h>
+#include <sbunix/sched.h>
+#include <sbunix/spinlock.h>
+#include <sbunix/smp.h>
+#include <sbunix/schedstat.h>
+
+/* Local APIC, one per CPU, all mapped at the same address */
+
+/* LAPIC timer counts (divided by 16) per PIT tick, from lapic_calibrate() */
+uint32_t lapic_ticks_per_jiffy = 0;
+
+/* What drives the tick, see TIMER_MODE */
+int timer_mode = TIMER_MODE_PIT;
+
+static int lapic_mapped = 0;
+static uint64_t tsc_per_jiffy = 0; /* TSC cycles per tick */
+
+static const char *timer_mode_names[] = {
+    [TIMER_MODE_PIT]      = "PIT",
+    [TIMER_MODE_PERIODIC] = "LAPIC periodic",
+    [TIMER_MODE_ONESHOT]  = "LAPIC one-shot",
+    [TIMER_MODE_DEADLINE] = "LAPIC TSC-deadline",
+};
+
+/**
+ * True if cpuid says this CPU has a local APIC.
+ */
+int lapic_present(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx >> 9) & 1;
+}
+
+/**
+ * Enable this CPU's local APIC. The first call maps the registers, the
+ * mapping is in the kernel's part of the page tables so all CPUs see it.
+ */
+void lapic_init(void) {
+    uint64_t base = rdmsr(MSR_APIC_BASE) & ~0xFFFUL;
+
+    if(!lapic_mapped) {
+        if(map_page(LAPIC_VIRT, base, PFLAG_RW|PFLAG_PCD|PFLAG_PWT))
+            kpanic("Failed to map the local APIC at 0x%lx\n", base);
+        lapic_mapped = 1;
+    }
+    lapic_write(LAPIC_TPR, 0);  /* accept all interrupts */
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+/**
+ * Count how fast the LAPIC timer runs against the PIT. Called on the BSP
+ * with interrupts enabled, takes 10 ticks.
+ */
+void lapic_calibrate(void) {
+    uint64_t start;
+
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    start = jiffies;
+    while(jiffies == start)
+        cpu_relax();
+    start = jiffies;
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    while(jiffies < start + 10)
+        cpu_relax();
+    lapic_ticks_per_jiffy = (0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR)) / 10;
+    lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+/**
+ * Fire this CPU's timer once at the TSC deadline, in the one-shot modes.
+ * @now: the TSC now
+ */
+static void lapic_timer_arm(uint64_t deadline, uint64_t now) {
+    uint64_t count = 1;
+
+    if(timer_mode == TIMER_MODE_DEADLINE) {
+        wrmsr(MSR_TSC_DEADLINE, deadline);
+        return;
+    }
+    /* In LAPIC counts, rounded up */
+    if(deadline > now)
+        count = (deadline - now) * lapic_ticks_per_jiffy / tsc_per_jiffy + 1;
+    lapic_write(LAPIC_TIMER_INIT, (uint32_t)MIN(count, 0xFFFFFFFFUL));
+}
+
+/**
+ * Set up the BSP's local APIC and move its tick from the PIT to the LAPIC
+ * timer, as TIMER_MODE asks. Called from start() with interrupts enabled,
+ * after tsc_calibrate().
+ */
+void lapic_timer_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint64_t flags;
+
+    if(!lapic_present()) {
+        printk("Timer: PIT, no local APIC\n");
+        return;
+    }
+    lapic_init();
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_EXTINT);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    cpus[0].apic_id = lapic_id();
+    lapic_calibrate();
+    tsc_per_jiffy = tsc_khz * 1000 / TIMER_HZ;
+
+    timer_mode = TIMER_MODE;
+    if(timer_mode == TIMER_MODE_DEADLINE) {
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        if(!(ecx & (1 << 24)))
+            timer_mode = TIMER_MODE_ONESHOT;
+    }
+    printk("Timer: %s\n", timer_mode_names[timer_mode]);
+    if(timer_mode == TIMER_MODE_PIT)
+        return;
+
+    /* Hand over between two ticks, so none is counted twice */
+    flags = local_irq_save();
+    pit_stop();
+    lapic_timer_start();
+    local_irq_restore(flags);
+}
+
+/**
+ * Start this CPU's LAPIC timer ticking at TIMER_HZ.
+ */
+void lapic_timer_start(void) {
+    struct cpu *cpu = this_cpu();
+
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV16);
+    if(timer_mode == TIMER_MODE_PIT || timer_mode == TIMER_MODE_PERIODIC) {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+        lapic_write(LAPIC_TIMER_INIT, lapic_ticks_per_jiffy);
+        return;
+    }
+    if(timer_mode == TIMER_MODE_DEADLINE) {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | LAPIC_TIMER_VECTOR);
+        /* The mode must be set before the deadline MSR is written */
+        __asm__ __volatile__ ("mfence" ::: "memory");
+    } else {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+    }
+    cpu->tick_next = read_tsc() + tsc_per_jiffy;
+    lapic_timer_arm(cpu->tick_next, read_tsc());
+}
+
+/**
+ * From this CPU's timer interrupt: in the one-shot modes, arm the timer
+ * for the next tick. Ticks stay in step with the TSC, however late the
+ * interrupt was handled.
+ * @return: ticks since the last call, 0 if the timer fired early
+ */
+uint64_t lapic_timer_rearm(struct cpu *cpu) {
+    /* A one-shot counts on the LAPIC clock, it may end a bit early */
+    uint64_t slack = tsc_per_jiffy / 16;
+    uint64_t now, ticks = 0;
+
+    if(timer_mode != TIMER_MODE_ONESHOT && timer_mode != TIMER_MODE_DEADLINE)
+        return 1;
+    now = read_tsc();
+    if(now + slack >= cpu->tick_next) {
+        ticks = (now + slack - cpu->tick_next) / tsc_per_jiffy + 1;
+        cpu->tick_next += ticks * tsc_per_jiffy;
+    }
+    lapic_timer_arm(cpu->tick_next, now);
+    return ticks;
+}
+
+/**
+ * Stop this CPU's tick while idle, in the one-shot modes. The timer fires
+ * ticks ticks from the last one instead, lapic_timer_rearm() then counts
+ * the ticks that passed.
+ */
+void lapic_timer_stop(struct cpu *cpu, uint64_t ticks) {
+    lapic_timer_arm(cpu->tick_next + (ticks - 1) * tsc_per_jiffy, read_tsc());
+}
+
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/**
+ * Send an inter-processor interrupt and wait for it to be accepted.
+ * @apic_id: destination, ignored for the shorthand destinations
+ * @icr: vector, delivery mode and destination shorthand
+ */
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr) {
+    /* An interrupt handler sending its own IPI would clobber ICR_HI */
+    uint64_t flags = local_irq_save();
+
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, icr);
+    while(lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING)
+        cpu_relax();
+    local_irq_restore(flags);
+}
+
+/**
+ * LAPIC timer interrupt, the tick of the secondary CPUs, and of the BSP
+ * unless it ticks from the PIT
+ */
+void ISR_HANDLER(48) {
+    struct cpu *cpu = this_cpu();
+    uint64_t ticks;
+
+    ticks = lapic_timer_rearm(cpu);
+    lapic_eoi();
+    if(!ticks)
+        return;
+    schedstat_tick(cpu);
+    if(cpu->id == 0)
+        timer_tick(ticks);
+    sched_tick();
+}
+
+/**
+ * Reschedule IPI, only wakes an idle CPU out of hlt
+ */
+void ISR_HANDLER(49) {
+    lapic_eoi();
+}
+
+/**
+ * TLB shootdown IPI from smp_flush_tlb_mm(). The sender holds the kernel
+ * lock, so the wrapper does not take it (ISR_WRAPPER_NOLOCK).
+ */
+void ISR_HANDLER(50) {
+    smp_tlb_flush_check();
+    lapic_eoi();
+}
+
+/**
+ * Spurious interrupt, no EOI
+ */
+void ISR_HANDLER(255) {
+}
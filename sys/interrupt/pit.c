@@ -2,71 +2,199 @@
 #include <sbunix/interrupt/pit.h>
 #include <sbunix/interrupt/idt.h>
 #include <sbunix/interrupt/pic8259.h>
+#include <sbunix/interrupt/lapic.h>
 #include <sbunix/console.h>
 #include <sbunix/sched.h>
+#include <sbunix/smp.h>
+#include <sbunix/spinlock.h>
+#include <sbunix/schedstat.h>
+#include <sbunix/interrupt/softirq.h>
+#include <sbunix/mm/page_alloc.h>
+#include <sys/vtime.h>
 
 /* Programmable Interrupt Timer */
 struct timespec unix_time;         /* real (UNIX) time */
 volatile uint64_t system_time = 0; /* seconds since boot */
-static uint32_t timer_ticks   = 0; /* current count of timer IRQs */
+volatile uint64_t jiffies     = 0; /* timer ticks since boot */
+volatile uint64_t idle_wakeups = 0; /* times the idle task left hlt */
+uint64_t tsc_khz              = 0; /* TSC cycles per millisecond */
+uint64_t tsc_mult             = 0; /* see tsc_to_ns() */
+static uint64_t clock_tsc_base = 0; /* TSC when init_unix_time() read the RTC */
+static uint64_t clock_unix_base = 0; /* ns since the epoch at clock_tsc_base */
+uint64_t vtime_phys           = 0; /* the time page, see vtime_init() */
+static struct vtime *vtime    = NULL;
+static uint32_t timer_ticks   = 0; /* ticks into the current second */
 static uint32_t timer_hz      = 0; /* timer frequency */
+static uint16_t tick_count    = 0; /* PIT counts per tick, 0 is 65536 */
+
+/* Set while the periodic tick is stopped for idle */
+static uint32_t oneshot_ticks = 0; /* ticks the one-shot covers */
+
+static uint64_t shown_time    = 0; /* system_time on the console */
 
 /**
- * Subtract nsec from the given timespec
- *
- * @ts: pointer to valid timespec to update
- * @nsec: number of nanoseconds to subtract, must be POSITIVE
- * @return:  true if the resultant ts is 0
+ * Program PIT channel 0.
+ * @cmd: PIT_CMD_PERIODIC or PIT_CMD_ONESHOT
+ * @count: reload or initial count
  */
-int time_sub(struct timespec *ts, long nsecs) {
-    if(nsecs < 0)
-        kpanic("nanoseconds to subtract is negative: %ld\n", nsecs);
+static inline void pit_program(uint8_t cmd, uint16_t count) {
+    outb(PIT_PORT_CMD, cmd);
+    outb(PIT_PORT_CH0, (uint8_t)count);        /* low byte of reload */
+    outb(PIT_PORT_CH0, (uint8_t)(count >> 8)); /* high byte of reload */
+}
 
-    if(ts->tv_nsec >= nsecs) {
-        ts->tv_nsec -= nsecs;
-    } else {
-        if(ts->tv_sec == 0) {
-            ts->tv_nsec = 0;
-            return 1;
-        } else {
-            ts->tv_sec--;
-            ts->tv_nsec = 1000000000 - (nsecs - ts->tv_nsec);
+/**
+ * Return the current count of PIT channel 0.
+ */
+static inline uint16_t pit_read_count(void) {
+    uint16_t count;
+    outb(PIT_PORT_CMD, PIT_CMD_LATCH);
+    count = inb(PIT_PORT_CH0);
+    count |= (uint16_t)inb(PIT_PORT_CH0) << 8;
+    return count;
+}
+
+/**
+ * True if channel 0's output is high, i.e. the one-shot has expired.
+ */
+static inline int pit_out_high(void) {
+    outb(PIT_PORT_CMD, PIT_CMD_READBACK_STATUS);
+    return inb(PIT_PORT_CH0) & PIT_STATUS_OUT;
+}
+
+/**
+ * Account for ticks that have passed, keeping the seconds since boot and
+ * the UNIX time in step.
+ */
+static void timer_advance(uint64_t ticks) {
+    jiffies += ticks;
+    timer_ticks += ticks;
+    if(timer_ticks >= timer_hz) {
+        while(timer_ticks >= timer_hz) {
+            timer_ticks -= timer_hz;
+            system_time++;
+            unix_time.tv_sec++;
         }
     }
-    return 0;
 }
 
 /**
- * Timer interrupt handler
+ * Bottom half of the tick, runs with interrupts enabled except while
+ * waking sleepers, which touches the run queues like sched_tick().
  */
-void ISR_HANDLER(32) {
-    int done;
-    struct task_struct *task;
+static void timer_softirq(void) {
+    uint64_t flags;
 
-    timer_ticks++;
+    /* Only looks at sleepers whose deadline has passed */
+    flags = local_irq_save();
+    sleep_wakeup_expired(jiffies);
+    local_irq_restore(flags);
 
-    if(timer_ticks == timer_hz) {
-        timer_ticks = 1;
-        system_time++;
-        unix_time.tv_sec++;
+    if(shown_time != system_time) {
+        shown_time = system_time;
         /* Print Seconds since boot in upper right corner of the console */
-        write_time(system_time);
+        write_time(shown_time);
         write_used_mem();
     }
+}
+
+/**
+ * The BSP's tick, from the PIT or its LAPIC timer. The rest is done in
+ * timer_softirq().
+ * @ticks: ticks since the last one, more once the idle tick was stopped
+ */
+void timer_tick(uint64_t ticks) {
+    oneshot_ticks = 0;
+    timer_advance(ticks);
+    raise_softirq(TIMER_SOFTIRQ);
+}
+
+/**
+ * PIT interrupt handler, in TIMER_MODE_PIT
+ */
+void ISR_HANDLER(32) {
+    uint64_t ticks = 1;
+
+    schedstat_tick(this_cpu());
+
+    if(oneshot_ticks) {
+        /* The idle one-shot expired, resume the periodic tick */
+        ticks = oneshot_ticks;
+        pit_program(PIT_CMD_PERIODIC, tick_count);
+    }
     /* Acknowledge interrupt */
     PIC_sendEOI(32);
+    timer_tick(ticks);
+    /* Timeslicing */
+    sched_tick();
+}
+
+/**
+ * Called by the idle task, with interrupts disabled, right before it halts.
+ * Stops the periodic tick and programs a single interrupt for the earliest
+ * sleeper's deadline, at most PIT_MAX_COUNT or NOHZ_MAX_TICKS away.
+ * The tick keeps going while another CPU runs a task, it reads jiffies.
+ * A periodic LAPIC timer is never stopped.
+ */
+void tick_nohz_idle_enter(void) {
+    uint64_t next = sleep_next_deadline();
+    uint32_t ticks;
+
+    if(!NOHZ_IDLE || oneshot_ticks || next <= jiffies + 1 || !smp_others_idle())
+        return;
 
-    /* PIT is set to 1000 HZ (1 millisecond) (1000000 nanoseconds) */
-    for(task = sleep_queue.tasks; task != NULL; task = task->next_rq) {
-        done = time_sub(&task->sleepts, 1000000L);
-        /* task is done sleeping, wake it up... */
-        if(done)
-            task_wakeup(&sleep_queue, task);
+    if(timer_mode == TIMER_MODE_ONESHOT || timer_mode == TIMER_MODE_DEADLINE) {
+        oneshot_ticks = (uint32_t)MIN(next - jiffies, NOHZ_MAX_TICKS);
+        lapic_timer_stop(this_cpu(), oneshot_ticks);
+        return;
     }
-    /* Timeslicing */
-    if(curr_task->type & TASK_USER && --curr_task->timeslice <= 0) {
-        schedule();
+    if(!tick_count)
+        return;
+
+    ticks = (uint32_t)MIN(next - jiffies, PIT_MAX_COUNT / tick_count);
+    if(ticks <= 1)
+        return;
+    oneshot_ticks = ticks;
+    pit_program(PIT_CMD_ONESHOT, (uint16_t)(ticks * tick_count));
+}
+
+/**
+ * Called by the idle task, with interrupts disabled, after it wakes up.
+ * If another interrupt woke us before the one-shot expired, account for
+ * the whole ticks that passed and finish the current tick with a shorter
+ * one-shot, whose interrupt resumes the periodic tick.
+ */
+void tick_nohz_idle_exit(void) {
+    uint32_t left;
+
+    idle_wakeups++;
+    if(!oneshot_ticks)
+        return;
+
+    if(timer_mode == TIMER_MODE_ONESHOT || timer_mode == TIMER_MODE_DEADLINE) {
+        /* The ticks that passed, no partial tick is lost. If the timer
+         * fired meanwhile its interrupt finds no tick to count. */
+        oneshot_ticks = 0;
+        timer_advance(lapic_timer_rearm(this_cpu()));
+        sleep_wakeup_expired(jiffies);
+        return;
+    }
+    /* Expired but not yet handled, the pending IRQ will account for it */
+    if(pit_out_high())
+        return;
+
+    /* The one-shot ends on a tick, so do the counts left of it */
+    left = pit_read_count();
+    timer_advance(oneshot_ticks - (left + tick_count - 1) / tick_count);
+    left %= tick_count;
+    if(left) {
+        oneshot_ticks = 1;
+        pit_program(PIT_CMD_ONESHOT, (uint16_t)left);
+    } else {
+        oneshot_ticks = 0;
+        pit_program(PIT_CMD_PERIODIC, tick_count);
     }
+    sleep_wakeup_expired(jiffies);
 }
 
 /**
@@ -90,18 +218,120 @@ void pit_set_freq(unsigned int hz) {
         reload_val = 0; /* 0 reload value for PIT is ~18 HZ */
         timer_hz = 18;
     } else {
-        reload_val = (uint16_t)(1193182/hz);
+        reload_val = (uint16_t)(PIT_FREQ/hz);
         timer_hz = hz;
     }
     timer_hz = reload_val? hz : 18;
     timer_ticks = 0;
+    tick_count = reload_val;
+    open_softirq(TIMER_SOFTIRQ, timer_softirq);
     cli();
-    outb(0x43, 0x36);
-    outb(0x40, (uint8_t)reload_val);        /* low byte of reload */
-    outb(0x40, (uint8_t)(reload_val >> 8)); /* high byte of reload */
+    pit_program(PIT_CMD_PERIODIC, reload_val);
     sti();
 }
 
+/**
+ * Copy the clock to the time page. A reader on another CPU may be in the
+ * middle of reading it, the odd seq tells it to retry.
+ */
+static void vtime_update(void) {
+    if(!vtime)
+        return;
+    vtime->seq++;
+    __asm__ __volatile__ ("" ::: "memory"); /* x86 stores are not reordered */
+    vtime->tsc_shift = TSC_SHIFT;
+    vtime->tsc_mult = tsc_mult;
+    vtime->tsc_base = clock_tsc_base;
+    vtime->realtime_base = clock_unix_base;
+    __asm__ __volatile__ ("" ::: "memory");
+    vtime->seq++;
+}
+
+/**
+ * Stop the PIT for good, the LAPIC timer ticks instead. It is left in
+ * one-shot mode, so it interrupts at most once more into a masked IRQ.
+ * Called with interrupts disabled.
+ */
+void pit_stop(void) {
+    IRQ_set_mask(0);
+    pit_program(PIT_CMD_ONESHOT, 0);
+    tick_count = 0;
+}
+
+/**
+ * Count how fast the TSC runs against the PIT. Called on the BSP with
+ * interrupts enabled, takes TSC_CALIBRATE_TICKS ticks. Both ends are
+ * taken right at a tick, so the error is about the interrupt latency.
+ */
+void tsc_calibrate(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint64_t start, tsc;
+
+    start = jiffies;
+    while(jiffies == start)
+        cpu_relax();
+    start = jiffies;
+    tsc = read_tsc();
+    while(jiffies < start + TSC_CALIBRATE_TICKS)
+        cpu_relax();
+    tsc = read_tsc() - tsc;
+    tsc_khz = tsc * TIMER_HZ / TSC_CALIBRATE_TICKS / 1000;
+    /* cycles per tick * (2^TSC_SHIFT / TICK_NSEC) */
+    tsc_mult = ((uint64_t)TICK_NSEC * TSC_CALIBRATE_TICKS << TSC_SHIFT) / tsc;
+    /* Without an invariant TSC the clock drifts with the CPU frequency */
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if(eax >= 0x80000007)
+        cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    else
+        edx = 0;
+    printk("TSC: %lu kHz%s\n", tsc_khz, (edx & (1 << 8))? "" : ", not invariant");
+    vtime_update();
+}
+
+/**
+ * Allocate the time page, which add_stack() maps read-only into every
+ * user process so clock_gettime() can read the TSC clock without a system
+ * call. Called once physical memory is set up. The page is never freed,
+ * the mapcount we keep outlives every user mapping.
+ */
+void vtime_init(void) {
+    uint64_t page = get_free_page(0);
+
+    if(!page)
+        kpanic("No memory for the time page\n");
+    vtime = (struct vtime *)page;
+    vtime_phys = kvirt_to_phys(page);
+    vtime_update();
+}
+
+/**
+ * Nanoseconds since the RTC was read at boot, from the TSC. The TSCs of
+ * the CPUs are assumed to be in step, as they are on any CPU with an
+ * invariant TSC. Counts in ticks until tsc_calibrate() is done.
+ */
+uint64_t clock_monotonic_ns(void) {
+    if(!tsc_mult)
+        return jiffies * TICK_NSEC;
+    return tsc_to_ns(read_tsc() - clock_tsc_base);
+}
+
+/**
+ * Nanoseconds since the epoch, the RTC time at boot plus the monotonic
+ * clock. Nothing sets the time, so the two never step apart.
+ */
+uint64_t clock_realtime_ns(void) {
+    return clock_unix_base + clock_monotonic_ns();
+}
+
+/**
+ * Convert TSC cycles to microseconds.
+ */
+uint64_t tsc_to_usec(uint64_t cycles) {
+    if(!tsc_khz)
+        return 0;
+    return cycles / tsc_khz * 1000 + cycles % tsc_khz * 1000 / tsc_khz;
+}
+
 /**
  * Read value from the RTC register
  * @reg: RTC register number to read
@@ -158,4 +388,8 @@ unsigned long read_rtc_time(void) {
 void init_unix_time(void) {
     unix_time.tv_sec  = read_rtc_time();
     unix_time.tv_nsec = 0;
+    /* read_rtc_time() returns right after the RTC second ticked over */
+    clock_tsc_base = read_tsc();
+    clock_unix_base = unix_time.tv_sec * NSEC_PER_SEC;
+    vtime_update();
 }
@@ -0,0 +1,56 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/interrupt/softirq.h>
+#include <sbunix/sched.h>
+#include <sbunix/preempt.h>
+#include <sbunix/smp.h>
+#include <sbunix/schedstat.h>
+
+/* Rounds of newly raised softirqs to run before leaving them for the next
+ * interrupt, so an interrupt storm can not keep a CPU in softirqs */
+#define SOFTIRQ_RESTART 10
+
+static softirq_action_t softirq_vec[NR_SOFTIRQS];
+
+/**
+ * Set the handler of a softirq, at boot.
+ */
+void open_softirq(int nr, softirq_action_t action) {
+    if(nr < 0 || nr >= NR_SOFTIRQS)
+        kpanic("No softirq %d\n", nr);
+    softirq_vec[nr] = action;
+}
+
+/**
+ * Mark a softirq pending on this CPU, called by interrupt handlers with
+ * interrupts disabled. It runs when the interrupt returns.
+ */
+void raise_softirq(int nr) {
+    this_cpu()->softirq_pending |= 1U << nr;
+}
+
+/**
+ * Run this CPU's pending softirqs, called by irq_exit() with interrupts
+ * disabled and returns with them disabled. The softirq count in the
+ * preempt count keeps a nested interrupt from running them again, and
+ * from switching tasks.
+ */
+void do_softirq(void) {
+    struct cpu *cpu = this_cpu();
+    struct task_struct *curr = curr_task;
+    int restart = SOFTIRQ_RESTART, nr;
+    uint32_t pending;
+
+    curr->preempt_count += SOFTIRQ_OFFSET;
+    while((pending = cpu->softirq_pending) && restart--) {
+        cpu->softirq_pending = 0;
+        schedstat_tick_irqs_on(cpu);
+        if(SOFTIRQ_IRQS_ON)
+            sti();
+        for(nr = 0; pending; nr++, pending >>= 1) {
+            if((pending & 1) && softirq_vec[nr])
+                softirq_vec[nr]();
+        }
+        cli();
+    }
+    curr->preempt_count -= SOFTIRQ_OFFSET;
+}
@@ -2,6 +2,9 @@
 #include "sched/roundrobin.h"
 #include <sbunix/sbunix.h>
 #include <sbunix/console.h>
+#include <sbunix/interrupt/pit.h>
+#include <sbunix/smp.h>
+#include <sbunix/workqueue.h>
 
 #include "test/test.h"
 
@@ -19,13 +22,20 @@ void kmain(void) {
     printk("*** Welcome to SBUnix ***\n");
     /* IRQs off in kernel */
     cli();
+    lock_kernel();
+    smp_start();
 
     init_task = ktask_create(run_init, "[init]");
+    workqueue_init();
 
     /* idle task */
     while(1){
         schedule();
-        __asm__ __volatile__("sti;hlt;");
+        tick_nohz_idle_enter();
+        unlock_kernel();
+        __asm__ __volatile__("sti;hlt;cli;");
+        lock_kernel();
+        tick_nohz_idle_exit();
     }
 
     kpanic("\nReturned to kmain!!!\n");
@@ -40,7 +50,7 @@ void run_init(void) {
         kpanic("init: failed to create terminal: %s\n", strerror(-err));
 
     /* Start the init process, this should not return */
-    err = (int)do_execve("/bin/init", NULL, NULL, 0);
+    err = (int)do_execve("/bin/init", NULL, NULL);
     if(err)
         kpanic("init: '/bin/init' failed: %s\n", strerror(-err));
 
@@ -1,6 +1,7 @@
 #include <sbunix/sbunix.h>
 #include <sbunix/mm/align.h>
 #include <sbunix/mm/pt.h>
+#include <sbunix/preempt.h>
 #include <sbunix/string.h>
 #include <errno.h>
 
@@ -335,6 +336,48 @@ void init_kernel_pt(uint64_t phys_free_page) {
     debug("NEW PAGE TABLE! at 0x%lx and 0x%lx\n", pml4, pdpt);
 }
 
+/* Tables of the temporary identity mapping, see pt_map_low_identity() */
+static uint64_t low_pdpt, low_pd;
+
+/**
+ * Identity map the first 2MB of physical memory in the kernel page table,
+ * for the AP trampoline which turns on paging while running at a low
+ * address. Not global, so a cr3 reload drops any cached translations.
+ * @return: 0 or -ENOMEM
+ */
+int pt_map_low_identity(void) {
+    uint64_t *pml4 = (uint64_t *)kphys_to_virt((uint64_t)PE_PHYS_ADDR(kernel_pt));
+
+    if(pml4[0])
+        kpanic("Low memory is already mapped: 0x%lx\n", pml4[0]);
+    low_pdpt = get_free_page(0);
+    low_pd = get_free_page(0);
+    if(!low_pdpt || !low_pd) {
+        pt_unmap_low_identity();
+        return -ENOMEM;
+    }
+    ((uint64_t *)low_pd)[0] = (uint64_t)0|PFLAG_PS|PFLAG_RW|PFLAG_P;
+    ((uint64_t *)low_pdpt)[0] = kvirt_to_phys(low_pd)|PFLAG_RW|PFLAG_P;
+    pml4[0] = kvirt_to_phys(low_pdpt)|PFLAG_RW|PFLAG_P;
+    write_cr3(read_cr3());
+    return 0;
+}
+
+/**
+ * Remove the mapping made by pt_map_low_identity().
+ */
+void pt_unmap_low_identity(void) {
+    uint64_t *pml4 = (uint64_t *)kphys_to_virt((uint64_t)PE_PHYS_ADDR(kernel_pt));
+
+    pml4[0] = 0;
+    write_cr3(read_cr3());
+    if(low_pd)
+        free_page(low_pd);
+    if(low_pdpt)
+        free_page(low_pdpt);
+    low_pd = low_pdpt = 0;
+}
+
 /**
  * Recursively free the page table pointed to by pte
  *
@@ -391,6 +434,9 @@ static uint64_t rec_copy_pt(int level, uint64_t pte) {
     int i;
     if(level > 4 || level < 1)
         kpanic("Invalid call: level cannot be %d\n", level);
+    /* Forking a large address space takes a while, copy a table at a time */
+    if(level == 1)
+        cond_resched();
 
     new_pt = (uint64_t *)get_free_page(0);
     if(!new_pt) {
@@ -1,6 +1,8 @@
 #include <sbunix/mm/vmm.h>
 #include <sbunix/string.h>
 #include <sbunix/sched.h>
+#include <sbunix/preempt.h>
+#include <sbunix/interrupt/pit.h>
 #include <errno.h>
 
 /*
@@ -51,91 +53,283 @@ int add_heap(struct mm_struct *user) {
 
 
 /**
- * Check that argv and envp are valid, and validate
- * E2BIG: they're too big to fit in 2 pages
+ * Return the length of the argument string str, not including the NUL.
+ * Strings from a user task must be terminated inside one of its vm areas,
+ * kernel tasks exec with kernel pointers which are trusted.
+ *
+ * @max: bytes of the argument block still unused
+ * @return: the length, -EFAULT if invalid, -E2BIG if it does not fit in max
  */
+static long arg_strlen(const char *str, size_t max) {
+    size_t len, limit = max;
+    struct vm_area *vma;
 
-int num_pointers(const char **array) {
-    int len = 0;
-    if(!array)
-        return 0;
-    while(*array++)
-        len++;
-    return len;
+    if(curr_task->type == TASK_USER) {
+        vma = vma_find_region(curr_task->mm->vmas, (uint64_t)str, 1);
+        if(!vma)
+            return -EFAULT;
+        limit = MIN(max, vma->vm_end - (uint64_t)str);
+    }
+    len = strnlen(str, limit);
+    if(len >= max)
+        return -E2BIG;
+    if(len == limit)
+        return -EFAULT; /* runs off the end of the vm area */
+    return (long)len;
 }
 
-int num_bytes(const char **array) {
-    int bytes = 0, err = 0, i;
+/**
+ * Count the strings in the NULL terminated array and the bytes needed to
+ * hold them, validating every pointer along the way.
+ *
+ * @count: set to the number of strings
+ * @bytes: incremented by the size of the strings (including NUL's)
+ * @return: 0 on success, -EFAULT or -E2BIG
+ */
+static int count_strings(const char **array, int *count, size_t *bytes) {
+    long len;
+    int i;
+
+    *count = 0;
     if(!array)
         return 0;
-    for(i = 0; array[i]; i++) {
-        size_t len = strnlen(array[i], PAGE_SIZE);// + 1;
-        /* Skipping first arg because it may have been an interpreter */
-        if(i != 0) {
-            err = valid_userptr_read(curr_task->mm, array[i], len);
-            if(err)
-                return err;
-        }
-
-        bytes += len;
+    for(i = 0; ; i++) {
+        if(curr_task->type == TASK_USER &&
+           valid_userptr_read(curr_task->mm, &array[i], sizeof(*array)))
+            return -EFAULT;
+        if(!array[i])
+            break;
+        len = arg_strlen(array[i], ARG_MAX - *bytes);
+        if(len < 0)
+            return (int)len;
+        *bytes += len + 1;
+        if(*bytes + (i + 1) * sizeof(char *) > ARG_MAX)
+            return -E2BIG;
     }
-    return bytes;
+    *count = i;
+    return 0;
 }
 
-#define MAX_ARG_ENV_BYTES PAGE_SIZE
-/* gotta leave room for the actual stack */
-#define MAX_ARG_ENV_PTRS ((PAGE_SIZE/sizeof(void *)) - 10)
+/**
+ * Return the kernel virtual address backing the user address uaddr
+ * in the staged stack pages.
+ */
+static char *arg_addr(struct exec_args *args, uint64_t uaddr) {
+    uint64_t i = (USER_STACK_TOP_PAGE - PAGE_ALIGN(uaddr)) >> PAGE_SHIFT;
+    uint64_t page = args->pages[i / ARG_PAGES_PER_DIR][i % ARG_PAGES_PER_DIR];
+    return (char *)page + (uaddr & (PAGE_SIZE - 1));
+}
 
-int argv_envp_err(const char **argv, const char **envp, int *argc, int *envc) {
-    int arg_bytes, env_bytes;
+/**
+ * Copy len bytes from src to the user address uaddr of the staged pages.
+ * @return: 0, or -EFAULT if that is outside the pages
+ */
+static int arg_put(struct exec_args *args, uint64_t uaddr,
+                   const void *src, size_t len) {
+    if(uaddr < args->user_rsp || len > USER_STACK_START - uaddr)
+        return -EFAULT;
+    while(len) {
+        size_t chunk = MIN(len, PAGE_SIZE - (uaddr & (PAGE_SIZE - 1)));
+        memcpy(arg_addr(args, uaddr), src, chunk);
+        uaddr += chunk;
+        src = (const char *)src + chunk;
+        len -= chunk;
+    }
+    return 0;
+}
 
-    /* first iteration argv, second envp */
-    *argc = num_pointers(argv);
-    *envc = num_pointers(envp);
-    arg_bytes = num_bytes(argv);
-    if(arg_bytes < 0)
-        return arg_bytes;
+/**
+ * Copy len bytes of the string str and a NUL into the staged pages at
+ * *strp and store its user pointer at *ptrp, advancing both.
+ * @return: 0 or -EFAULT
+ */
+static int arg_put_string(struct exec_args *args, const char *str, size_t len,
+                          uint64_t *strp, uint64_t *ptrp) {
+    int err;
 
-    env_bytes = num_bytes(envp);
-    if(env_bytes < 0)
-        return env_bytes;
+    err = arg_put(args, *strp, str, len);
+    if(!err)
+        err = arg_put(args, *strp + len, "", 1);
+    if(!err)
+        err = arg_put(args, *ptrp, strp, sizeof(uint64_t));
+    if(err)
+        return err;
+    *strp += len + 1;
+    *ptrp += sizeof(uint64_t);
+    return 0;
+}
 
-    if((arg_bytes + env_bytes) > MAX_ARG_ENV_BYTES ||
-            (*argc + *envc + 2) > MAX_ARG_ENV_PTRS)
-        return -E2BIG;
+/**
+ * Copy the first count strings of array, as counted by count_strings().
+ * Another thread of the caller may have changed them since, so each
+ * length is taken again and must fit in the bytes left before
+ * USER_STACK_START. The NUL is written separately, a string may even
+ * change during the copy.
+ * @return: 0, -EFAULT or -E2BIG
+ */
+static int arg_put_strings(struct exec_args *args, const char **array,
+                           int count, uint64_t *strp, uint64_t *ptrp) {
+    long len;
+    int err, i;
+
+    for(i = 0; i < count; i++) {
+        len = arg_strlen(array[i], USER_STACK_START - *strp);
+        if(len < 0)
+            return (int)len;
+        err = arg_put_string(args, array[i], (size_t)len, strp, ptrp);
+        if(err)
+            return err;
+    }
     return 0;
 }
 
+/**
+ * Allocate an empty argument block.
+ */
+struct exec_args *exec_args_create(void) {
+    struct exec_args *args;
+    args = kmalloc(sizeof(*args));
+    if(!args)
+        return NULL;
+    memset(args, 0, sizeof(*args));
+    return args;
+}
 
 /**
- * Copy num strings from strs into virt_strs, put user pointers in virt_ptrs
- *
- * copy backwards from last string
- */
-void copy_strings(const char **strs, int num, uint64_t *ptrs, char **deststrsp, int off) {
-    uint64_t user_ptr = PAGE_ALIGN(USER_STACK_START);
-    char *dest = *deststrsp;
-    user_ptr += (uint64_t)dest - PAGE_ALIGN((uint64_t)dest);
-
-    ptrs[--off] = 0; /* start from end */
-    while(num--) {
-        const char *src = strs[num];
-        ptrs[--off] = user_ptr; /* user pointer to dest string */
-        while (user_ptr++ && (*dest++ = *src++) != '\0')/* nothing */;
+ * Free the argument block and any of its pages not mapped by add_stack.
+ */
+void exec_args_destroy(struct exec_args *args) {
+    int i;
+    if(!args)
+        return;
+    for(i = 0; i < args->npages; i++) {
+        uint64_t page = args->pages[i / ARG_PAGES_PER_DIR][i % ARG_PAGES_PER_DIR];
+        if(page)
+            free_page(page);
+    }
+    for(i = 0; i < ARG_MAX_DIRS; i++) {
+        if(args->pages[i])
+            free_page((uint64_t)args->pages[i]);
     }
-    *deststrsp = dest;
+    kfree(args);
 }
 
 /**
- * Add the stack vm area.
+ * Stage argv and envp (and args->interp, if set, as the first argument)
+ * for the new user stack. This MUST be called while argv and envp are
+ * still mapped, i.e. before the current mm is torn down.
  *
- * TODO: I don't know why I stayed up doing this. I can't think
+ * Layout, from high to low addresses:
+ *      USER_STACK_START: end of the envp strings
+ *                        envp strings, argv strings
+ *                        padding to 16 bytes
+ *                        NULL, envp pointers, NULL, argv pointers
+ *      user_rsp:         argc
+ *
+ * @return: 0 on success, -EFAULT, -E2BIG or -ENOMEM
+ */
+int exec_args_copy(struct exec_args *args, const char **argv,
+                   const char **envp) {
+    size_t bytes = 0;
+    uint64_t strp, ptrp, argc, nptrs;
+    int nargv, err;
+
+    if(args->interp[0])
+        bytes += strlen(args->interp) + 1;
+    err = count_strings(argv, &nargv, &bytes);
+    if(err)
+        return err;
+    err = count_strings(envp, &args->envc, &bytes);
+    if(err)
+        return err;
+    args->argc = nargv + (args->interp[0] ? 1 : 0);
+
+    /* argc, the argv and envp pointers, and their NULL terminators */
+    nptrs = (uint64_t)args->argc + args->envc + 3;
+    strp = USER_STACK_START - bytes;
+    args->user_rsp = ALIGN_DOWN(strp - nptrs * sizeof(uint64_t), 16);
+    if(USER_STACK_TOP_PAGE - PAGE_ALIGN(args->user_rsp) >= ARG_MAX)
+        return -E2BIG;
+
+    /* Allocate every page from the top of the stack down to user_rsp */
+    args->npages = 0;
+    while(USER_STACK_TOP_PAGE - args->npages * PAGE_SIZE >=
+          PAGE_ALIGN(args->user_rsp)) {
+        uint64_t **dir = &args->pages[args->npages / ARG_PAGES_PER_DIR];
+        uint64_t page;
+        if(!*dir) {
+            *dir = (uint64_t *)get_free_page(0);
+            if(!*dir)
+                return -ENOMEM;
+        }
+        page = get_free_page(0);
+        if(!page)
+            return -ENOMEM;
+        (*dir)[args->npages % ARG_PAGES_PER_DIR] = page;
+        args->npages++;
+    }
+
+    /* Now safe to copy! Only as many strings as were counted */
+    ptrp = args->user_rsp;
+    argc = (uint64_t)args->argc;
+    err = arg_put(args, ptrp, &argc, sizeof(argc));
+    if(err)
+        return err;
+    ptrp += sizeof(uint64_t);
+
+    args->arg_start = strp;
+    if(args->interp[0]) {
+        err = arg_put_string(args, args->interp, strlen(args->interp),
+                             &strp, &ptrp);
+        if(err)
+            return err;
+    }
+    err = arg_put_strings(args, argv, nargv, &strp, &ptrp);
+    if(err)
+        return err;
+    ptrp += sizeof(uint64_t); /* NULL, the pages are zeroed */
+    args->arg_end = args->env_start = strp;
+
+    err = arg_put_strings(args, envp, args->envc, &strp, &ptrp);
+    if(err)
+        return err;
+    args->env_end = strp;
+    return 0;
+}
+
+/**
+ * Add the read-only vm area of the time page and map it, see vtime_init().
+ * Must be called with user's page tables loaded.
  */
-int add_stack(struct mm_struct *user, const char **argv, const char **envp) {
+static int add_vtime(struct mm_struct *user) {
+    struct vm_area *vtime;
+    int err;
+
+    vtime = vma_create(VTIME_ADDR, VTIME_ADDR + PAGE_SIZE, VM_RODATA, 0);
+    if(!vtime)
+        return -ENOMEM;
+    vtime->onfault = onfault_vtime;
+    err = onfault_vtime(vtime, VTIME_ADDR);
+    if(err) {
+        vma_destroy(vtime);
+        return err;
+    }
+    /* From here on the page tables hold the mapping */
+    if(mm_add_vma(user, vtime)) {
+        vma_destroy(vtime);
+        return -ENOEXEC;
+    }
+    return 0;
+}
+
+/**
+ * Add the stack vm area, mapping the staged argument pages at its top.
+ * On success the mapped pages belong to the user's page tables.
+ */
+int add_stack(struct mm_struct *user, struct exec_args *args) {
     struct vm_area *stack;
-    uint64_t phys_ptrs, phys_strs, *virt_ptrs;
-    char *virt_strs; /* hold page of user strings */
-    int err, argc, envc;
+    uint64_t curr_pml4;
+    int err = 0, i;
 
     user->start_stack = USER_STACK_START;
     stack = vma_create(USER_STACK_END, USER_STACK_START, VM_STACK, PFLAG_RW);
@@ -143,50 +337,35 @@ int add_stack(struct mm_struct *user, const char **argv, const char **envp) {
         return -ENOMEM;
     stack->onfault = onfault_mmap_anon;
 
-    /* Copy envp and args to new stack */
-    phys_ptrs = get_zero_page();
-    if(!phys_ptrs) {
-        err = -ENOMEM;
-        goto out_vma;
-    }
-    virt_ptrs = (uint64_t *)kphys_to_virt(phys_ptrs);
-    phys_strs = get_zero_page();
-    if(!phys_strs) {
-        err = -ENOMEM;
-        goto out_virt_ptrs;
+    /* Map the staged pages, only switching page tables once */
+    curr_pml4 = read_cr3();
+    write_cr3(user->pml4);
+    for(i = 0; i < args->npages; i++) {
+        uint64_t *page = &args->pages[i / ARG_PAGES_PER_DIR][i % ARG_PAGES_PER_DIR];
+        err = map_page(USER_STACK_TOP_PAGE - i * PAGE_SIZE,
+                       kvirt_to_phys(*page), stack->vm_prot);
+        if(err)
+            break;
+        *page = 0; /* now owned by the page tables */
     }
-    virt_strs = (char *)kphys_to_virt(phys_strs);
-
-    err = argv_envp_err(argv, envp, &argc, &envc); /* TODO: move this? validate pointers */
-    if(err)
-        goto out_virt_strs;
-    /* Now safe to copy! */
-    copy_strings(envp, envc, virt_ptrs, &virt_strs, 512);
-    copy_strings(argv, argc, virt_ptrs, &virt_strs, 512 - envc - 1);
-    virt_ptrs[512 - (argc + envc + 3)] = (int64_t)argc;
-    /* Map the string page to the top */
-    err = map_page_into(ALIGN_DOWN(USER_STACK_START, PAGE_SIZE), phys_strs,
-                        stack->vm_prot, user->pml4);
-    if(err)
-        goto out_virt_strs;
-    /* Map the pointer page next and set entry rsp */
-    user->user_rsp = USER_STACK_START - PAGE_SIZE - (8 * (argc + envc + 2));
-    err = map_page_into(ALIGN_DOWN(user->user_rsp, PAGE_SIZE), phys_ptrs,
-                        stack->vm_prot, user->pml4);
+    if(!err)
+        err = add_vtime(user);
+    write_cr3(curr_pml4);
     if(err)
-        goto out_virt_strs;
+        goto out_vma;
 
     /* Finally, add stack to the user */
     if(mm_add_vma(user, stack)) {
         err = -ENOEXEC;
-        goto out_virt_strs;
+        goto out_vma;
     }
 
+    user->user_rsp = args->user_rsp;
+    user->arg_start = args->arg_start;
+    user->arg_end = args->arg_end;
+    user->env_start = args->env_start;
+    user->env_end = args->env_end;
     return 0;
-out_virt_strs:
-    free_page(PAGE_ALIGN((uint64_t)virt_strs));
-out_virt_ptrs:
-    free_page(PAGE_ALIGN((uint64_t)virt_ptrs));
 out_vma:
     vma_destroy(stack);
     return err;
@@ -260,11 +439,13 @@ int mmap_area(struct mm_struct *mm, struct file *filep,
     } else {
         vma->onfault = onfault_mmap_anon;
     }
-    /* pre-fault the first page */
+    /* pre-fault the first page, not switched out while on mm's tables */
+    preempt_disable();
     curr_pml4 = read_cr3();
     write_cr3(mm->pml4);
     err = vma->onfault(vma, vm_start);
     write_cr3(curr_pml4);
+    preempt_enable();
     if(err)
         goto out_vma;
     /* finally add to mm */
@@ -327,6 +508,26 @@ void mm_destroy(struct mm_struct *mm) {
     }
 }
 
+static void mm_free_work(struct work_struct *work) {
+    mm_destroy(work_entry(work, struct mm_struct, free_work));
+}
+
+/**
+ * Like mm_destroy(), but if this drops the last reference the pages and
+ * page tables are freed later by a kworker, off the exit and exec paths.
+ * A CPU with the mm in CR3 holds a reference, see switch_mm().
+ */
+void mm_destroy_async(struct mm_struct *mm) {
+    if(!mm)
+        return;
+    if(mm->mm_count > 1) {
+        mm->mm_count--;
+        return;
+    }
+    init_work(&mm->free_work, mm_free_work);
+    queue_work(&mm->free_work);
+}
+
 /**
  * Return a deep copy of the current task's mm_struct.
  * This is used by fork.
@@ -347,7 +548,8 @@ struct mm_struct *mm_deep_copy(void) {
     /* Copy exactly from parent */
     memcpy(copy_mm, curr_mm, sizeof(*copy_mm));
     /* set pml4 to NULL so we don't free the parent's */
-    curr_mm->pml4 = 0;
+    copy_mm->pml4 = 0;
+    copy_mm->mm_count = 1; /* the parent's may be shared by its threads */
     /* Update the prev/next mm pointers */
     mm_list_add(copy_mm);
 
@@ -356,11 +558,15 @@ struct mm_struct *mm_deep_copy(void) {
     if(!copy_mm->vmas)
         goto out_copy_mm;
 
-    /* Create a copy of the page tables that are now Copy-On-Write */
-    curr_mm->pml4 = copy_current_pml4();
-    if(!curr_mm->pml4) {
+    /* Create a copy of the page tables that are now Copy-On-Write. The
+     * parent keeps its own, which may be in use by its threads on other
+     * CPUs while we copy. */
+    copy_mm->pml4 = copy_current_pml4();
+    if(!copy_mm->pml4) {
         goto out_copy_mm;
     }
+    /* Our threads must not keep writing through stale TLB entries */
+    smp_flush_tlb_mm(curr_mm);
 
     return copy_mm;
 out_copy_mm:
@@ -715,6 +921,26 @@ int onfault_mmap_anon(struct vm_area *vma, uint64_t addr) {
 }
 
 
+/**
+ * Map the kernel's time page, shared by every process. Writes to it fault
+ * as a protection violation, so it is never copied on write.
+ * @return: error or 0, same as map_page
+ */
+int onfault_vtime(struct vm_area *vma, uint64_t addr) {
+    int err;
+
+    if(!vma)
+        kpanic("Null VMA in a page fault!\n");
+    if(!vma_contains(vma, addr))
+        kpanic("VMA doesn't contain addr %p\n", (void*)addr);
+
+    err = map_page(VTIME_ADDR, vtime_phys, vma->vm_prot);
+    if(!err)
+        kphys_inc_mapcount(vtime_phys); /* free_pml4() drops it */
+    return err;
+}
+
+
 /**
  * For a Copy-On-Write page fault.
  * NOTE: This is only called when we have faulted on a PRESENT page.
@@ -723,7 +949,13 @@ int onfault_mmap_anon(struct vm_area *vma, uint64_t addr) {
  */
 int copy_on_write_pagefault(struct vm_area *vma, uint64_t addr) {
     uint64_t aligned = ALIGN_DOWN(addr, PAGE_SIZE);
-    return copy_cow_page(aligned, vma->vm_prot);
+    int err;
+
+    err = copy_cow_page(aligned, vma->vm_prot);
+    /* Our threads on other CPUs may still see the old page */
+    if(!err)
+        smp_flush_tlb_mm(curr_task->mm);
+    return err;
 }
 
 
@@ -0,0 +1,212 @@
+#include <sbunix/rbtree.h>
+
+/*
+ * Red-black tree rebalancing, after CLRS chapter 13.
+ * NULL children are the black leaves.
+ */
+
+static inline int rb_is_red(struct rb_node *node) {
+    return node && node->rb_red;
+}
+
+/**
+ * Replace the parent's link to old with new.
+ */
+static void rb_change_child(struct rb_node *old, struct rb_node *new,
+                            struct rb_node *parent, struct rb_root *root) {
+    if(!parent)
+        root->rb_node = new;
+    else if(parent->rb_left == old)
+        parent->rb_left = new;
+    else
+        parent->rb_right = new;
+}
+
+static void rb_rotate_left(struct rb_node *x, struct rb_root *root) {
+    struct rb_node *y = x->rb_right;
+
+    x->rb_right = y->rb_left;
+    if(y->rb_left)
+        y->rb_left->rb_parent = x;
+    y->rb_parent = x->rb_parent;
+    rb_change_child(x, y, x->rb_parent, root);
+    y->rb_left = x;
+    x->rb_parent = y;
+}
+
+static void rb_rotate_right(struct rb_node *x, struct rb_root *root) {
+    struct rb_node *y = x->rb_left;
+
+    x->rb_left = y->rb_right;
+    if(y->rb_right)
+        y->rb_right->rb_parent = x;
+    y->rb_parent = x->rb_parent;
+    rb_change_child(x, y, x->rb_parent, root);
+    y->rb_right = x;
+    x->rb_parent = y;
+}
+
+/**
+ * Restore the red-black properties after rb_link_node().
+ */
+void rb_insert_color(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *parent, *gparent, *uncle;
+
+    while((parent = node->rb_parent) && parent->rb_red) {
+        gparent = parent->rb_parent; /* a red parent is never the root */
+        if(parent == gparent->rb_left) {
+            uncle = gparent->rb_right;
+            if(rb_is_red(uncle)) {
+                parent->rb_red = uncle->rb_red = 0;
+                gparent->rb_red = 1;
+                node = gparent;
+                continue;
+            }
+            if(node == parent->rb_right) {
+                rb_rotate_left(parent, root);
+                node = parent;
+                parent = node->rb_parent;
+            }
+            parent->rb_red = 0;
+            gparent->rb_red = 1;
+            rb_rotate_right(gparent, root);
+        } else {
+            uncle = gparent->rb_left;
+            if(rb_is_red(uncle)) {
+                parent->rb_red = uncle->rb_red = 0;
+                gparent->rb_red = 1;
+                node = gparent;
+                continue;
+            }
+            if(node == parent->rb_left) {
+                rb_rotate_right(parent, root);
+                node = parent;
+                parent = node->rb_parent;
+            }
+            parent->rb_red = 0;
+            gparent->rb_red = 1;
+            rb_rotate_left(gparent, root);
+        }
+    }
+    root->rb_node->rb_red = 0;
+}
+
+/**
+ * Fix a black deficit at node (possibly NULL), a child of parent.
+ */
+static void rb_erase_color(struct rb_node *node, struct rb_node *parent,
+                           struct rb_root *root) {
+    struct rb_node *sib;
+
+    while(node != root->rb_node && !rb_is_red(node)) {
+        if(node == parent->rb_left) {
+            sib = parent->rb_right;
+            if(sib->rb_red) {
+                sib->rb_red = 0;
+                parent->rb_red = 1;
+                rb_rotate_left(parent, root);
+                sib = parent->rb_right;
+            }
+            if(!rb_is_red(sib->rb_left) && !rb_is_red(sib->rb_right)) {
+                sib->rb_red = 1;
+                node = parent;
+                parent = node->rb_parent;
+            } else {
+                if(!rb_is_red(sib->rb_right)) {
+                    sib->rb_left->rb_red = 0;
+                    sib->rb_red = 1;
+                    rb_rotate_right(sib, root);
+                    sib = parent->rb_right;
+                }
+                sib->rb_red = parent->rb_red;
+                parent->rb_red = 0;
+                sib->rb_right->rb_red = 0;
+                rb_rotate_left(parent, root);
+                node = root->rb_node;
+            }
+        } else {
+            sib = parent->rb_left;
+            if(sib->rb_red) {
+                sib->rb_red = 0;
+                parent->rb_red = 1;
+                rb_rotate_right(parent, root);
+                sib = parent->rb_left;
+            }
+            if(!rb_is_red(sib->rb_left) && !rb_is_red(sib->rb_right)) {
+                sib->rb_red = 1;
+                node = parent;
+                parent = node->rb_parent;
+            } else {
+                if(!rb_is_red(sib->rb_left)) {
+                    sib->rb_right->rb_red = 0;
+                    sib->rb_red = 1;
+                    rb_rotate_left(sib, root);
+                    sib = parent->rb_left;
+                }
+                sib->rb_red = parent->rb_red;
+                parent->rb_red = 0;
+                sib->rb_left->rb_red = 0;
+                rb_rotate_right(parent, root);
+                node = root->rb_node;
+            }
+        }
+    }
+    if(node)
+        node->rb_red = 0;
+}
+
+/**
+ * Remove node from the tree and rebalance.
+ */
+void rb_erase(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *child, *parent, *next;
+    int removed_red;
+
+    if(!node->rb_left || !node->rb_right) {
+        /* At most one child, splice node out */
+        child = node->rb_left? node->rb_left : node->rb_right;
+        parent = node->rb_parent;
+        removed_red = node->rb_red;
+        rb_change_child(node, child, parent, root);
+        if(child)
+            child->rb_parent = parent;
+    } else {
+        /* Two children, node's successor takes its place */
+        next = node->rb_right;
+        while(next->rb_left)
+            next = next->rb_left;
+        child = next->rb_right;
+        removed_red = next->rb_red;
+        if(next->rb_parent == node) {
+            parent = next;
+        } else {
+            parent = next->rb_parent;
+            parent->rb_left = child;
+            if(child)
+                child->rb_parent = parent;
+            next->rb_right = node->rb_right;
+            next->rb_right->rb_parent = next;
+        }
+        rb_change_child(node, next, node->rb_parent, root);
+        next->rb_parent = node->rb_parent;
+        next->rb_left = node->rb_left;
+        next->rb_left->rb_parent = next;
+        next->rb_red = node->rb_red;
+    }
+
+    if(!removed_red)
+        rb_erase_color(child, parent, root);
+}
+
+/**
+ * Return the leftmost (smallest) node, NULL if the tree is empty.
+ */
+struct rb_node *rb_first(struct rb_root *root) {
+    struct rb_node *node = root->rb_node;
+
+    if(!node)
+        return NULL;
+    while(node->rb_left)
+        node = node->rb_left;
+    return node;
+}
@@ -0,0 +1,240 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/rbtree.h>
+#include <sbunix/smp.h>
+#include <sbunix/schedstat.h>
+#include <sbunix/interrupt/pit.h>
+#include "cfs.h"
+
+/*
+ * Completely fair scheduling.
+ * Each task accumulates virtual runtime, its run time scaled by the weight
+ * of its nice value, and the runnable task with the least vruntime runs
+ * next. Runnable tasks (other than the current) are kept in a red-black
+ * tree keyed by vruntime. Timeslices split CFS_LATENCY_TICKS between the
+ * runnable tasks by weight, and fork does not split the parent's share.
+ * Each CPU has its own timeline, a CPU with nothing queued steals the
+ * leftmost task of the CPU with the most queued tasks.
+ */
+
+#define CFS_LATENCY_TICKS  20  /* every runnable task runs once per period */
+#define CFS_MIN_SLICE      2   /* ticks, stretches the period for many tasks */
+#define CFS_WAKEUP_GRAN    TICK_NSEC
+#define NICE_0_WEIGHT      1024
+
+/* Each nice level is ~10% CPU, weights are ~1.25x apart (as in Linux) */
+static const uint32_t cfs_prio_to_weight[NICE_MAX - NICE_MIN + 1] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+struct cfs_rq {
+    /* Runnable tasks ordered by vruntime, the current task is not in it */
+    struct rb_root timeline;
+    /* Only marks membership (task->rq) and counts tasks, order is in the tree */
+    struct queue queue;
+    uint64_t load;          /* sum of the weights in the tree */
+    uint64_t min_vruntime;  /* monotonic floor of all vruntimes */
+    int need_resched;
+};
+
+static struct cfs_rq cfs_rqs[MAX_CPUS];
+
+static inline uint64_t cfs_weight(struct task_struct *task) {
+    int nice = MAX(NICE_MIN, MIN(task->nice, NICE_MAX));
+    return cfs_prio_to_weight[nice - NICE_MIN];
+}
+
+/**
+ * Convert real nanoseconds into the task's virtual nanoseconds.
+ */
+static inline uint64_t cfs_delta(uint64_t ns, struct task_struct *task) {
+    return ns * NICE_0_WEIGHT / cfs_weight(task);
+}
+
+static inline struct task_struct *cfs_leftmost(struct cfs_rq *rq) {
+    struct rb_node *left = rb_first(&rq->timeline);
+    return left? rb_entry(left, struct task_struct, run_node) : NULL;
+}
+
+/**
+ * Return the task running on cpu if it is a runnable CFS task, else NULL.
+ */
+static inline struct task_struct *cfs_curr(int cpu) {
+    struct task_struct *curr = cpus[cpu].curr;
+    if(curr->state == TASK_RUNNABLE && curr != cpus[cpu].idle && !rt_task(curr))
+        return curr;
+    return NULL;
+}
+
+static void cfs_update_min_vruntime(int cpu) {
+    struct cfs_rq *rq = &cfs_rqs[cpu];
+    struct task_struct *left = cfs_leftmost(rq), *curr = cfs_curr(cpu);
+    uint64_t vruntime;
+
+    if(curr) {
+        vruntime = curr->vruntime;
+        if(left)
+            vruntime = MIN(vruntime, left->vruntime);
+    } else if(left) {
+        vruntime = left->vruntime;
+    } else {
+        return;
+    }
+    rq->min_vruntime = MAX(rq->min_vruntime, vruntime);
+}
+
+/**
+ * Timeslice in ticks, task's share of the period by weight.
+ */
+static int cfs_slice(struct cfs_rq *rq, struct task_struct *task) {
+    uint64_t period = CFS_LATENCY_TICKS, w = cfs_weight(task);
+    uint64_t nr = rq->queue.num_tasks + 1;
+
+    if(nr * CFS_MIN_SLICE > period)
+        period = nr * CFS_MIN_SLICE;
+    return (int)MAX(period * w / (rq->load + w), CFS_MIN_SLICE);
+}
+
+/**
+ * Insert a runnable task into the timeline of the CPU it last ran on.
+ * Sleepers (and tasks new to this class) get at most half a period of
+ * credit over the others.
+ */
+static void cfs_enqueue(struct task_struct *task, int flags) {
+    struct cfs_rq *rq = &cfs_rqs[task->cpu];
+    struct rb_node **link = &rq->timeline.rb_node, *parent = NULL;
+    struct task_struct *curr = cfs_curr(task->cpu);
+    uint64_t credit = CFS_LATENCY_TICKS * TICK_NSEC / 2;
+
+    if(task->rq)
+        kpanic("Task %s is already on a queue\n", task->cmdline);
+
+    if(rq->min_vruntime > credit && task->vruntime < rq->min_vruntime - credit)
+        task->vruntime = rq->min_vruntime - credit;
+
+    while(*link) {
+        parent = *link;
+        /* Equal keys go right, so they run in FIFO order */
+        if(task->vruntime < rb_entry(parent, struct task_struct, run_node)->vruntime)
+            link = &parent->rb_left;
+        else
+            link = &parent->rb_right;
+    }
+    rb_link_node(&task->run_node, parent, link);
+    rb_insert_color(&task->run_node, &rq->timeline);
+
+    task->rq = &rq->queue;
+    rq->queue.num_tasks++;
+    rq->load += cfs_weight(task);
+
+    /* Preempt that CPU's task on its next tick if it is well ahead */
+    if((flags & ENQUEUE_WAKEUP) && curr &&
+            curr->vruntime > task->vruntime + CFS_WAKEUP_GRAN)
+        rq->need_resched = 1;
+}
+
+static void cfs_dequeue(struct task_struct *task) {
+    struct cfs_rq *rq = &cfs_rqs[task->cpu];
+
+    if(task->rq != &rq->queue)
+        return;
+    rb_erase(&task->run_node, &rq->timeline);
+    task->rq = NULL;
+    rq->queue.num_tasks--;
+    rq->load -= cfs_weight(task);
+}
+
+/**
+ * Charge the tick to the current task.
+ */
+static int cfs_tick(struct task_struct *curr) {
+    curr->vruntime += cfs_delta(TICK_NSEC, curr);
+    cfs_update_min_vruntime(this_cpu()->id);
+    return --curr->timeslice <= 0 || cfs_rqs[this_cpu()->id].need_resched;
+}
+
+/**
+ * The child starts behind everyone, one minimum slice past the current
+ * minimum, so forking can not be used to get ahead.
+ */
+static void cfs_fork(struct task_struct *parent, struct task_struct *child) {
+    cfs_update_min_vruntime(child->cpu);
+    child->vruntime = MAX(parent->vruntime, cfs_rqs[child->cpu].min_vruntime) +
+            cfs_delta(CFS_MIN_SLICE * TICK_NSEC, child);
+    child->timeslice = 0;
+}
+
+/**
+ * Take the leftmost task of the CPU with the most queued tasks. Its
+ * vruntime is moved from that CPU's min_vruntime to ours, so it keeps its
+ * lead or lag over the others but not the difference between the CPUs.
+ * @self: the stealing CPU
+ * @return: the task, or NULL if every other CPU's timeline is empty
+ */
+static struct task_struct *cfs_steal(int self) {
+    struct cfs_rq *rq = &cfs_rqs[self], *busiest = NULL;
+    struct task_struct *task;
+    ulong most = 0;
+    int i;
+
+    for(i = 0; i < smp_num_cpus; i++) {
+        if(i != self && cfs_rqs[i].queue.num_tasks > most) {
+            most = cfs_rqs[i].queue.num_tasks;
+            busiest = &cfs_rqs[i];
+        }
+    }
+    if(!busiest)
+        return NULL;
+    task = cfs_leftmost(busiest);
+    cfs_dequeue(task);
+    if(task->vruntime + rq->min_vruntime > busiest->min_vruntime)
+        task->vruntime = task->vruntime + rq->min_vruntime - busiest->min_vruntime;
+    else
+        task->vruntime = 0;
+    sched_stats.steals++;
+    return task;
+}
+
+/**
+ * Run the task with the least vruntime, the current task keeps running if
+ * it is still the furthest behind.
+ */
+static struct task_struct *cfs_pick_next(void) {
+    struct cfs_rq *rq = &cfs_rqs[this_cpu()->id];
+    struct task_struct *task, *left, *curr = cfs_curr(this_cpu()->id);
+
+    rq->need_resched = 0;
+    left = cfs_leftmost(rq);
+
+    if(curr && (!left || curr->vruntime <= left->vruntime)) {
+        task = curr;
+    } else if(left) {
+        task = left;
+        cfs_dequeue(task);
+    } else {
+        /* Nothing queued here, balance by taking work from another CPU */
+        task = smp_num_cpus > 1? cfs_steal(this_cpu()->id) : NULL;
+        /* Return idle task if no task */
+        if(!task)
+            return idle_task;
+    }
+
+    task->timeslice = cfs_slice(rq, task);
+    return task;
+}
+
+struct sched_class cfs_sched_class = {
+        .name = "cfs",
+        .pick_next = cfs_pick_next,
+        .enqueue = cfs_enqueue,
+        .dequeue = cfs_dequeue,
+        .tick = cfs_tick,
+        .fork = cfs_fork,
+};
@@ -0,0 +1,8 @@
+#ifndef SCHED_CFS_H
+#define SCHED_CFS_H
+
+#include <sbunix/sched.h>
+
+extern struct sched_class cfs_sched_class;
+
+#endif
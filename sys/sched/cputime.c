@@ -0,0 +1,35 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/cputime.h>
+#include <sbunix/string.h>
+#include <sbunix/interrupt/pit.h>
+
+/**
+ * Add acct to sum, e.g. a reaped child's usage to its parent's cacct.
+ */
+void acct_add(struct task_acct *sum, struct task_acct *acct) {
+    sum->utime += acct->utime;
+    sum->stime += acct->stime;
+    sum->minflt += acct->minflt;
+    sum->majflt += acct->majflt;
+    sum->nvcsw += acct->nvcsw;
+    sum->nivcsw += acct->nivcsw;
+}
+
+static void cycles_to_timeval(uint64_t cycles, struct timeval *tv) {
+    uint64_t usec = tsc_to_usec(cycles);
+    tv->tv_sec = (time_t)(usec / 1000000);
+    tv->tv_usec = (suseconds_t)(usec % 1000000);
+}
+
+/**
+ * Fill in the rusage returned by getrusage() and wait4().
+ */
+void acct_to_rusage(struct task_acct *acct, struct rusage *ru) {
+    memset(ru, 0, sizeof(*ru));
+    cycles_to_timeval(acct->utime, &ru->ru_utime);
+    cycles_to_timeval(acct->stime, &ru->ru_stime);
+    ru->ru_minflt = (long)acct->minflt;
+    ru->ru_majflt = (long)acct->majflt;
+    ru->ru_nvcsw = (long)acct->nvcsw;
+    ru->ru_nivcsw = (long)acct->nivcsw;
+}
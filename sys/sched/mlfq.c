@@ -0,0 +1,197 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/smp.h>
+#include <sbunix/schedstat.h>
+#include "roundrobin.h"
+#include "mlfq.h"
+
+/*
+ * Multi-level feedback queue.
+ * Tasks that use up their timeslice sink a level, to longer slices and
+ * lower priority. Tasks that block (e.g. sbush on the terminal) rise a level
+ * when they wake, and preempt anything running at a lower level.
+ * Every MLFQ_BOOST_TICKS all tasks go back to the top so CPU hogs can not
+ * be starved.
+ * Each CPU has its own levels, a CPU with nothing queued steals from the
+ * CPU with the most queued tasks.
+ */
+
+#define MLFQ_LEVELS       4
+#define MLFQ_BOOST_TICKS  1000  /* 1 second of user time at 1000 HZ */
+
+/* Timeslice in timer ticks for each level */
+static const int mlfq_slice[MLFQ_LEVELS] = {10, 20, 40, 80};
+
+struct mlfq_rq {
+    /* One round robin queue per level, 0 is the highest priority */
+    struct queue queues[MLFQ_LEVELS];
+    ulong num_tasks;    /* queued on all levels */
+    int need_resched;
+    int boost_ticks;
+};
+
+static struct mlfq_rq mlfq_rqs[MAX_CPUS];
+
+static inline int mlfq_level(struct task_struct *task) {
+    if(task->sched_level < 0)
+        return 0;
+    if(task->sched_level >= MLFQ_LEVELS)
+        return MLFQ_LEVELS - 1;
+    return task->sched_level;
+}
+
+/**
+ * Queue a runnable task at its level on the CPU it last ran on. A waking
+ * task is promoted one level with a fresh slice.
+ */
+static void mlfq_enqueue(struct task_struct *task, int flags) {
+    struct mlfq_rq *rq = &mlfq_rqs[task->cpu];
+    int level = mlfq_level(task);
+
+    if(flags & ENQUEUE_WAKEUP) {
+        if(level > 0)
+            level--;
+        task->timeslice = mlfq_slice[level];
+        /* Preempt a lower priority task on the next tick of that CPU */
+        if(level < mlfq_level(cpus[task->cpu].curr))
+            rq->need_resched = 1;
+    }
+    task->sched_level = level;
+    rr_queue_add(&rq->queues[level], task);
+    rq->num_tasks++;
+}
+
+static void mlfq_dequeue(struct task_struct *task) {
+    if(!task->rq)
+        return;
+    rr_queue_remove(task->rq, task);
+    mlfq_rqs[task->cpu].num_tasks--;
+}
+
+/**
+ * Move every task of this CPU back to the top level.
+ */
+static void mlfq_boost(int cpu) {
+    struct mlfq_rq *rq = &mlfq_rqs[cpu];
+    struct task_struct *task;
+
+    for(task = kernel_task.next_task; task != &kernel_task;
+        task = task->next_task) {
+        if(rt_task(task) || task->cpu != cpu)
+            continue;
+        if(task->state == TASK_RUNNABLE && task->rq &&
+                task->rq != &rq->queues[0]) {
+            rr_queue_remove(task->rq, task);
+            rr_queue_add(&rq->queues[0], task);
+        }
+        task->sched_level = 0;
+        if(task->timeslice > mlfq_slice[0])
+            task->timeslice = mlfq_slice[0];
+    }
+}
+
+/**
+ * Demote the current task when its slice runs out.
+ */
+static int mlfq_tick(struct task_struct *curr) {
+    struct mlfq_rq *rq = &mlfq_rqs[this_cpu()->id];
+
+    if(++rq->boost_ticks >= MLFQ_BOOST_TICKS) {
+        rq->boost_ticks = 0;
+        mlfq_boost(this_cpu()->id);
+    }
+    if(--curr->timeslice <= 0) {
+        if(curr->sched_level < MLFQ_LEVELS - 1)
+            curr->sched_level++;
+        return 1;
+    }
+    return rq->need_resched;
+}
+
+/**
+ * The child starts at the parent's level with half of its remaining slice.
+ */
+static void mlfq_fork(struct task_struct *parent, struct task_struct *child) {
+    parent->timeslice >>= 1;
+    child->timeslice = parent->timeslice;
+}
+
+/**
+ * Return the highest non-empty level of rq, MLFQ_LEVELS if none.
+ */
+static int mlfq_top_level(struct mlfq_rq *rq) {
+    int level;
+
+    for(level = 0; level < MLFQ_LEVELS; level++) {
+        if(rq->queues[level].tasks)
+            break;
+    }
+    return level;
+}
+
+/**
+ * Take the highest priority task queued on the CPU with the most queued
+ * tasks.
+ * @self: the stealing CPU
+ * @return: the task, or NULL if every other CPU's levels are empty
+ */
+static struct task_struct *mlfq_steal(int self) {
+    struct mlfq_rq *busiest = NULL;
+    struct task_struct *task;
+    ulong most = 0;
+    int i;
+
+    for(i = 0; i < smp_num_cpus; i++) {
+        if(i != self && mlfq_rqs[i].num_tasks > most) {
+            most = mlfq_rqs[i].num_tasks;
+            busiest = &mlfq_rqs[i];
+        }
+    }
+    if(!busiest)
+        return NULL;
+    task = rr_queue_pop(&busiest->queues[mlfq_top_level(busiest)]);
+    busiest->num_tasks--;
+    sched_stats.steals++;
+    return task;
+}
+
+/**
+ * Pick the first task of the highest non-empty level. The current task
+ * keeps running if it is still runnable and at a strictly higher level.
+ */
+static struct task_struct *mlfq_pick_next(void) {
+    struct mlfq_rq *rq = &mlfq_rqs[this_cpu()->id];
+    struct task_struct *task = NULL;
+    int level;
+
+    rq->need_resched = 0;
+    level = mlfq_top_level(rq);
+
+    if(curr_task->state == TASK_RUNNABLE && curr_task != idle_task &&
+            !rt_task(curr_task) && mlfq_level(curr_task) < level) {
+        task = curr_task;
+    } else if(level < MLFQ_LEVELS) {
+        task = rr_queue_pop(&rq->queues[level]);
+        rq->num_tasks--;
+    } else if(smp_num_cpus > 1) {
+        /* Nothing queued here, balance by taking work from another CPU */
+        task = mlfq_steal(this_cpu()->id);
+    }
+    if(!task) {
+        /* Return idle task if no task */
+        return idle_task;
+    }
+
+    if(task->timeslice <= 0)
+        task->timeslice = mlfq_slice[mlfq_level(task)];
+    return task;
+}
+
+struct sched_class mlfq_sched_class = {
+        .name = "mlfq",
+        .pick_next = mlfq_pick_next,
+        .enqueue = mlfq_enqueue,
+        .dequeue = mlfq_dequeue,
+        .tick = mlfq_tick,
+        .fork = mlfq_fork,
+};
@@ -0,0 +1,8 @@
+#ifndef SCHED_MLFQ_H
+#define SCHED_MLFQ_H
+
+#include <sbunix/sched.h>
+
+extern struct sched_class mlfq_sched_class;
+
+#endif
@@ -0,0 +1,119 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <errno.h>
+
+/*
+ * PID allocation and lookup.
+ *
+ * Used PIDs are kept in a bitmap. A new PID is the first free one after
+ * the last one handed out, wrapping around at PID_MAX, so freed PIDs are
+ * reused but not right away. PID 0 belongs to the idle tasks and is never
+ * handed out.
+ *
+ * Tasks are hashed by PID from creation until their parent reaps them, so
+ * zombies can still be found. Because PIDs are handed out in order the low
+ * bits spread them evenly over the buckets.
+ */
+
+#define PIDMAP_WORDS  (PID_MAX / 64)
+#define PIDHASH_SIZE  1024
+#define pid_hashfn(pid)  ((pid) & (PIDHASH_SIZE - 1))
+
+static uint64_t pidmap[PIDMAP_WORDS] = { 1 }; /* PID 0 is taken */
+static int nr_pids = 1;
+static pid_t last_pid = 0;
+static struct task_struct *pid_hash[PIDHASH_SIZE];
+
+/**
+ * Take the first free PID after the last one allocated.
+ * @return: the new PID, or -EAGAIN if all are in use
+ */
+pid_t alloc_pid(void) {
+    pid_t pid = last_pid + 1;
+    uint64_t free;
+    int i, word;
+
+    if(nr_pids >= PID_MAX)
+        return -EAGAIN;
+
+    /* One more than the number of words, the first may be partly skipped */
+    for(i = 0; i <= PIDMAP_WORDS; i++) {
+        if(pid >= PID_MAX)
+            pid = 0;
+        word = pid / 64;
+        free = ~pidmap[word] & (~0UL << (pid % 64));
+        if(free) {
+            pid = word * 64 + __builtin_ctzl(free);
+            pidmap[word] |= 1UL << (pid % 64);
+            nr_pids++;
+            last_pid = pid;
+            return pid;
+        }
+        pid = (word + 1) * 64;
+    }
+    kpanic("PID bitmap has no free bit, but only %d PIDs are used\n", nr_pids);
+    return -EAGAIN;
+}
+
+/**
+ * Give back a PID from alloc_pid().
+ */
+void free_pid(pid_t pid) {
+    if(pid <= 0 || pid >= PID_MAX || !(pidmap[pid / 64] & (1UL << (pid % 64))))
+        kpanic("Freeing PID %d which is not in use\n", pid);
+    pidmap[pid / 64] &= ~(1UL << (pid % 64));
+    nr_pids--;
+}
+
+/**
+ * Make task findable by its PID.
+ */
+void pid_hash_add(struct task_struct *task) {
+    struct task_struct **bucket = &pid_hash[pid_hashfn(task->pid)];
+
+    task->pid_hash_next = *bucket;
+    *bucket = task;
+}
+
+/**
+ * Remove task from the PID hash, when it is reaped.
+ */
+void pid_hash_remove(struct task_struct *task) {
+    struct task_struct **link = &pid_hash[pid_hashfn(task->pid)];
+
+    for(; *link != NULL; link = &(*link)->pid_hash_next) {
+        if(*link == task) {
+            *link = task->pid_hash_next;
+            task->pid_hash_next = NULL;
+            return;
+        }
+    }
+    kpanic("Task %d is not in the PID hash\n", task->pid);
+}
+
+/**
+ * Return the task with the given pid, zombies included, or NULL.
+ */
+struct task_struct *lookup_pid(pid_t pid) {
+    struct task_struct *task;
+
+    if(pid <= 0 || pid >= PID_MAX)
+        return NULL;
+    for(task = pid_hash[pid_hashfn(pid)]; task != NULL;
+        task = task->pid_hash_next) {
+        if(task->pid == pid)
+            return task;
+    }
+    return NULL;
+}
+
+/**
+ * Return the live task with the given pid, or NULL.
+ */
+struct task_struct *find_task_by_pid(pid_t pid) {
+    struct task_struct *task = lookup_pid(pid);
+
+    if(task && task->state == TASK_DEAD)
+        return NULL;
+    return task;
+}
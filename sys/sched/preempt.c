@@ -0,0 +1,58 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/preempt.h>
+#include <sbunix/smp.h>
+#include <sbunix/cputime.h>
+#include <sbunix/schedstat.h>
+#include <sbunix/interrupt/softirq.h>
+
+/*
+ * Preemption of tasks at the end of interrupts and at preemption points,
+ * see <sbunix/preempt.h>.
+ */
+
+/**
+ * Switch out the current task from a preemption point in a syscall,
+ * interrupts are enabled again when it is switched back in.
+ */
+void preempt_schedule(void) {
+    uint64_t flags = local_irq_save();
+    schedule();
+    local_irq_restore(flags);
+}
+
+/**
+ * Called by every ISR wrapper before the handler.
+ */
+void irq_enter(void) {
+    struct task_struct *curr;
+
+    this_cpu()->irq_stamp = read_tsc(); /* interrupts off since about now */
+    lock_kernel();
+    curr = curr_task;
+    if(!curr->preempt_count)
+        account_user_time(curr);    /* interrupted user mode */
+    curr->preempt_count += HARDIRQ_OFFSET;
+}
+
+/**
+ * Called by every ISR wrapper after the handler. Runs the softirqs the
+ * handler raised, unless it interrupted another interrupt or softirq.
+ * If the timeslice ran out and the interrupted code can be preempted,
+ * switch tasks here. The interrupted task returns from the interrupt when
+ * it is switched back in.
+ */
+void irq_exit(void) {
+    struct task_struct *curr = curr_task;
+
+    curr->preempt_count -= HARDIRQ_OFFSET;
+    if(!in_interrupt() && this_cpu()->softirq_pending)
+        do_softirq();
+    schedstat_tick_irqs_on(this_cpu());
+    if(!curr->preempt_count) {
+        if(curr->need_resched)
+            schedule();
+        account_system_time(curr);  /* back to user mode */
+    }
+    unlock_kernel();
+}
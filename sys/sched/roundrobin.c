@@ -1,120 +1,257 @@
 #include <sbunix/sbunix.h>
 #include <sbunix/sched.h>
+#include <sbunix/smp.h>
+#include <sbunix/schedstat.h>
 #include "roundrobin.h"
 
+/*
+ * Each CPU has two round robin queues, both hold tasks in the state
+ * TASK_RUNNABLE. run_queue points to the one being drained, when it is
+ * depleted it is exchanged with just_ran_queue. A CPU with nothing left to
+ * run steals from the CPU with the most queued tasks.
+ */
+struct rr_rq {
+    struct queue queues[2];
+    struct queue *run_queue;
+    struct queue *just_ran_queue;
+};
+
+static struct rr_rq rr_rqs[MAX_CPUS];
+
 /**
- * Add a task to the front of the list of tasks in queue.
+ * Return the round robin queues of a CPU.
+ */
+static struct rr_rq *cpu_rr_rq(int cpu) {
+    struct rr_rq *rq = &rr_rqs[cpu];
+    if(!rq->run_queue) {
+        rq->run_queue = &rq->queues[0];
+        rq->just_ran_queue = &rq->queues[1];
+    }
+    return rq;
+}
+
+/**
+ * Add a task to the end of the list of tasks in queue.
  */
 void rr_queue_add(struct queue *queue, struct task_struct *task) {
     if(!queue || !task)
         return;
+    if(task->rq)
+        kpanic("Task %s is already on a queue\n", task->cmdline);
 
     task->next_rq = NULL;
-    if(!queue->tasks) {
+    task->prev_rq = queue->tail;
+    if(!queue->tail) {
         /* Add the first element of the queue */
         queue->tasks = task;
     } else {
         /* Insert into the end of the queue */
-        struct task_struct *prev = queue->tasks;
-        for(; prev->next_rq != NULL; prev = prev->next_rq) {
-        }
-        prev->next_rq = task;
+        queue->tail->next_rq = task;
     }
+    queue->tail = task;
+    queue->num_tasks++;
+    task->rq = queue;
+}
+
+/**
+ * Add a task to the front of the list of tasks in queue.
+ */
+void rr_queue_add_head(struct queue *queue, struct task_struct *task) {
+    if(!queue || !task)
+        return;
+    if(task->rq)
+        kpanic("Task %s is already on a queue\n", task->cmdline);
+
+    task->prev_rq = NULL;
+    task->next_rq = queue->tasks;
+    if(queue->tasks)
+        queue->tasks->prev_rq = task;
+    else
+        queue->tail = task;
+    queue->tasks = task;
+    queue->num_tasks++;
+    task->rq = queue;
 }
 
 /**
- * Search for and remove the given task from the queue.
- * No error if not found.
+ * Remove the given task from the queue.
+ * No error if the task is not on this queue.
  */
 void rr_queue_remove(struct queue *queue, struct task_struct *task) {
-    if(!queue || !queue->tasks || !task)
+    if(!queue || !task || task->rq != queue)
         return;
 
-    if(queue->tasks == task)
-        /* Simple, it was the head of the list. */
-        queue->tasks =  queue->tasks->next_rq;
-    else {
-        struct task_struct *prev = queue->tasks;
-        /* Search for task, removing it if found */
-        for(; prev->next_rq != NULL; prev = prev->next_rq) {
-            if(prev->next_rq == task) {
-                prev->next_rq = prev->next_rq->next_rq;
-                return;
-            }
-        }
-    }
+    if(task->prev_rq)
+        task->prev_rq->next_rq = task->next_rq;
+    else
+        queue->tasks = task->next_rq;  /* it was the head of the list */
+
+    if(task->next_rq)
+        task->next_rq->prev_rq = task->prev_rq;
+    else
+        queue->tail = task->prev_rq;   /* it was the tail of the list */
+
+    task->next_rq = task->prev_rq = NULL;
+    task->rq = NULL;
+    queue->num_tasks--;
 }
 
 /**
  * Pop the first task off the queue, NULL if no tasks.
  */
 struct task_struct *rr_queue_pop(struct queue *queue) {
+    struct task_struct *task;
     if(!queue || !queue->tasks)
         return NULL;
-    else {
-        /* Pop off the first task */
-        struct task_struct *task = queue->tasks;
-        queue->tasks = queue->tasks->next_rq;
-        return task;
-    }
+
+    /* Pop off the first task */
+    task = queue->tasks;
+    rr_queue_remove(queue, task);
+    return task;
+}
+
+/**
+ * Exchange the run_queue and the just_ran_queue.
+ * Called when the run_queue is depleted. The queues are swapped rather
+ * than their contents, so each task's rq pointer stays valid.
+ */
+static void exchange_queues(struct rr_rq *rq) {
+    struct queue *tmp;
+    tmp = rq->just_ran_queue;
+    rq->just_ran_queue = rq->run_queue;
+    rq->run_queue = tmp;
+}
+
+/**
+ * Queue a runnable task on the CPU it last ran on. Waking tasks go on the
+ * run_queue so they run before the tasks that have already had their turn.
+ */
+static void rr_enqueue(struct task_struct *task, int flags) {
+    struct rr_rq *rq = cpu_rr_rq(task->cpu);
+    if(flags & ENQUEUE_WAKEUP)
+        rr_queue_add(rq->run_queue, task);
+    else
+        rr_queue_add(rq->just_ran_queue, task);
+}
+
+/**
+ * Remove a runnable task from whichever rr queue it is on.
+ */
+static void rr_dequeue(struct task_struct *task) {
+    rr_queue_remove(task->rq, task);
+}
+
+/**
+ * Reschedule when the task has used up its timeslice.
+ */
+static int rr_tick(struct task_struct *curr) {
+    return --curr->timeslice <= 0;
 }
 
 /**
- * Exchange the tasks of the run_queue and the just_ran_queue.
- * Called when the run_queue is depleted.
+ * Half the remaining timeslice (split between parent and child).
  */
-void exchange_queues(void) {
-    struct task_struct *tmp;
-    tmp = just_ran_queue.tasks;
-    just_ran_queue.tasks = run_queue.tasks;
-    run_queue.tasks = tmp;
+static void rr_fork(struct task_struct *parent, struct task_struct *child) {
+    parent->timeslice >>= 1;
+    child->timeslice = parent->timeslice;
 }
 
 /**
- * Pick the highest priority task to run.
+ * Take a task queued on the CPU with the most queued tasks.
+ * @self: the stealing CPU
+ * @return: the task, or NULL if every other CPU's queues are empty
+ */
+static struct task_struct *rr_steal(int self) {
+    struct rr_rq *rq, *busiest = NULL;
+    struct task_struct *task;
+    ulong n, most = 0;
+    int i;
+
+    for(i = 0; i < smp_num_cpus; i++) {
+        if(i == self)
+            continue;
+        rq = cpu_rr_rq(i);
+        n = rq->queues[0].num_tasks + rq->queues[1].num_tasks;
+        if(n > most) {
+            most = n;
+            busiest = rq;
+        }
+    }
+    if(!busiest)
+        return NULL;
+    /* Prefer a task that already had its turn over there */
+    task = rr_queue_pop(busiest->just_ran_queue);
+    if(!task)
+        task = rr_queue_pop(busiest->run_queue);
+    sched_stats.steals++;
+    return task;
+}
+
+/**
+ * Pick the highest priority task to run on this CPU.
  */
 struct task_struct *rr_pick_next_task(void) {
+    struct rr_rq *rq = cpu_rr_rq(this_cpu()->id);
     struct task_struct *task;
-    task = rr_queue_pop(&run_queue);
+    task = rr_queue_pop(rq->run_queue);
     if(!task) {
         /* Swap run and just_ran queues */
-        exchange_queues();
+        exchange_queues(rq);
+        if(rq->run_queue->tasks)
+            sched_stats.rr_exchanges++;
         /* Try again */
-        task = rr_queue_pop(&run_queue);
+        task = rr_queue_pop(rq->run_queue);
     }
 
+    /* Nothing queued here, balance by taking work from another CPU */
+    if(!task && smp_num_cpus > 1)
+        task = rr_steal(this_cpu()->id);
+
     /* If no other tasks, but the current is still runnable, then run it! */
-    if(!task && curr_task->state == TASK_RUNNABLE) {
-        reset_timeslice(curr_task);
+    if(!task && curr_task->state == TASK_RUNNABLE && !rt_task(curr_task))
         task = curr_task;
-    }
 
     if(!task) {
         /* Return idle task if no task */
-        task = &kernel_task;
+        task = idle_task;
     }
+    /* Refill the timeslice */
+    reset_timeslice(task);
     return task;
 }
 
+struct sched_class rr_sched_class = {
+        .name = "rr",
+        .pick_next = rr_pick_next_task,
+        .enqueue = rr_enqueue,
+        .dequeue = rr_dequeue,
+        .tick = rr_tick,
+        .fork = rr_fork,
+};
+
 
 void debug_queues(void) {
     int i = 1;
     struct task_struct *task;
+    struct rr_rq *rq = cpu_rr_rq(this_cpu()->id);
+    debug("cpu %d, %lu steals\n", this_cpu()->id, sched_stats.steals);
     debug("run_queue:\n");
-    for(task = run_queue.tasks; task != NULL; task = task->next_rq) {
+    for(task = rq->run_queue->tasks; task != NULL; task = task->next_rq) {
         debug("#%d: %s\n", i, task->cmdline);
         i++;
     }
     i = 1;
     debug("just_ran_queue:\n");
-    for(task = just_ran_queue.tasks; task != NULL; task = task->next_rq) {
+    for(task = rq->just_ran_queue->tasks; task != NULL; task = task->next_rq) {
         debug("#%d: %s\n", i, task->cmdline);
         i++;
     }
     i = 1;
-    debug("block_queue:\n");
-    for(task = block_queue.tasks; task != NULL; task = task->next_rq) {
-        debug("#%d: %s\n", i, task->cmdline);
+    debug("blocked:\n");
+    for(task = kernel_task.next_task; task != &kernel_task; task = task->next_task) {
+        if(task->state != TASK_BLOCKED)
+            continue;
+        debug("#%d: %s on %p\n", i, task->cmdline, task->blocked_on);
         i++;
     }
 }
@@ -3,12 +3,12 @@
 
 #include <sbunix/sched.h>
 
-extern struct queue just_ran_queue;
+extern struct sched_class rr_sched_class;
 
 void rr_queue_add(struct queue *queue, struct task_struct *task);
+void rr_queue_add_head(struct queue *queue, struct task_struct *task);
 struct task_struct *rr_queue_pop(struct queue *queue);
 void rr_queue_remove(struct queue *queue, struct task_struct *task);
-void exchange_queues(void);
 struct task_struct *rr_pick_next_task(void);
 
 void debug_queues(void);
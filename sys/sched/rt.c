@@ -0,0 +1,203 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/smp.h>
+#include <sbunix/interrupt/pit.h>
+#include <sched.h> /* SCHED_* */
+#include "roundrobin.h"
+
+/*
+ * Real-time tasks, SCHED_FIFO and SCHED_RR.
+ * schedule() asks this class first, so a runnable real-time task always
+ * runs before the tasks of the system's sched_class. There is one round
+ * robin queue per static priority, shared by all CPUs under the kernel
+ * lock, and a bitmap of the non-empty ones. The highest priority runs
+ * first; SCHED_FIFO runs until it blocks or yields, SCHED_RR gets
+ * RT_RR_SLICE ticks before the next task of its priority.
+ *
+ * A task waking at a higher priority than some CPU's current task makes
+ * that CPU reschedule right away, not on its next tick.
+ *
+ * Each CPU lets real-time tasks run for at most RT_RUNTIME_TICKS of every
+ * RT_PERIOD_TICKS, the rest is left to the other tasks so that a runaway
+ * real-time task can not starve init or the shell.
+ */
+
+#define RT_NR_PRIO        (SCHED_RT_PRIO_MAX + 1)
+#define RT_RR_SLICE       100       /* ticks */
+#define RT_FIFO_SLICE     1         /* never counted down, only yield zeroes it */
+#define RT_PERIOD_TICKS   1000      /* 1 second at 1000 HZ */
+#define RT_RUNTIME_TICKS  950       /* 95% of each period */
+
+struct rt_cpu {
+    uint64_t period_start;  /* jiffies */
+    int runtime;            /* ticks of real-time tasks in this period */
+    int throttled;          /* used up runtime, until the period ends */
+};
+
+static struct queue rt_queues[RT_NR_PRIO];
+static uint64_t rt_bitmap[2]; /* bit set if rt_queues[bit] is not empty */
+static int rt_nr_queued = 0;
+static struct rt_cpu rt_cpus[MAX_CPUS];
+
+static inline int rt_timeslice(struct task_struct *task) {
+    return task->policy == SCHED_RR? RT_RR_SLICE : RT_FIFO_SLICE;
+}
+
+/**
+ * Return the highest priority with a queued task, or -1 if none.
+ */
+static int rt_highest_prio(void) {
+    if(rt_bitmap[1])
+        return 64 + 63 - __builtin_clzl(rt_bitmap[1]);
+    if(rt_bitmap[0])
+        return 63 - __builtin_clzl(rt_bitmap[0]);
+    return -1;
+}
+
+/**
+ * Return a CPU's throttle state, starting a new period if the last one
+ * is over.
+ */
+static struct rt_cpu *rt_cpu_get(int cpu) {
+    struct rt_cpu *rc = &rt_cpus[cpu];
+
+    if(jiffies - rc->period_start >= RT_PERIOD_TICKS) {
+        rc->period_start = jiffies;
+        rc->runtime = 0;
+        rc->throttled = 0;
+    }
+    return rc;
+}
+
+/**
+ * Priority of the task a CPU runs, for choosing which CPU a waking task
+ * preempts: -1 for idle, 0 for a task of the system's class.
+ */
+static int rt_cpu_prio(struct cpu *cpu) {
+    if(cpu->curr == cpu->idle)
+        return -1;
+    return rt_task(cpu->curr)? cpu->curr->rt_priority : 0;
+}
+
+/**
+ * Make the CPU running the lowest priority task reschedule, if task has a
+ * higher priority than that and the CPU may still run real-time tasks.
+ */
+static void rt_check_preempt(struct task_struct *task) {
+    struct cpu *cpu, *lowest = NULL;
+    int i, prio, lowest_prio = task->rt_priority;
+
+    for(i = 0; i < smp_num_cpus; i++) {
+        cpu = &cpus[i];
+        if(!cpu->online || rt_cpu_get(i)->throttled)
+            continue;
+        prio = rt_cpu_prio(cpu);
+        if(prio < lowest_prio) {
+            lowest_prio = prio;
+            lowest = cpu;
+        }
+    }
+    if(lowest)
+        smp_resched_cpu(lowest);
+}
+
+/**
+ * Queue a runnable task at its priority. A task preempted with slice left
+ * goes back to the head so it keeps its place among its priority, one that
+ * wakes, yielded, or is new goes to the tail.
+ */
+static void rt_enqueue(struct task_struct *task, int flags) {
+    struct queue *queue = &rt_queues[task->rt_priority];
+
+    if(!(flags & ENQUEUE_WAKEUP) && task->timeslice > 0)
+        rr_queue_add_head(queue, task);
+    else
+        rr_queue_add(queue, task);
+    rt_bitmap[task->rt_priority / 64] |= 1UL << (task->rt_priority % 64);
+    rt_nr_queued++;
+
+    if(flags & ENQUEUE_WAKEUP)
+        rt_check_preempt(task);
+}
+
+static void rt_dequeue(struct task_struct *task) {
+    struct queue *queue = task->rq;
+
+    rr_queue_remove(queue, task);
+    if(!queue->num_tasks)
+        rt_bitmap[task->rt_priority / 64] &= ~(1UL << (task->rt_priority % 64));
+    rt_nr_queued--;
+}
+
+/**
+ * Pick the highest priority real-time task for this CPU.
+ * @return: the task, or NULL if none is runnable or this CPU is throttled
+ */
+static struct task_struct *rt_pick_next(void) {
+    struct task_struct *curr = curr_task, *task;
+    int prio;
+
+    if(rt_cpu_get(this_cpu()->id)->throttled)
+        return NULL;
+
+    prio = rt_highest_prio();
+    /* Keep running the current task unless it yielded, used its slice, or
+     * a higher priority one is queued */
+    if(rt_task(curr) && curr->state == TASK_RUNNABLE &&
+            (curr->rt_priority > prio ||
+             (curr->rt_priority == prio && curr->timeslice > 0))) {
+        if(curr->timeslice <= 0)
+            curr->timeslice = rt_timeslice(curr);
+        return curr;
+    }
+    if(prio < 0)
+        return NULL;
+
+    task = rt_queues[prio].tasks;
+    rt_dequeue(task);
+    if(task->timeslice <= 0)
+        task->timeslice = rt_timeslice(task);
+    return task;
+}
+
+/**
+ * Charge the tick to this CPU's real-time runtime and to a SCHED_RR
+ * task's slice.
+ */
+static int rt_tick(struct task_struct *curr) {
+    struct rt_cpu *rc = rt_cpu_get(this_cpu()->id);
+
+    if(++rc->runtime >= RT_RUNTIME_TICKS) {
+        rc->throttled = 1;
+        return 1;
+    }
+    if(curr->policy == SCHED_RR)
+        return --curr->timeslice <= 0;
+    return 0;
+}
+
+/**
+ * The child keeps the parent's policy and queues behind it.
+ */
+static void rt_fork(struct task_struct *parent, struct task_struct *child) {
+    child->timeslice = 0;
+}
+
+/**
+ * Called on a tick of a task of the system's class: reschedule if
+ * real-time tasks are waiting and this CPU may run them again.
+ */
+int rt_tick_preempt(struct task_struct *curr) {
+    if(rt_task(curr) || !rt_nr_queued)
+        return 0;
+    return !rt_cpu_get(this_cpu()->id)->throttled;
+}
+
+struct sched_class rt_sched_class = {
+        .name = "rt",
+        .pick_next = rt_pick_next,
+        .enqueue = rt_enqueue,
+        .dequeue = rt_dequeue,
+        .tick = rt_tick,
+        .fork = rt_fork,
+};
@@ -1,15 +1,23 @@
 #include <sbunix/sbunix.h>
 #include <sbunix/sched.h>
+#include <sbunix/preempt.h>
+#include <sbunix/fpu.h>
+#include <sbunix/cputime.h>
+#include <sbunix/schedstat.h>
 #include <sbunix/mm/vmm.h>
 #include <sbunix/mm/pt.h>
 #include <sbunix/mm/align.h>
 #include <sbunix/string.h>
 #include <sbunix/gdt.h>
+#include <sbunix/smp.h>
 #include <sbunix/interrupt/pit.h>
 #include <sbunix/fs/terminal.h>
+#include <sys/schedclass.h>
 #include <errno.h>
+#include <sched.h> /* CLONE_* */
 #include "roundrobin.h"
-#include "../syscall/syscall_dispatch.h"
+#include "mlfq.h"
+#include "cfs.h"
 
 /* All kernel tasks use this mm_struct */
 struct mm_struct kernel_mm = {0};
@@ -17,79 +25,88 @@ struct mm_struct kernel_mm = {0};
 struct task_struct kernel_task = {
         .type = TASK_KERN,
         .state = TASK_RUNNABLE,
-        .first_switch = 0,
         .foreground = 1, /* can read from the terminal */
         .in_syscall = 0,
+        .preempt_count = PREEMPT_KERNEL,
         .timeslice = 0,  /* does not have timeslice */
-        .sleepts = {0, 0},
+        .sleep_until = 0,
         .pid = 0,
         .exit_code = 0,
         .blocked_on = NULL,
+        .wait_exclusive = 0,
+        .child_exit = { { 0, NULL, NULL } },
+        .zombies = { 0, NULL, NULL },
         .kernel_rsp = 0, /* Will be set on first call to schedule */
         .mm = &kernel_mm,
         .next_task = &kernel_task,
         .prev_task = &kernel_task,
         .next_rq = NULL,
+        .prev_rq = NULL,
+        .rq = NULL,
         .parent = NULL,
         .chld = NULL,
         .sib = NULL,
-        .files = {0},
+        .prev_sib = NULL,
+        .files = NULL,
         .cmdline = "kmain",
         .cwd = "/",
 };
-/* The currently running task */
-struct task_struct *curr_task = &kernel_task;
-/* The last (previous) task to run, may need to be reaped */
-static struct task_struct *last_task = NULL;
-
-/* Holds a singly linked list of tasks in the state TASK_RUNNABLE.
- * When depleted it grabs the list from the just_ran_queue. */
-struct queue run_queue = {
-        .num_switches = 0,
-        .tasks = NULL,
-};
-
-/* Holds a singly linked list of tasks in the state TASK_RUNNABLE */
-struct queue just_ran_queue = {
-        .num_switches = 0,
-        .tasks = NULL,
-
-};
-
-/* Hold's tasks in the state TASK_BLOCKED, blocked on terminals or pipes */
-struct queue block_queue = {
-        .num_switches = 0,
-        .tasks = NULL,
-};
-
-/* Hold's tasks in the state TASK_SLEEPING, from call to nanosleep(2) */
-struct queue sleep_queue = {
-        .num_switches = 0,
-        .tasks = NULL,
-};
-
-/* Hold's tasks in the state TASK_WAITING, from call to waitpid(2) */
-struct queue wait_queue = {
-        .num_switches = 0,
-        .tasks = NULL,
+/* Scheduler class used from boot, build with -DSCHED_CLASS_DEFAULT=...
+ * to change it (see the Makefile). */
+#ifndef SCHED_CLASS_DEFAULT
+#define SCHED_CLASS_DEFAULT SCHED_CLASS_RR
+#endif
+
+/* Indexed by SCHED_CLASS_* from <sys/schedclass.h> */
+static struct sched_class *sched_classes[SCHED_CLASS_NUM] = {
+        [SCHED_CLASS_RR]   = &rr_sched_class,
+        [SCHED_CLASS_MLFQ] = &mlfq_sched_class,
+        [SCHED_CLASS_CFS]  = &cfs_sched_class,
 };
+static int sched_class_id = SCHED_CLASS_DEFAULT;
+/* The active scheduler class, decides which runnable task runs next.
+ * Set in scheduler_init(). */
+struct sched_class *sched_class = NULL;
+/* System wide scheduler statistics, see <sbunix/schedstat.h> */
+struct schedstat sched_stats;
+/* The task that last took control of the terminal, see foreground_task() */
+static struct task_struct *fg_task = NULL;
 
 /* Private functions */
 static void task_list_add(struct task_struct *task);
 static void task_add_new(struct task_struct *task);
 static void add_child(struct task_struct *parent, struct task_struct *chld);
+static struct files_struct *files_alloc(void);
+static struct files_struct *files_copy(struct files_struct *old);
+static void files_release(struct files_struct *files);
 
 
 void scheduler_init(void) {
     /* set the kernel's page table to the initial pagetable */
     kernel_mm.pml4 = kernel_pt;
     kernel_mm.mm_count++; /* plus 1 for the kernel itself? */
+
+    sched_class = sched_classes[sched_class_id];
+    printk("Scheduler class: %s\n", sched_class->name);
 }
 
 void scheduler_start(void) {
     /* currently no use */
 }
 
+/**
+ * Make the first switch_to() to task run start(), on the kernel stack
+ * at sp, once post_context_switch() is done. start() gets no arguments.
+ */
+void task_set_start(struct task_struct *task, uint64_t sp, void (*start)(void)) {
+    struct switch_frame *frame = (struct switch_frame *)sp - 1;
+
+    memset(frame, 0, sizeof(*frame));
+    frame->rbx = (uint64_t)start;
+    frame->rip = (uint64_t)switch_first;
+    task->kernel_rsp = (uint64_t)frame;
+}
+
 /**
  * Create a kernel task. It's state will be TASK_RUNNABLE and
  * the type will be TASK_KERN.
@@ -111,14 +128,21 @@ struct task_struct *ktask_create(void (*start)(void), const char *name) {
 
     task->type = TASK_KERN;
     task->state = TASK_RUNNABLE;
-    /* Put the start function on the stack for switch_to  */
-    task->first_switch = 1;
+    task->lock_depth = 1; /* starts inside schedule(), holding the lock */
+    task->preempt_count = PREEMPT_KERNEL;
+    task->cpu = this_cpu()->id;
     task->foreground = 1; /* all kernel threads can read input */
-    stack[510] = (uint64_t)start;
-    task->kernel_rsp = (uint64_t)&stack[510];
+    if(!fg_task)
+        fg_task = task;
+    /* start() is entered like a call, but has nowhere to return to */
+    stack[511] = 0;
+    task_set_start(task, (uint64_t)&stack[511], start);
+    task->kstack_top = (uint64_t)&stack[510];
     task->mm = &kernel_mm;
     kernel_mm.mm_count++;
-    task->pid = get_next_pid();
+    task->pid = alloc_pid();
+    if(task->pid < 0)
+        goto out_task;
     task_set_cmdline(task, name);
     strcpy(task->cwd, "/"); /* set cwd to root for ktasks */
     task->timeslice = TIMESLICE_BASE;
@@ -126,18 +150,47 @@ struct task_struct *ktask_create(void (*start)(void), const char *name) {
     task_add_new(task); /* add to run queue and task list */
     return task;
 
+out_task:
+    kfree(task);
 out_stack:
     free_page((uint64_t)stack);
     return NULL;
 }
 
+/**
+ * Create the idle task of a secondary CPU. It runs on the stack the CPU
+ * boots on and is never on the list of all tasks or on a queue.
+ * @stack: the page the CPU boots on
+ */
+struct task_struct *idle_task_create(int cpu_id, uint64_t *stack) {
+    struct task_struct *task;
+
+    task = kmalloc(sizeof(*task));
+    if(!task)
+        return NULL;
+
+    memset(task, 0, sizeof(*task));
+    task->type = TASK_KERN;
+    task->state = TASK_RUNNABLE;
+    task->cpu = cpu_id;
+    task->preempt_count = PREEMPT_KERNEL;
+    task->kernel_rsp = (uint64_t)&stack[510];
+    task->kstack_top = (uint64_t)&stack[510];
+    task->mm = &kernel_mm;
+    kernel_mm.mm_count++;
+    task_set_cmdline(task, "[idle]");
+    strcpy(task->cwd, "/");
+    return task;
+}
+
 /**
  * Return a copy of the current task.
+ * @clone_flags: 0 for fork, or CLONE_VM and CLONE_FILES to share the
+ *               memory and the open files with the current task
  */
-struct task_struct *fork_curr_task(void) {
+struct task_struct *fork_curr_task(int clone_flags) {
     struct task_struct *task;
-    uint64_t *kstack, *curr_kstack;
-    int i;
+    uint64_t *kstack, *curr_kstack, flags;
 
     kstack = (uint64_t *)get_free_page(0);
     if(!kstack)
@@ -147,43 +200,78 @@ struct task_struct *fork_curr_task(void) {
     if(!task)
         goto out_stack;
 
-    /* Half the remaining timeslice (split between parent and child) */
-    curr_task->timeslice >>= 1;
-
     memcpy(task, curr_task, sizeof(*task));     /* Exact copy of parent */
-
-    /* deep copy the current mm */
-    task->mm = mm_deep_copy();
-    if(task->mm == NULL)
+    task->pid = alloc_pid();                    /* new pid */
+    if(task->pid < 0)
         goto out_task;
+    flags = local_irq_save();
+    task_sched_class(curr_task)->fork(curr_task, task); /* e.g. split the timeslice */
+    task->quota_used = 0;                       /* same limit, own budget */
+    task->quota_start = jiffies;
+    local_irq_restore(flags);
+
+    if(clone_flags & CLONE_VM) {
+        task->mm->mm_count++;   /* a thread, same address space */
+    } else {
+        /* deep copy the current mm */
+        task->mm = mm_deep_copy();
+        if(task->mm == NULL)
+            goto out_pid;
+    }
+
+    if(clone_flags & CLONE_FILES) {
+        task->files->count++;
+    } else {
+        /* Increment reference counts on any open files */
+        task->files = files_copy(curr_task->files);
+        if(!task->files)
+            goto out_mm;
+    }
+
+    if(fpu_fork(curr_task, task))
+        goto out_files;
 
     /* Copy the curr_task's kstack */
     curr_kstack = (uint64_t *)ALIGN_DOWN(read_rsp(), PAGE_SIZE);
     memcpy(kstack, curr_kstack, PAGE_SIZE);
     task->kernel_rsp = (uint64_t)&kstack[510];  /* new kernel stack */
-    task->pid = get_next_pid();                 /* new pid */
+    task->kstack_top = (uint64_t)&kstack[510];
     task->parent = curr_task;                   /* new parent */
-    task->chld = task->sib = NULL;              /* no children/siblings yet */
-    task->next_task = task->prev_task = task->next_rq = NULL;
-
-    /* Increment reference counts on any open files */
-    for(i = 0; i < TASK_FILES_MAX; i++) {
-        struct file *fp = task->files[i];
-        if(fp) {
-            fp->f_count++;
-        }
-    }
+    task->chld = task->sib = task->prev_sib = NULL; /* no children/siblings yet */
+    wait_queue_init(&task->child_exit);
+    memset(&task->zombies, 0, sizeof(task->zombies));
+    task->next_task = task->prev_task = task->next_rq = task->prev_rq = NULL;
+    task->rq = NULL;
+    task->on_cpu = 0;
+    task->killed = 0;
+    memset(&task->acct, 0, sizeof(task->acct));
+    memset(&task->cacct, 0, sizeof(task->cacct));
+    memset(&task->sched_info, 0, sizeof(task->sched_info));
+    /* The child starts on its way back to user mode, child_ret_from_fork */
+    task->in_syscall = 0;
+    task->preempt_count = 0;
+    task->need_resched = 0;
 
     /* Add this new child to the parent */
     add_child(curr_task, task);
 
-    /* TODO: Here we steal our parent's foreground status */
-    if(curr_task->pid > 2)
-        curr_task->foreground = 0;/* change to 1; to let all tasks read */
+    /* TODO: Here we steal our parent's foreground status, threads share it */
+    if(!(clone_flags & CLONE_VM)) {
+        if(curr_task->pid > 2)
+            curr_task->foreground = 0;/* change to 1; to let all tasks read */
+        if(task->foreground)
+            fg_task = task;
+    }
 
     task_add_new(task); /* add to run queue and task list */
 
     return task;
+out_files:
+    files_release(task->files);
+out_mm:
+    mm_destroy(task->mm);
+out_pid:
+    free_pid(task->pid);
 out_task:
     kfree(task);
 out_stack:
@@ -194,85 +282,106 @@ out_stack:
 /**
  * Free the task's kernel stack, memory context, and close open files.
  * NOTE: Only called when removed from its queue.
- * Leaves the task on in the list of all tasks (only remove when a
- * parent calls cleanup_child).
+ * Leaves the task on in the list of all tasks and in the PID hash, and
+ * puts it on its parent's zombies (only remove when the parent calls
+ * cleanup_child).
  */
 void task_destroy(struct task_struct *task) {
-    int i;
-    mm_destroy(task->mm);
+    struct task_struct *child, *next;
+    mm_destroy_async(task->mm);
+    fpu_release(task);
 
     free_page(ALIGN_DOWN(task->kernel_rsp, PAGE_SIZE));
 
-    /* Close any open files */
-    for(i = 0; i < TASK_FILES_MAX; i++) {
-        struct file *fp = task->files[i];
-        if(fp) {
-            fp->f_op->close(fp);
-            task->files[i] = NULL;
-        }
-    }
+    /* Close any open files, unless our threads still use them */
+    files_release(task->files);
+    task->files = NULL;
 
     /* Give terminal control back to the parent */
     if(task->foreground && task->parent) {
         task->parent->foreground = 1;
+        if(fg_task == task)
+            fg_task = task->parent;
     }
     task->foreground = 0; /* remove the foreground from the dead task */
+    if(fg_task == task)
+        fg_task = NULL;
 
-    /* If we have children give them to init */
-    if(task->chld) {
-        /* Give all children to init */
-        struct task_struct *prevchld, *nextchld;
-        for(prevchld = task->chld; prevchld != NULL; prevchld = nextchld) {
-            nextchld = prevchld->sib;
-            add_child(init_task, prevchld);
-        }
+    /* Give all children to init, and the zombies among them too */
+    for(child = task->chld; child != NULL; child = next) {
+        next = child->sib;
+        add_child(init_task, child);
+    }
+    task->chld = NULL;
+    if(task->zombies.tasks) {
+        while((child = rr_queue_pop(&task->zombies)) != NULL)
+            rr_queue_add(&init_task->zombies, child);
+        wake_up_all(&init_task->child_exit);
     }
 
-    if(task->parent) {
-        /* Notify parent of child's termination */
-        if(task->parent->state == TASK_WAITING) {
-            task_wakeup(&wait_queue, task->parent);
-        }
-    } else {
-        /* We have no parent so add ourself to init */
+    /* We have no parent so add ourself to init */
+    if(!task->parent)
         add_child(init_task, task);
-    }
+    /* Notify parent of child's termination */
+    rr_queue_add(&task->parent->zombies, task);
+    wake_up_all(&task->parent->child_exit);
 }
 
 /**
- * Do the final cleanup of a task struct.
+ * Do the final cleanup of a zombie, freeing its task struct and PID.
  * @return: the exit code of the task
  */
 int cleanup_child(struct task_struct *task) {
+    uint64_t flags;
     int rv;
     if(!task)
         kpanic("Waiting on NULL task\n");
 
-    /* Remove the child from list of all tasks. */
+    /* Remove the child from list of all tasks */
+    flags = local_irq_save();
     if(task->next_task)
         task->next_task->prev_task = task->prev_task;
     if(task->prev_task)
         task->prev_task->next_task = task->next_task;
+    local_irq_restore(flags);
 
     if(!task->parent)
         kpanic("Reaping a child that has no parent!\n");
+    if(task->rq != &task->parent->zombies)
+        kpanic("Reaping %d which is not a zombie!\n", task->pid);
+    rr_queue_remove(&task->parent->zombies, task);
 
     /* Remove task from list of children in parent*/
-    if(task->parent->chld == task) {
-        /* task was first child */
-        task->parent->chld = task->sib;
-    } else {
-        struct task_struct *prev = task->parent->chld;
-        for(; prev->sib != task; prev = prev->sib) {
-        }
-        prev->sib = task->sib; /* remove task */
-    }
+    if(task->prev_sib)
+        task->prev_sib->sib = task->sib;
+    else
+        task->parent->chld = task->sib; /* task was first child */
+    if(task->sib)
+        task->sib->prev_sib = task->prev_sib;
+
+    pid_hash_remove(task);
+    free_pid(task->pid);
 
     rv = task->exit_code;
     kfree(task);
     return rv;
 }
 
+/**
+ * Set the user FS base of task, loading it now if task is running here.
+ * The FS base can only change through here (CR4.FSGSBASE is off), so
+ * task->fs_base is always current and context_switch() only loads it.
+ */
+void task_set_fs_base(struct task_struct *task, uint64_t base) {
+    struct cpu *cpu = this_cpu();
+
+    task->fs_base = base;
+    if(task == cpu->curr && cpu->fs_base != base) {
+        wrmsr(MSR_FS_BASE, base);
+        cpu->fs_base = base;
+    }
+}
+
 /**
  * Set the task cmdline to the string cmdline
  */
@@ -303,34 +412,32 @@ void task_list_add(struct task_struct *task) {
 void queue_add_by_state(struct task_struct *task) {
 //    debug("Adding task: %s\n", task->cmdline);
     if(task->state == TASK_RUNNABLE) {
-        rr_queue_add(&just_ran_queue, task);
-    } else if(task->state == TASK_BLOCKED) {
-        rr_queue_add(&block_queue, task);
+        schedstat_enqueue(task, 0);
+        task_sched_class(task)->enqueue(task, 0);
     } else if(task->state == TASK_SLEEPING) {
-        rr_queue_add(&sleep_queue, task);
-    } else if(task->state == TASK_WAITING) {
-        rr_queue_add(&wait_queue, task);
+        sleep_add(task);
+    } else if(task->state & (TASK_BLOCKED | TASK_WAITING)) {
+        if(!task->blocked_on)
+            kpanic("Task %s is waiting on nothing\n", task->cmdline);
+        rr_queue_add(&task->blocked_on->waiters, task);
     } else {
         kpanic("Don't know which queue to put task into: state=%d\n", task->state);
     }
 }
 
 /**
- * Remove task from the queue it resides in.
+ * Remove task from the queue it resides in, if any.
  */
 void queue_remove_by_state(struct task_struct *task) {
-    if(task->state == TASK_RUNNABLE) {
-        /* Could be in either queue */
-        rr_queue_remove(&run_queue, task);
-        rr_queue_remove(&just_ran_queue, task);
-    } else if(task->state == TASK_BLOCKED) {
-        rr_queue_remove(&block_queue, task);
-    } else if(task->state == TASK_SLEEPING) {
-        rr_queue_remove(&sleep_queue, task);
-    } else if(task->state == TASK_WAITING) {
-        rr_queue_remove(&wait_queue, task);
-    } else {
+    if(task->state & (TASK_UNRUNNABLE | TASK_DEAD))
         kpanic("Don't know which queue to remvoe task from: state=%d\n", task->state);
+    if(task->state == TASK_RUNNABLE)
+        task_sched_class(task)->dequeue(task);
+    else if(task->state == TASK_SLEEPING)
+        sleep_remove(task);
+    else {
+        sleep_cancel_timeout(task);
+        rr_queue_remove(task->rq, task); /* the task knows its queue */
     }
 }
 
@@ -340,10 +447,14 @@ void queue_remove_by_state(struct task_struct *task) {
  * Adds it to the list of all tasks and to the appropriate queue.
  */
 void task_add_new(struct task_struct *task) {
+    uint64_t flags;
     if(!task)
         return;
+    flags = local_irq_save();
     task_list_add(task);
+    pid_hash_add(task);
     queue_add_by_state(task);
+    local_irq_restore(flags);
 }
 
 /**
@@ -351,31 +462,64 @@ void task_add_new(struct task_struct *task) {
  * This function NEVER returns.
  */
 void kill_curr_task(int exit_code) {
+    cli(); /* for schedule() */
     curr_task->exit_code = exit_code;
     curr_task->state = TASK_DEAD;
     schedule();
 }
 
+/**
+ * True if task can not be destroyed right away and has to kill itself.
+ * It is running on another CPU or was preempted in the middle of a
+ * syscall, or we are an interrupt that came in the middle of one: the
+ * kernel may be using what task_destroy() frees.
+ */
+static int kill_must_defer(struct task_struct *task) {
+    if(in_interrupt() && curr_task->in_syscall)
+        return 1;
+    if(task == curr_task)
+        return 0;
+    return task->on_cpu || (task->state == TASK_RUNNABLE && task->in_syscall);
+}
+
 /**
  * Kill a task (possibly the current task) with exit code.
  */
 void kill_other_task(struct task_struct *task, int exit_code) {
+    uint64_t flags;
+
     /* If already dead do nothing */
     if(!task || task->state == TASK_DEAD)
         return;
 
+    if(task->type == TASK_KERN && curr_task->type != TASK_KERN) {
+        return; /* users can't kill kernel tasks */
+    }
+
+    /* It kills itself on its next tick or syscall return, when it is
+     * next switched out, or when it wakes up in wait_on() */
+    if(kill_must_defer(task)) {
+        task->exit_code = exit_code;
+        task->killed = 1;
+        flags = local_irq_save();
+        if(task->state & (TASK_BLOCKED | TASK_WAITING | TASK_SLEEPING)) {
+            queue_remove_by_state(task);
+            task_wakeup(NULL, task);
+        }
+        local_irq_restore(flags);
+        return;
+    }
+
     /* Let's you kill the current task too */
     if(task == curr_task) {
         kill_curr_task(exit_code);
         return; /* Doesn't return! */
     }
 
-    if(task->type == TASK_KERN && curr_task->type != TASK_KERN) {
-        return; /* users can't kill kernel tasks */
-    }
-
     /* Remove from it's queue */
+    flags = local_irq_save();
     queue_remove_by_state(task);
+    local_irq_restore(flags);
 
     /* Proceed with the kill */
     task->state = TASK_DEAD;
@@ -396,72 +540,28 @@ void send_signal(struct task_struct *task, int sig) {
 }
 
 /**
- * Returns the current task that controls the terminal
+ * Returns the task that last took control of the terminal: the newest
+ * child forked by the foreground, or its parent again once it exits.
  */
 struct task_struct *foreground_task(void) {
-    struct task_struct *task;
-    /* For all tasks on the system */
-    for(task = kernel_task.next_task; task != &kernel_task;
-        task = task->next_task) {
-        if(task->foreground)
-            return task;
-    }
-    debug("NO task is in the foreground!\n");
-    return NULL;
+    if(!fg_task)
+        debug("NO task is in the foreground!\n");
+    return fg_task;
 }
 
 /**
- * Block the current task, this is called inside a system call so interrupts
- * are disabled
- */
-void task_block(void *block_on) {
-    curr_task->state = TASK_BLOCKED;
-    curr_task->blocked_on = block_on;
-    schedule();
-}
-
-/**
- * Remove the task from the from queue and add it to the run queue.
+ * Remove the task from the from queue and hand it to the scheduler class.
+ * Called with interrupts disabled.
  */
 void task_wakeup(struct queue *from_queue, struct task_struct *task) {
     task->state = TASK_RUNNABLE;
     task->blocked_on = NULL;
+    sleep_cancel_timeout(task);
     rr_queue_remove(from_queue, task);
-    rr_queue_add(&run_queue, task); /* We want this to run on next schedule() */
-}
-
-/**
- * Unblock the first task blocking on blocked_on
- */
-void task_unblock(void *blocked_on) {
-    struct task_struct *task = block_queue.tasks;
-    if(!task)
-        return;
-
-    for(;task != NULL; task = task->next_rq) {
-        if(blocked_on == task->blocked_on) {
-            /* It is the foreground, AND blocking on blocked_on */
-            task_wakeup(&block_queue, task);
-            /* Wake up ALL, do not break here. Consider blocking on pipes... */
-        }
-    }
-}
-
-/**
- * Unblock the task which was waiting for the terminal.
- */
-void task_unblock_foreground(void *blocked_on) {
-    struct task_struct *task = block_queue.tasks;
-    if(!task)
-        return;
-
-    for(;task != NULL; task = task->next_rq) {
-        if(task->foreground && (blocked_on == task->blocked_on)) {
-            /* It is the foreground, AND blocking on blocked_on */
-            task_wakeup(&block_queue, task);
-            /* TODO: break; ???? */
-        }
-    }
+    schedstat_enqueue(task, 1);
+    task_sched_class(task)->enqueue(task, ENQUEUE_WAKEUP);
+    /* Its CPU may be halted in the idle loop */
+    smp_kick_cpu(&cpus[task->cpu]);
 }
 
 /**
@@ -472,32 +572,47 @@ void add_child(struct task_struct *parent, struct task_struct *chld) {
         return;
 
     /* Push new child onto the parent's list */
+    chld->prev_sib = NULL;
     chld->sib = parent->chld;
+    if(parent->chld)
+        parent->chld->prev_sib = chld;
     parent->chld = chld;
     chld->parent = parent;
 }
 
 /**
- * Return the next PID to use.
- * The list of all task is in sorted order, with the max being directly
- * behind the kernel task.
+ * Load next's page tables on this CPU, unless they already are.
+ *
+ * The CPU holds a reference to the user mm in its CR3 (cpu->active_mm),
+ * so that it is not freed while still loaded. That lets kernel threads
+ * and the idle task run on the page tables of the task before them, they
+ * never touch user memory. A user task that comes back after them then
+ * finds its TLB entries still there. smp_flush_tlb_mm() flushes every
+ * CPU that has the mm loaded, running it or not.
+ * @return: the mm whose reference the CPU gave up, or NULL. Drop it with
+ * mm_destroy_async() once it is safe to wake a kworker.
  */
-pid_t get_next_pid(void) {
-    int max_pid = kernel_task.prev_task->pid;
-    if(max_pid >= 2147483645)
-        kpanic("Ran out of PIDs, please reboot!");
-    return max_pid + 1;
+struct mm_struct *switch_mm(struct cpu *cpu, struct mm_struct *next) {
+    struct mm_struct *prev = cpu->active_mm;
+
+    if(prev == next)
+        return NULL;
+    write_cr3(next->pml4);
+    sched_stats.cr3_loads++;
+    cpu->active_mm = next;
+    if(next != &kernel_mm)
+        next->mm_count++;
+    return (prev && prev != &kernel_mm)? prev : NULL;
 }
 
 /**
- * Switch to the new mm_struct.
- * @prev: mm_struct of the previously running (current) task
- * @next: mm_struct to switch to
+ * True if task, just switched out, is to be destroyed. Unless preempted
+ * in a syscall a killed task dies when it is switched out, otherwise
+ * when the syscall returns.
  */
-void switch_mm(struct mm_struct *prev, struct mm_struct *next) {
-    if(prev != next) {
-        write_cr3(next->pml4);
-    }
+static inline int task_dies_on_switch(struct task_struct *task) {
+    return task->state == TASK_DEAD || (task->killed &&
+            !(task->state == TASK_RUNNABLE && task->in_syscall));
 }
 
 /**
@@ -506,11 +621,19 @@ void switch_mm(struct mm_struct *prev, struct mm_struct *next) {
  * @next: task to switch to
  */
 static inline void __attribute__((always_inline)) context_switch(struct task_struct *prev, struct task_struct *next) {
-    struct mm_struct *mm, *prev_mm;
-    mm = next->mm;
-    prev_mm = prev->mm;
-
-    switch_mm(prev_mm, mm);
+    struct cpu *cpu = this_cpu();
+
+    /* Kernel threads keep the loaded mm, but not a dying one alive */
+    if(next->type == TASK_USER || !LAZY_TLB)
+        cpu->mm_drop = switch_mm(cpu, next->mm);
+    else if(prev->type == TASK_USER && task_dies_on_switch(prev))
+        cpu->mm_drop = switch_mm(cpu, &kernel_mm);
+    fpu_switch(prev, next);
+    /* Kernel tasks do not use FS, leave the last user's base loaded */
+    if(next->type == TASK_USER && this_cpu()->fs_base != next->fs_base) {
+        wrmsr(MSR_FS_BASE, next->fs_base);
+        this_cpu()->fs_base = next->fs_base;
+    }
 
     switch_to(prev, next);
     /* next is now the current task */
@@ -519,61 +642,342 @@ static inline void __attribute__((always_inline)) context_switch(struct task_str
 /**
  * Update the TSS with the new kernel stack.
  * Cleanup the last task, destroying or placing on a queue as needed.
+ * Also called by switch_first, the first time a task runs.
  */
-static void __attribute__((noinline)) post_context_switch(void) {
-    /* Update the kernel stack in the tss (these are always aligned minus 16) */
-    tss.rsp0 = ALIGN_UP(curr_task->kernel_rsp, PAGE_SIZE) - 16;
-    syscall_kernel_rsp = tss.rsp0;
-    /* todo: ltr or ldtr to load the TSS again? */
+void post_context_switch(void) {
+    struct cpu *cpu = this_cpu();
+    struct task_struct *last_task = cpu->last;
+
+    /* Start charging time to the new task */
+    curr_task->acct_stamp = read_tsc();
+    schedstat_switch_in(curr_task, curr_task->acct_stamp);
 
-    /* Clean up the previous task */
+    /* Kernel threads never leave ring 0, exec loads it if they become users */
+    if(curr_task->type == TASK_USER)
+        load_kernel_stack(cpu, curr_task);
+
+    /* Clean up the previous task, its stack is no longer in use so
+     * another CPU may pick it from now on */
 //    debug("Switched from %s --> %s\n", last_task->cmdline, curr_task->cmdline);
+    last_task->on_cpu = 0;
     /* Do not destroy or add the Idle Task to the run queues */
-    if(last_task != &kernel_task) {
+    if(last_task != cpu->idle) {
+        if(task_dies_on_switch(last_task))
+            last_task->state = TASK_DEAD;
         if (last_task->state == TASK_DEAD) {
             task_destroy(last_task);
         } else {
             queue_add_by_state(last_task);
         }
     }
+    if(cpu->mm_drop) {
+        mm_destroy_async(cpu->mm_drop);
+        cpu->mm_drop = NULL;
+    }
+}
 
-    /* Refill the timeslice */
-    reset_timeslice(curr_task);
+/**
+ * True if task has used up its CPU quota for the current period, see
+ * cpuquota(2). Starts a new period if the last one is over.
+ */
+static int quota_exceeded(struct task_struct *task) {
+    if(!task->quota)
+        return 0;
+    if(jiffies - task->quota_start >= task->quota_period) {
+        task->quota_start = jiffies;
+        task->quota_used = 0;
+    }
+    return task->quota_used >= task->quota;
+}
+
+/**
+ * Park prev until its next quota period, if it ran out of quota. Only
+ * from user mode (the tick or a syscall's return), so that it is not
+ * parked holding anything a syscall may be using. The sleep timeline
+ * wakes it up.
+ */
+static void quota_throttle(struct task_struct *prev) {
+    if(prev->state != TASK_RUNNABLE || prev->in_syscall ||
+            !quota_exceeded(prev))
+        return;
+    prev->state = TASK_SLEEPING;
+    prev->sleep_until = prev->quota_start + prev->quota_period;
+    sched_stats.quota_throttles++;
+}
+
+/**
+ * Set the CPU quota of task, and start a new period.
+ * @quota: ticks per period, 0 for no limit
+ * @period: ticks
+ */
+void task_set_quota(struct task_struct *task, uint32_t quota, uint32_t period) {
+    uint64_t flags = local_irq_save();
+
+    task->quota = quota;
+    task->quota_period = period;
+    task->quota_used = 0;
+    task->quota_start = jiffies;
+    local_irq_restore(flags);
+}
+
+/**
+ * Ask schedule() to switch straight to task if the current task blocks
+ * before anything else runs here, e.g. the reader the current task just
+ * woke by filling a pipe. Call with interrupts disabled, right before
+ * blocking.
+ */
+void sched_handoff(struct task_struct *task) {
+    if(SCHED_HANDOFF)
+        this_cpu()->handoff = task;
+}
+
+/**
+ * Take the task the blocking prev asked to hand off to, see
+ * sched_handoff(). It gets what is left of prev's timeslice, so two tasks
+ * bouncing the CPU between them still share one slice and can not starve
+ * the rest. Real-time tasks are always picked by priority instead.
+ * @return: the task, dequeued, or NULL to pick as usual
+ */
+static struct task_struct *sched_pick_handoff(struct cpu *cpu,
+                                              struct task_struct *prev) {
+    struct task_struct *task = cpu->handoff;
+
+    cpu->handoff = NULL;
+    if(!task || task == prev || prev->state == TASK_RUNNABLE ||
+            prev->timeslice <= 0 || rt_task(prev))
+        return NULL;
+    if(task->state != TASK_RUNNABLE || !task->rq || task->on_cpu ||
+            rt_task(task) || rt_tick_preempt(prev))
+        return NULL;
+    task_sched_class(task)->dequeue(task);
+    task->timeslice = prev->timeslice;
+    sched_stats.handoffs++;
+    return task;
 }
 
 /**
  * Switch out the current task for the next task to run.
  *
  * TODO: schedule MUST always be called with interrupts disabled
+ * and the kernel lock held, which passes from prev to next.
  */
 void schedule(void) {
+    struct cpu *cpu = this_cpu();
     struct task_struct *prev, *next;
 
     /* Assuming atomicity */
-    prev = curr_task;
-    next = rr_pick_next_task();
+    prev = cpu->curr;
+    prev->need_resched = 0;
+    if(prev->quota)
+        quota_throttle(prev);
+    next = sched_pick_handoff(cpu, prev);
+    /* Real-time tasks first, unless this CPU used up their share */
+    if(!next)
+        next = rt_sched_class.pick_next();
+    if(!next)
+        next = sched_class->pick_next();
 
     if(prev != next) {
-        run_queue.num_switches++;
-        curr_task = next;
-        last_task = prev; /* the last_task to run is the "prev" */
+        sched_stats.switches++;
+        account_system_time(prev);
+        if(prev != cpu->idle)
+            schedstat_switch_out(prev, prev->acct_stamp);
+        if(prev->state == TASK_RUNNABLE)
+            prev->acct.nivcsw++;
+        else
+            prev->acct.nvcsw++;
+        next->cpu = cpu->id;
+        next->on_cpu = 1;
+        cpu->curr = next;
+        cpu->last = prev; /* the last task to run is the "prev" */
 
         context_switch(prev, next);
-        /* WE CAN NOT REFER TO LOCALS AFTER the context_switch */
-
+        /* Back in the frame this task switched out from, possibly on
+         * another CPU: prev and next are stale, cpu->last is the real prev */
         post_context_switch();
+    }
+}
 
-        /* If this was the first switch then the current stack has no frame for
-         * schedule(), on retq we will return to the task's start function for
-         * the first time.
-         */
-        if(curr_task->first_switch) {
-            curr_task->first_switch = 0;
-            curr_task->kernel_rsp = ALIGN_UP(curr_task->kernel_rsp, PAGE_SIZE) - 16;
-            __asm__ __volatile__ ("retq;");
-        }
+/**
+ * Called on every timer interrupt. User tasks are preempted when the
+ * scheduler class asks for it, at the end of the interrupt or, if they
+ * are in a syscall, at the next preemption point.
+ */
+void sched_tick(void) {
+    struct task_struct *curr = curr_task;
+
+    if(curr == this_cpu()->idle)
+        return;
+    /* Kernel threads (kworkers) only switch at cond_resched() points */
+    if(!(curr->type & TASK_USER)) {
+        if(sched_class->tick(curr))
+            curr->need_resched = 1;
+        return;
+    }
+    /* Killed by another CPU while we were running in user mode, not in a
+     * syscall or a softirq */
+    if(curr_task->killed && curr_task->preempt_count == HARDIRQ_OFFSET)
+        kill_curr_task(curr_task->exit_code);
+    if(curr_task->quota)
+        curr_task->quota_used++;
+    if(task_sched_class(curr_task)->tick(curr_task) ||
+            rt_tick_preempt(curr_task) || quota_exceeded(curr_task))
+        curr_task->need_resched = 1;
+}
+
+/**
+ * Switch the whole system to another scheduler class, moving every queued
+ * runnable task over to it.
+ * @class_id: one of SCHED_CLASS_*, or negative to only query
+ * @return: the previous class id, or -EINVAL
+ */
+int sched_set_class(int class_id) {
+    struct sched_class *new;
+    struct task_struct *task;
+    int prev_id = sched_class_id;
+    uint64_t flags;
+
+    if(class_id < 0)
+        return prev_id;
+    if(class_id >= SCHED_CLASS_NUM)
+        return -EINVAL;
+
+    new = sched_classes[class_id];
+    if(new == sched_class)
+        return prev_id;
+
+    flags = local_irq_save();
+    for(task = kernel_task.next_task; task != &kernel_task;
+        task = task->next_task) {
+        /* The current task is not on a queue */
+        if(task->state != TASK_RUNNABLE || !task->rq || rt_task(task))
+            continue;
+        sched_class->dequeue(task);
+        new->enqueue(task, 0);
+    }
+    debug("Scheduler class %s --> %s\n", sched_class->name, new->name);
+    sched_class = new;
+    sched_class_id = class_id;
+    local_irq_restore(flags);
+    return prev_id;
+}
+
+/**
+ * Set the nice value of a task, clamped to [NICE_MIN, NICE_MAX].
+ * A queued task is requeued so the class sees its new weight.
+ */
+void task_set_nice(struct task_struct *task, int nice) {
+    uint64_t flags = local_irq_save();
+    int queued = task->state == TASK_RUNNABLE && task->rq;
+
+    nice = MAX(NICE_MIN, MIN(nice, NICE_MAX));
+    if(queued)
+        task_sched_class(task)->dequeue(task);
+    task->nice = nice;
+    if(queued)
+        task_sched_class(task)->enqueue(task, 0);
+    local_irq_restore(flags);
+}
+
+/**
+ * Change the policy and real-time priority of a task, moving it between
+ * rt_sched_class and the system's class.
+ * @policy: SCHED_OTHER, SCHED_FIFO or SCHED_RR
+ * @prio: SCHED_RT_PRIO_MIN to SCHED_RT_PRIO_MAX, 0 for SCHED_OTHER
+ * @return: 0 or -EINVAL
+ */
+int sched_setscheduler_task(struct task_struct *task, int policy, int prio) {
+    uint64_t flags;
+    int queued;
+
+    if(policy == SCHED_OTHER) {
+        if(prio != 0)
+            return -EINVAL;
+    } else if(policy == SCHED_FIFO || policy == SCHED_RR) {
+        if(prio < SCHED_RT_PRIO_MIN || prio > SCHED_RT_PRIO_MAX)
+            return -EINVAL;
+    } else {
+        return -EINVAL;
     }
 
+    flags = local_irq_save();
+    queued = task->state == TASK_RUNNABLE && task->rq;
+    if(queued)
+        task_sched_class(task)->dequeue(task);
+    task->policy = policy;
+    task->rt_priority = prio;
+    task->timeslice = 0; /* the new class gives it a fresh slice */
+    if(queued)
+        task_sched_class(task)->enqueue(task, 0);
+    /* Let the classes pick again, it may now run before or after others */
+    curr_task->need_resched = 1;
+    if(task->on_cpu)
+        smp_resched_cpu(&cpus[task->cpu]);
+    local_irq_restore(flags);
+    return 0;
+}
+
+/**
+ * Give up the CPU to another runnable task, a real-time task goes behind
+ * the others of its priority.
+ */
+void sched_yield_curr(void) {
+    uint64_t flags = local_irq_save();
+
+    if(rt_task(curr_task))
+        curr_task->timeslice = 0;
+    schedule();
+    local_irq_restore(flags);
+}
+
+/**
+ * Return a new, empty, open file table.
+ */
+static struct files_struct *files_alloc(void) {
+    struct files_struct *files;
+
+    files = kmalloc(sizeof(*files));
+    if(!files)
+        return NULL;
+    memset(files, 0, sizeof(*files));
+    files->count = 1;
+    return files;
+}
+
+/**
+ * Return a copy of the open file table old for a forked child, the child
+ * gets a reference to every open file.
+ */
+static struct files_struct *files_copy(struct files_struct *old) {
+    struct files_struct *files;
+    int i;
+
+    files = files_alloc();
+    if(!files || !old)
+        return files;
+    for(i = 0; i < TASK_FILES_MAX; i++) {
+        files->fd[i] = old->fd[i];
+        if(files->fd[i])
+            files->fd[i]->f_count++;
+    }
+    return files;
+}
+
+/**
+ * Drop a task's reference to its file table, closing the files when the
+ * last task using it is gone.
+ */
+static void files_release(struct files_struct *files) {
+    int i;
+
+    if(!files || --files->count > 0)
+        return;
+    for(i = 0; i < TASK_FILES_MAX; i++) {
+        struct file *fp = files->fd[i];
+        if(fp)
+            fp->f_op->close(fp);
+    }
+    kfree(files);
 }
 
 /**
@@ -583,15 +987,20 @@ int task_files_init(struct task_struct *task) {
     struct file *fp;
     if(!task)
         kpanic("task is NULL!\n");
-    if(task->files[0] || task->files[1] || task->files[2])
+    if(!task->files) {
+        task->files = files_alloc();
+        if(!task->files)
+            return -ENOMEM;
+    }
+    if(task->files->fd[0] || task->files->fd[1] || task->files->fd[2])
         kpanic("A file is open during init!!\n");
     fp = term_open();
     if(!fp)
         return -ENOMEM;
     fp->f_count += 2; /* we make 2 "copies" */
-    task->files[0] = fp;
-    task->files[1] = fp;
-    task->files[2] = fp;
+    task->files->fd[0] = fp;
+    task->files->fd[1] = fp;
+    task->files->fd[2] = fp;
     return 0;
 }
 
@@ -599,6 +1008,6 @@ int task_files_init(struct task_struct *task) {
  * Print some info from a task.
  */
 void debug_task(struct task_struct *task) {
-    debug("type=%d, state=%d, 1st_switch=%d, fg=%d, cmd=%s\n",
-          task->type, task->state, task->first_switch, task->foreground, task->cmdline);
+    debug("type=%d, state=%d, fg=%d, cmd=%s\n",
+          task->type, task->state, task->foreground, task->cmdline);
 }
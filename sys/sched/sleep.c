@@ -0,0 +1,125 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/rbtree.h>
+
+/*
+ * Tasks in the state TASK_SLEEPING, from calls to nanosleep(2).
+ * Sleepers are kept in a red-black tree keyed by their absolute deadline
+ * (in jiffies) and the earliest is cached, so a timer tick only looks at
+ * the sleepers that are due.
+ *
+ * Tasks blocked in wait_on_timeout() are on the timeline too, but stay on
+ * their wait queue (task->rq) and have task->timeout set to TIMEOUT_ARMED.
+ */
+
+static struct rb_root sleep_timeline = { NULL };
+/* The sleeper with the earliest deadline, NULL if none */
+static struct task_struct *sleep_first = NULL;
+/* Only marks membership (task->rq) and counts tasks, order is in the tree */
+static struct queue sleep_queue;
+
+/**
+ * Insert task on the timeline at task->sleep_until.
+ */
+static void timeline_insert(struct task_struct *task) {
+    struct rb_node **link = &sleep_timeline.rb_node, *parent = NULL;
+
+    while(*link) {
+        parent = *link;
+        /* Equal deadlines go right, so they wake in FIFO order */
+        if(task->sleep_until < rb_entry(parent, struct task_struct, sleep_node)->sleep_until)
+            link = &parent->rb_left;
+        else
+            link = &parent->rb_right;
+    }
+    rb_link_node(&task->sleep_node, parent, link);
+    rb_insert_color(&task->sleep_node, &sleep_timeline);
+
+    if(!sleep_first || task->sleep_until < sleep_first->sleep_until) {
+        sleep_first = task;
+        /* The BSP's timer wakes sleepers, it may be idle without a tick */
+        smp_kick_cpu(&cpus[0]);
+    }
+}
+
+static void timeline_erase(struct task_struct *task) {
+    struct rb_node *first;
+
+    rb_erase(&task->sleep_node, &sleep_timeline);
+    if(task == sleep_first) {
+        first = rb_first(&sleep_timeline);
+        sleep_first = first? rb_entry(first, struct task_struct, sleep_node) : NULL;
+    }
+}
+
+/**
+ * Add a sleeping task, task->sleep_until must be set.
+ */
+void sleep_add(struct task_struct *task) {
+    if(task->rq)
+        kpanic("Task %s is already on a queue\n", task->cmdline);
+
+    timeline_insert(task);
+    task->rq = &sleep_queue;
+    sleep_queue.num_tasks++;
+}
+
+/**
+ * Remove a sleeping task, no error if it is not sleeping.
+ */
+void sleep_remove(struct task_struct *task) {
+    if(task->rq != &sleep_queue)
+        return;
+
+    timeline_erase(task);
+    task->rq = NULL;
+    sleep_queue.num_tasks--;
+}
+
+/**
+ * Wake the blocked task at task->sleep_until if nothing else wakes it
+ * first, see wait_on_timeout().
+ */
+void sleep_add_timeout(struct task_struct *task) {
+    timeline_insert(task);
+    task->timeout = TIMEOUT_ARMED;
+}
+
+/**
+ * Called when a task with a timeout is woken or leaves its wait queue,
+ * no error if it has none.
+ */
+void sleep_cancel_timeout(struct task_struct *task) {
+    if(task->timeout != TIMEOUT_ARMED)
+        return;
+    timeline_erase(task);
+    task->timeout = TIMEOUT_NONE;
+}
+
+/**
+ * Wake up every sleeper whose deadline is at or before now.
+ * Called from the timer softirq with interrupts disabled.
+ */
+void sleep_wakeup_expired(uint64_t now) {
+    struct task_struct *task;
+
+    while(sleep_first && sleep_first->sleep_until <= now) {
+        task = sleep_first;
+        if(task->timeout == TIMEOUT_ARMED) {
+            /* Timed out, take it off its wait queue */
+            timeline_erase(task);
+            task->timeout = TIMEOUT_EXPIRED;
+            task_wakeup(task->rq, task);
+        } else {
+            sleep_remove(task);
+            task_wakeup(NULL, task);
+        }
+    }
+}
+
+/**
+ * Return the earliest sleeper's deadline in jiffies, or -1 if none.
+ */
+uint64_t sleep_next_deadline(void) {
+    return sleep_first? sleep_first->sleep_until : (uint64_t)-1;
+}
@@ -0,0 +1,44 @@
+#
+# Kernel stack switching for schedule(), see switch_to() in
+# include/sbunix/sched.h. Called with interrupts disabled.
+#
+# A switched out task's kernel stack ends with a struct switch_frame: the
+# callee-saved registers and the address switch_stack() returns to. The
+# caller-saved ones are already saved by the C code around the call.
+#
+
+#
+# void switch_stack(uint64_t *prev_rsp, uint64_t next_rsp)
+#   Save the callee-saved registers on the current stack, store the stack
+#   pointer in *prev_rsp, and return on the stack at next_rsp instead.
+#
+.global switch_stack
+switch_stack:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    retq
+
+#
+# The first switch to a new task returns here, with the task's start
+# function in %rbx (task_set_start()). Clean up after the last task,
+# then jump to start with the stack task_set_start() was given.
+#
+.global switch_first
+switch_first:
+    movq %rsp, %r12
+    andq $-16, %rsp                 # ABI alignment for the call
+    call post_context_switch
+    movq %r12, %rsp
+    jmp *%rbx
@@ -0,0 +1,124 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/string.h>
+#include <errno.h>
+
+/*
+ * Wait queues, each waitable object embeds a wait_queue_head and only the
+ * tasks waiting on that object are looked at when it is woken.
+ * The current task is put on the wait queue by queue_add_by_state() once
+ * it has been switched out.
+ */
+
+void wait_queue_init(struct wait_queue_head *wq) {
+    memset(wq, 0, sizeof(*wq));
+}
+
+/**
+ * Put the current task to sleep on wq. If what it waits for is set by an
+ * interrupt handler, disable interrupts before checking for it so the
+ * wake up is not missed.
+ * @state: TASK_BLOCKED or TASK_WAITING
+ * @exclusive: if true, a wake_up() wakes only one exclusive waiter
+ */
+void wait_on(struct wait_queue_head *wq, int state, int exclusive) {
+    uint64_t flags = local_irq_save();
+
+    curr_task->state = state;
+    curr_task->blocked_on = wq;
+    curr_task->wait_exclusive = exclusive;
+    schedule();
+    local_irq_restore(flags);
+    /* Woken up to die by kill_other_task() */
+    if(curr_task->killed)
+        kill_curr_task(curr_task->exit_code);
+}
+
+/**
+ * Like wait_on(), but give up waiting at the deadline.
+ * @deadline: absolute time in jiffies
+ * @return: 0 if woken, or -ETIMEDOUT
+ */
+int wait_on_timeout(struct wait_queue_head *wq, int state, uint64_t deadline) {
+    uint64_t flags = local_irq_save();
+    int rv;
+
+    curr_task->state = state;
+    curr_task->blocked_on = wq;
+    curr_task->wait_exclusive = 0;
+    curr_task->sleep_until = deadline;
+    sleep_add_timeout(curr_task);
+    schedule();
+    rv = (curr_task->timeout == TIMEOUT_EXPIRED)? -ETIMEDOUT : 0;
+    curr_task->timeout = TIMEOUT_NONE;
+    local_irq_restore(flags);
+    if(curr_task->killed)
+        kill_curr_task(curr_task->exit_code);
+    return rv;
+}
+
+/**
+ * Block the current task on wq until it is woken.
+ */
+void task_block(struct wait_queue_head *wq) {
+    wait_on(wq, TASK_BLOCKED, 0);
+}
+
+/**
+ * Block the current task on wq, at most one exclusive waiter is woken
+ * by wake_up(). Use for waiters that will consume what woke them.
+ */
+void task_block_exclusive(struct wait_queue_head *wq) {
+    wait_on(wq, TASK_BLOCKED, 1);
+}
+
+/**
+ * Wake the waiters on wq, O(waiters on wq).
+ * @nr_exclusive: max exclusive waiters to wake, 0 for all
+ * @foreground: only wake tasks controlling the terminal
+ * @return: the first exclusive waiter woken, or NULL
+ */
+static struct task_struct *__wake_up(struct wait_queue_head *wq,
+                                     int nr_exclusive, int foreground) {
+    struct task_struct *task, *next, *first = NULL;
+    int woke_exclusive = 0;
+    uint64_t flags = local_irq_save();
+
+    /* task_wakeup() unlinks task, so grab the next one first */
+    for(task = wq->waiters.tasks; task != NULL; task = next) {
+        next = task->next_rq;
+        if(foreground && !task->foreground)
+            continue;
+        if(task->wait_exclusive) {
+            if(nr_exclusive && woke_exclusive >= nr_exclusive)
+                continue; /* still wake the non-exclusive waiters */
+            if(!woke_exclusive++)
+                first = task;
+        }
+        task_wakeup(&wq->waiters, task);
+    }
+    local_irq_restore(flags);
+    return first;
+}
+
+/**
+ * Wake all non-exclusive waiters and the first exclusive waiter.
+ * @return: the exclusive waiter woken, or NULL
+ */
+struct task_struct *wake_up(struct wait_queue_head *wq) {
+    return __wake_up(wq, 1, 0);
+}
+
+/**
+ * Wake every waiter, e.g. when the object is closed.
+ */
+void wake_up_all(struct wait_queue_head *wq) {
+    __wake_up(wq, 0, 0);
+}
+
+/**
+ * Wake every waiter that controls the terminal.
+ */
+void wake_up_foreground(struct wait_queue_head *wq) {
+    __wake_up(wq, 0, 1);
+}
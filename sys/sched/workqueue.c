@@ -0,0 +1,134 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/preempt.h>
+#include <sbunix/workqueue.h>
+
+/*
+ * The system workqueue, see <sbunix/workqueue.h>.
+ * Pending work is a FIFO list under the kernel lock. Idle workers wait
+ * exclusively on work_wait so queue_work() wakes only one of them.
+ * Each worker remembers the work it is running so flush_work() can tell
+ * when it is done without touching the work_struct, which the work
+ * function may have freed.
+ */
+
+#define WQ_NR_WORKERS  2
+
+static struct work_struct *work_head, *work_tail;
+static struct wait_queue_head work_wait;    /* idle workers */
+static struct wait_queue_head flush_wait;   /* flush_work() callers */
+static struct task_struct *workers[WQ_NR_WORKERS];
+static struct work_struct *worker_current[WQ_NR_WORKERS];
+
+static struct work_struct *work_pop(void) {
+    struct work_struct *work = work_head;
+
+    if(work) {
+        work_head = work->next;
+        if(!work_head)
+            work_tail = NULL;
+        work->next = NULL;
+        work->pending = 0;
+    }
+    return work;
+}
+
+/**
+ * Run pending work forever, worker i of workers[].
+ */
+static void worker_run(int i) {
+    struct work_struct *work;
+    uint64_t flags;
+
+    while(1) {
+        flags = local_irq_save();
+        while(!(work = work_pop()))
+            task_block_exclusive(&work_wait);
+        worker_current[i] = work;
+        local_irq_restore(flags);
+
+        sti();
+        work->func(work);  /* work may be freed now */
+        cli();
+
+        worker_current[i] = NULL;
+        wake_up_all(&flush_wait);
+        cond_resched();
+    }
+}
+
+static void worker0(void) {
+    worker_run(0);
+}
+
+static void worker1(void) {
+    worker_run(1);
+}
+
+/**
+ * Start the worker threads, after init so that it gets PID 1.
+ */
+void workqueue_init(void) {
+    void (*start[WQ_NR_WORKERS])(void) = {worker0, worker1};
+    int i;
+
+    wait_queue_init(&work_wait);
+    wait_queue_init(&flush_wait);
+    for(i = 0; i < WQ_NR_WORKERS; i++) {
+        workers[i] = ktask_create(start[i], "[kworker]");
+        if(!workers[i])
+            kpanic("Failed to create kworker %d\n", i);
+        /* Workers never read the terminal */
+        workers[i]->foreground = 0;
+    }
+}
+
+/**
+ * Queue work to be run by a worker, it may run on another CPU before this
+ * returns. Can be called from interrupt handlers.
+ * @return: 1 if queued, 0 if it was still pending
+ */
+int queue_work(struct work_struct *work) {
+    uint64_t flags;
+
+    if(work->pending)
+        return 0;
+    flags = local_irq_save();
+    work->pending = 1;
+    work->next = NULL;
+    if(work_tail)
+        work_tail->next = work;
+    else
+        work_head = work;
+    work_tail = work;
+    wake_up(&work_wait);
+    local_irq_restore(flags);
+    return 1;
+}
+
+/**
+ * True if work is pending or some worker is running it.
+ */
+static int work_busy(struct work_struct *work) {
+    int i;
+
+    if(work->pending)
+        return 1;
+    for(i = 0; i < WQ_NR_WORKERS; i++) {
+        if(worker_current[i] == work)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Wait until work has finished running, if it is queued or running.
+ * Not from a worker, it could be waiting on itself.
+ */
+void flush_work(struct work_struct *work) {
+    uint64_t flags = local_irq_save();
+
+    while(work_busy(work))
+        task_block(&flush_wait);
+    local_irq_restore(flags);
+}
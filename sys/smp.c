@@ -0,0 +1,280 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/smp.h>
+#include <sbunix/sched.h>
+#include <sbunix/spinlock.h>
+#include <sbunix/fpu.h>
+#include <sbunix/string.h>
+#include <sbunix/interrupt/idt.h>
+#include <sbunix/interrupt/lapic.h>
+#include <sbunix/interrupt/pit.h>
+#include <sbunix/mm/pt.h>
+#include "syscall/syscall_dispatch.h"
+
+/* Per-CPU data, cpus[0] is the bootstrap processor (BSP) */
+struct cpu cpus[MAX_CPUS] = {
+        [0] = {
+            .self = &cpus[0],
+            .curr = &kernel_task,
+            .idle = &kernel_task,
+            .id = 0,
+            .online = 1,
+        },
+};
+/* CPUs 0 to smp_num_cpus - 1 are online */
+int smp_num_cpus = 1;
+
+/*
+ * The big kernel lock. Only one CPU runs kernel code at a time, the rest
+ * of the kernel relies on cli for mutual exclusion as it did on one CPU.
+ * It is taken on every entry to the kernel (syscall_dispatch, the ISR
+ * wrappers, the idle loops) and released on the way back to ring 3.
+ * The nesting count is per task, so the lock passes from prev to next on
+ * a context switch.
+ * There are no separate scheduler, page allocator or VMM locks: system
+ * calls and interrupts still run one CPU at a time, only user code runs in
+ * parallel. The run queues are per CPU so that splitting this lock up later
+ * does not also mean reworking the scheduler classes.
+ */
+static spinlock_t kernel_lock = SPINLOCK_INIT;
+
+/* Used by the APs in trampoline.s */
+uint64_t ap_stacks[MAX_CPUS];  /* initial stack of each AP */
+volatile int ap_next_id = 1;   /* next free slot in cpus[] */
+int ap_max_id = 1;             /* slots with a stack and idle task */
+extern char trampoline_start[], trampoline_end[];
+extern uint32_t tramp_cr0, tramp_cr3, tramp_cr4, tramp_efer;
+
+/* Set by smp_start(), the APs wait for it before scheduling */
+static volatile int smp_started = 0;
+
+void ap_main(int id);
+
+/**
+ * Take the kernel lock, or nest if the current task already holds it.
+ */
+void lock_kernel(void) {
+    if(curr_task->lock_depth++ != 0)
+        return;
+    /* The holder may be waiting in smp_flush_tlb_mm() for this CPU, which
+     * can not take the IPI if it spins here with interrupts disabled */
+    while(!spin_trylock(&kernel_lock)) {
+        while(kernel_lock.locked) {
+            smp_tlb_flush_check();
+            cpu_relax();
+        }
+    }
+}
+
+/**
+ * Drop one level of the kernel lock, releasing it at the outermost level.
+ */
+void unlock_kernel(void) {
+    if(curr_task->lock_depth <= 0)
+        kpanic("Task %s does not hold the kernel lock\n", curr_task->cmdline);
+    if(--curr_task->lock_depth == 0)
+        spin_unlock(&kernel_lock);
+}
+
+/**
+ * Load this CPU's GDT and TSS and point its GS base at cpu.
+ */
+void cpu_init(struct cpu *cpu) {
+    cpu->self = cpu;
+    reload_gdt(cpu);
+    setup_tss(cpu);
+    /* Loading %gs in reload_gdt() cleared the GS base */
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+    wrmsr(MSR_KERNEL_GS_BASE, 0);
+}
+
+/**
+ * Spin for at least ticks timer ticks, interrupts must be enabled.
+ */
+static void smp_delay(uint64_t ticks) {
+    uint64_t end = jiffies + ticks + 1;
+    while(jiffies < end)
+        cpu_relax();
+}
+
+/**
+ * Bring up the other CPUs (APs). Called on the BSP from start() with
+ * interrupts enabled. Every AP is sent INIT and then two Startup IPIs, it
+ * runs trampoline.s and waits in ap_main() for smp_start().
+ */
+void smp_init(void) {
+    uint64_t *stack, end;
+    int i;
+
+    /* lapic_timer_init() set up the BSP's local APIC */
+    if(MAX_CPUS < 2 || !lapic_ticks_per_jiffy)
+        return;
+
+    /* A boot stack and an idle task for every possible AP */
+    for(i = 1; i < MAX_CPUS; i++) {
+        stack = (uint64_t *)get_free_page(0);
+        if(!stack)
+            break;
+        cpus[i].idle = idle_task_create(i, stack);
+        if(!cpus[i].idle) {
+            free_page((uint64_t)stack);
+            break;
+        }
+        cpus[i].id = i;
+        cpus[i].curr = cpus[i].idle;
+        ap_stacks[i] = (uint64_t)&stack[510];
+    }
+    ap_max_id = i;
+
+    tramp_cr0 = (uint32_t)read_cr0();
+    tramp_cr3 = (uint32_t)kernel_pt;
+    tramp_cr4 = (uint32_t)read_cr4();
+    tramp_efer = (uint32_t)rdmsr(MSR_EFER) & ~MSR_EFER_LMA;
+    memcpy((void *)kphys_to_virt(TRAMPOLINE_PHYS), trampoline_start,
+           (size_t)(trampoline_end - trampoline_start));
+    if(pt_map_low_identity())
+        return;
+
+    lapic_send_ipi(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_INIT |
+                      LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    smp_delay(10);
+    for(i = 0; i < 2; i++) {
+        lapic_send_ipi(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_STARTUP |
+                          (TRAMPOLINE_PHYS >> 12));
+        smp_delay(1);
+    }
+
+    /* Wait for every AP that claimed a slot to come online */
+    smp_delay(20);
+    for(i = 1; i < MIN(ap_next_id, ap_max_id); i++) {
+        end = jiffies + TIMER_HZ;
+        while(!cpus[i].online && jiffies < end)
+            cpu_relax();
+        if(!cpus[i].online)
+            break;
+    }
+    smp_num_cpus = i;
+    pt_unmap_low_identity();
+    printk("SMP: %d CPUs online\n", smp_num_cpus);
+}
+
+/**
+ * Let the APs start scheduling, called from kmain() with the kernel lock.
+ */
+void smp_start(void) {
+    smp_started = 1;
+}
+
+/**
+ * Entry point of an AP in C, on its boot stack, from trampoline.s.
+ * After setting up the CPU it becomes its idle task.
+ */
+void ap_main(int id) {
+    struct cpu *cpu = &cpus[id];
+
+    cpu_init(cpu);
+    reload_idt();
+    enable_syscalls();
+    fpu_cpu_init();
+    lapic_init();
+    /* Only the BSP takes interrupts from the PIC */
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    cpu->apic_id = lapic_id();
+    cpu->online = 1;
+
+    while(!smp_started)
+        cpu_relax();
+    /* Drop any cached translations of the trampoline's identity mapping */
+    write_cr3(read_cr3());
+
+    lock_kernel();
+    lapic_timer_start();
+
+    /* idle task */
+    while(1) {
+        schedule();
+        unlock_kernel();
+        __asm__ __volatile__("sti;hlt;cli;");
+        lock_kernel();
+    }
+}
+
+/**
+ * Interrupt cpu out of its idle loop so it looks at its queues. Nothing is
+ * done if it is this CPU or already running a task.
+ */
+void smp_kick_cpu(struct cpu *cpu) {
+    if(smp_num_cpus < 2 || cpu == this_cpu() || !cpu->online ||
+            cpu->curr != cpu->idle)
+        return;
+    lapic_send_ipi((uint32_t)cpu->apic_id, IPI_RESCHED_VECTOR);
+}
+
+/**
+ * Make cpu switch tasks soon, even if it is running a task. Another CPU
+ * gets an IPI and schedules at the end of the interrupt, or at its next
+ * preemption point if the interrupt came in a syscall.
+ */
+void smp_resched_cpu(struct cpu *cpu) {
+    cpu->curr->need_resched = 1;
+    if(smp_num_cpus < 2 || cpu == this_cpu() || !cpu->online)
+        return;
+    lapic_send_ipi((uint32_t)cpu->apic_id, IPI_RESCHED_VECTOR);
+}
+
+/**
+ * Make every other CPU that has mm loaded reload its page tables
+ * (mm->pml4), dropping its TLB entries, and wait until they all have.
+ * That includes CPUs running a kernel thread on it, see switch_mm().
+ * Called with the kernel lock held after mm's page tables were changed
+ * in a way that its threads on other CPUs must see: write protection for
+ * copy-on-write, or a page replaced under them.
+ *
+ * A CPU flushes in the IPI handler, or while it spins in lock_kernel()
+ * if it was about to enter the kernel with interrupts disabled.
+ */
+void smp_flush_tlb_mm(struct mm_struct *mm) {
+    struct cpu *self = this_cpu(), *cpu;
+    int i;
+
+    if(smp_num_cpus < 2)
+        return;
+    /* cpus[i].active_mm can not change, switching needs the kernel lock */
+    for(i = 0; i < smp_num_cpus; i++) {
+        cpu = &cpus[i];
+        if(cpu == self || !cpu->online || cpu->active_mm != mm)
+            continue;
+        cpu->tlb_flush = 1;
+        lapic_send_ipi((uint32_t)cpu->apic_id, IPI_TLB_VECTOR);
+    }
+    for(i = 0; i < smp_num_cpus; i++) {
+        while(cpus[i].tlb_flush)
+            cpu_relax();
+    }
+}
+
+/**
+ * Reload this CPU's page tables if smp_flush_tlb_mm() asked for it.
+ * Runs without the kernel lock, from the IPI or a spin in lock_kernel().
+ */
+void smp_tlb_flush_check(void) {
+    struct cpu *cpu = this_cpu();
+
+    if(!cpu->tlb_flush)
+        return;
+    write_cr3(cpu->active_mm->pml4);
+    cpu->tlb_flush = 0;
+}
+
+/**
+ * True if every other CPU is running its idle task.
+ */
+int smp_others_idle(void) {
+    struct cpu *self = this_cpu();
+    int i;
+
+    for(i = 0; i < smp_num_cpus; i++) {
+        if(&cpus[i] != self && cpus[i].curr != cpus[i].idle)
+            return 0;
+    }
+    return 1;
+}
@@ -1,12 +1,16 @@
 #include <sbunix/sbunix.h>
 #include <sbunix/gdt.h>
+#include <sbunix/fpu.h>
+#include <sbunix/console.h>
 #include <sbunix/fs/tarfs.h>
 #include <sbunix/interrupt/idt.h>
 #include <sbunix/interrupt/pic8259.h>
 #include <sbunix/interrupt/pit.h>
+#include <sbunix/interrupt/lapic.h>
 #include <sbunix/mm/physmem.h>
 #include <sbunix/mm/pt.h>
 #include <sbunix/sched.h>
+#include <sbunix/smp.h>
 #include "kmain.h"
 #include "syscall/syscall_dispatch.h"
 
@@ -39,8 +43,9 @@ void start(uint32_t* modulep, uint64_t physbase, uint64_t physfree)
 	/* Initialize interrupts and memory allocation */
 	load_idt();
 	PIC_protected_mode();
+	keyboard_init();
 	init_unix_time();
-	pit_set_freq(1000);  /* 1000 HZ (1 millisecond) (1000000 nanoseconds) */
+	pit_set_freq(TIMER_HZ);  /* 1000 HZ (1 millisecond) (1000000 nanoseconds) */
 
 	/* Init kernel page table */
 	init_kernel_pt(physfree);
@@ -48,14 +53,20 @@ void start(uint32_t* modulep, uint64_t physbase, uint64_t physfree)
 
 	/* Init physical memory tracking */
 	pzone_remove(physbase, physfree);  /* Remove kernel's code and data */
+	pzone_remove(TRAMPOLINE_PHYS, TRAMPOLINE_PHYS + PAGE_SIZE); /* AP startup */
 	physmem_init();
 	physmem_report();
+	vtime_init();
 
 	tarfs_init();
 
 	scheduler_init();
 
 	enable_syscalls();
+	fpu_init();
+	tsc_calibrate();
+	lapic_timer_init();
+	smp_init();
 	/* Start the kernel */
 	kmain();
 	halt_loop("Halting in start(), time and key presses should update...\n");
@@ -79,8 +90,7 @@ void boot(void)
 		:"=g"(loader_stack)
 		:"r"(&stack[INITIAL_STACK_SIZE - 16])
 	);
-	reload_gdt();
-	setup_tss();
+	cpu_init(&cpus[0]);  /* GDT, TSS, and GS base of the BSP */
 	virt_base = (uint64_t)&kernmem - (uint64_t)&physbase;
 	start((uint32_t*)(loader_stack[3] + virt_base), (uint64_t)&physbase,
 		  (uint64_t)loader_stack[4]);
@@ -0,0 +1,34 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/syscall.h>
+#include <sbunix/mm/vmm.h>
+#include <sys/prctl.h>
+
+/**
+ * Set or get the FS base of the current task, the user's thread pointer.
+ * The GS base is swapped with the kernel's on every entry, so the user
+ * can not have one.
+ * @code: ARCH_SET_FS or ARCH_GET_FS
+ * @addr: the new FS base, or where to store the current one
+ */
+int do_arch_prctl(int code, uint64_t addr) {
+    int err;
+
+    switch(code) {
+        case ARCH_SET_FS:
+            /* Must be a canonical user address, or wrmsr faults */
+            if(addr >> 47)
+                return -EPERM;
+            task_set_fs_base(curr_task, addr);
+            return 0;
+        case ARCH_GET_FS:
+            err = valid_userptr_write(curr_task->mm, (void *)addr,
+                                      sizeof(uint64_t));
+            if(err)
+                return err;
+            *(uint64_t *)addr = curr_task->fs_base;
+            return 0;
+        default:
+            return -EINVAL;
+    }
+}
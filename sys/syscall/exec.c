@@ -4,6 +4,10 @@
 #include <sbunix/mm/vmm.h>
 #include <sbunix/gdt.h>
 #include <sbunix/sched.h>
+#include <sbunix/smp.h>
+#include <sbunix/preempt.h>
+#include <sbunix/fpu.h>
+#include <sbunix/cputime.h>
 #include <sbunix/string.h>
 #include <sbunix/syscall.h>
 #include <errno.h>
@@ -11,16 +15,24 @@
 #include "syscall_dispatch.h"
 
 void __attribute__((noreturn)) enter_usermode(uint64_t user_rsp, uint64_t user_rip) {
+    struct cpu *cpu;
+
     cli();
-    /* Same is in post_context_switch(), kernel stacks always aligned up minus 16 */
-    tss.rsp0 = ALIGN_UP(read_rsp(), PAGE_SIZE) - 16;
-    syscall_kernel_rsp = tss.rsp0;
+    cpu = this_cpu();
+    /* A kernel task becoming a user one may not have a stack of its own */
+    curr_task->kstack_top = ALIGN_UP(read_rsp(), PAGE_SIZE) - 16;
+    load_kernel_stack(cpu, curr_task);
+    /* Not returning through syscall_dispatch() */
+    curr_task->in_syscall = 0;
+    curr_task->preempt_count = 0;
+    account_system_time(curr_task);
+    unlock_kernel();
+    /* %gs is not reloaded, that would clear the kernel's GS base */
     __asm__ __volatile__(
         "movq $0x23, %%rax;"
         "movq %%rax, %%ds;"
         "movq %%rax, %%es;"
         "movq %%rax, %%fs;"
-        "movq %%rax, %%gs;"
         "pushq %%rax;"         /* ring3 ss, should be _USER_DS|RPL = 0x23 */
         "pushq %0;"            /* ring3 rsp */
         "pushfq;"              /* ring3 rflags */
@@ -44,6 +56,7 @@ void __attribute__((noreturn)) enter_usermode(uint64_t user_rsp, uint64_t user_r
         "xorq %%r13, %%r13;"
         "xorq %%r14, %%r14;"
         "xorq %%r15, %%r15;"
+        "swapgs;"              /* user's GS base */
         "iretq;"
         : /* No output */
         : "r"(user_rsp), "r"(user_rip)
@@ -59,74 +72,95 @@ char *is_interpreter(struct file *fp) {
     hdr = fp->private_data;
     /* Hack: we know it's a tarfs file in memory, so just get the data pointer */
     file_start = (char *)(hdr + 1);
-    if(file_start[0] == '#' &&  file_start[1] == '!')
+    if(fp->f_size >= 2 && file_start[0] == '#' &&  file_start[1] == '!')
         return file_start + 2;
     return NULL;
 }
 
-static char inter_prev = 0;
 /**
- * Lookup a filename and load the ELF/script
+ * Copy the interpreter path following a "#!" into args->interp.
+ * @inter: start of the path, as returned by is_interpreter
+ * @return: 0 on success, -ENAMETOOLONG if the path does not fit
  */
-long do_execve(char *filename, const char **argv, const char **envp, int rec) {
+static int copy_interpreter(struct exec_args *args, struct file *fp,
+                            const char *inter) {
+    const char *file_end = (char *)(fp->private_data) +
+            sizeof(struct posix_header_ustar) + fp->f_size;
+    int i;
+
+    for(i = 0; inter + i < file_end && !isspace(inter[i]) && inter[i] != '\0'; i++) {
+        if(i >= ARG_INTERP_MAX)
+            return -ENAMETOOLONG;
+        args->interp[i] = inter[i];
+    }
+    args->interp[i] = '\0';
+    return 0;
+}
+
+/**
+ * Resolve filename against the cwd and open it.
+ * @return: the open file, or NULL with err set
+ */
+static struct file *exec_open(const char *filename, long *err) {
     struct file *fp;
-    struct mm_struct *mm;
     char *rpath;
     int ierr;
-    long err;
-    const char **copyargv = NULL;
-    char *inter;
-    size_t len;
 
-    /* Resolve pathname to an absolute path */
-    rpath = resolve_path(curr_task->cwd, filename, &err);
+    rpath = resolve_path(curr_task->cwd, filename, err);
     if(!rpath)
-        goto cleanup_rec_argv;
-
-    if(rec == 1) {
-        len = strlen(filename);
-        filename[len] = inter_prev;
-    }
+        return NULL;
 
     fp = tarfs_open(rpath, O_RDONLY, 0, &ierr);
     kfree(rpath);
     if(ierr) {
-        err = ierr;
-        goto cleanup_rec_argv;
+        *err = ierr;
+        return NULL;
     }
+    return fp;
+}
 
-    if(rec == 0 && (inter = is_interpreter(fp))) {
+/**
+ * Lookup a filename and load the ELF/script
+ */
+long do_execve(const char *filename, const char **argv, const char **envp) {
+    struct exec_args *args;
+    struct file *fp;
+    struct mm_struct *mm, *old_mm;
+    char *inter;
+    long err;
+
+    args = exec_args_create();
+    if(!args)
+        return -ENOMEM;
+
+    fp = exec_open(filename, &err);
+    if(!fp)
+        goto cleanup_args;
+
+    if((inter = is_interpreter(fp))) {
         /* filename needs to be launched as a exec(interpreter, argv, evnp) */
-        int i;
-        for(i = 0; !isspace(inter[i]) && inter[i] != '\0'; i++); /*nothing*/;
-        inter_prev = inter[i];
-        inter[i] = '\0';
-        copyargv = (const char **)get_free_page(0);
-        if(!copyargv) {
-            err = -ENOMEM;
-            goto cleanup_file;
-        }
-        copyargv[0] = inter;
-        /* copy argv */
-        for(i = 1; argv[i - 1] && i < 200 ; i++)
-            copyargv[i] = argv[i - 1];
-        copyargv[i] = NULL;
-        if(i >= 200) {
-            err = -E2BIG;
-            goto cleanup_copyargs;
-        }
+        err = copy_interpreter(args, fp, inter);
         fp->f_op->close(fp);
-        return do_execve(inter, copyargv, envp, 1);
+        if(err)
+            goto cleanup_args;
+        fp = exec_open(args->interp, &err);
+        if(!fp)
+            goto cleanup_args;
     }
 
+    /* Stage the arguments while the caller's memory is still mapped */
+    err = exec_args_copy(args, argv, envp);
+    if(err)
+        goto cleanup_file;
+
     err = elf_validiate_exec(fp);
     if(err)
-        goto cleanup_copyargs;
+        goto cleanup_file;
     /* create new mm_struct */
     mm = mm_create();
     if(!mm) {
         err = -ENOMEM;
-        goto cleanup_copyargs;
+        goto cleanup_file;
     }
     err = elf_load(fp, mm);
     if(err)
@@ -135,38 +169,38 @@ long do_execve(char *filename, const char **argv, const char **envp, int rec) {
     err = add_heap(mm);
     if(err)
         goto cleanup_mm;
-    err = add_stack(mm, argv, envp);
+    err = add_stack(mm, args);
     if(err)
         goto cleanup_mm;
 
-    if(rec == 1)
-        free_page((uint64_t)argv);
-
     /* Update curr_task->cmdline  */
-    task_set_cmdline(curr_task, filename);
+    task_set_cmdline(curr_task, args->interp[0] ? args->interp : filename);
+    exec_args_destroy(args);
 
-    write_cr3(mm->pml4);
+    /* The CPU's reference moves from the mm it had loaded to the new one */
+    old_mm = switch_mm(this_cpu(), mm);
     /* If current task is a user, destroy it's mm_struct  */
     if(curr_task->type == TASK_KERN) {
         curr_task->type = TASK_USER;
     } else {
-        /* free old mm_struct */
-        mm_destroy(curr_task->mm);
+        /* free old mm_struct, CR3 no longer points at it */
+        mm_destroy_async(curr_task->mm);
     }
+    mm_destroy_async(old_mm);
     curr_task->mm = mm;
     fp->f_op->close(fp);
+    /* The new program starts with a clean FPU state */
+    fpu_release(curr_task);
+    /* and sets up its own thread pointer, if it has TLS */
+    task_set_fs_base(curr_task, 0);
 
     enter_usermode(mm->user_rsp, mm->user_rip);
     /* does not return */
 cleanup_mm:
     mm_destroy(mm);
-cleanup_copyargs:
-    if(copyargv)
-        free_page((uint64_t)copyargv);
 cleanup_file:
     fp->f_op->close(fp);
-cleanup_rec_argv:
-    if(rec == 1)
-        free_page((uint64_t)argv);
+cleanup_args:
+    exec_args_destroy(args);
     return err;
 }
@@ -15,7 +15,7 @@ int next_fd(struct task_struct *task) {
     int i;
 
     for(i = 0; i < TASK_FILES_MAX; i++) {
-        if(task->files[i] == NULL)
+        if(task->files->fd[i] == NULL)
             return i;
     }
     return -EMFILE; /* no free files */
@@ -53,30 +53,40 @@ long do_open(const char *pathname, int flags, mode_t mode) {
     if(ierr)
         return (long)ierr;
     /* success */
-    curr_task->files[newfd] = newfilep;
+    curr_task->files->fd[newfd] = newfilep;
     return newfd;
 }
 
 ssize_t do_read(int fd, void *buf, size_t count) {
     struct file *filep;
+    ssize_t rv;
 
     if(INVALID_FD(fd))
         return -EBADF;
-    filep = curr_task->files[fd];
+    filep = curr_task->files->fd[fd];
     if(!filep)
         return -EBADF;
-    return filep->f_op->read(filep, buf, count, &filep->f_pos);
+    /* Hold on to it, a thread sharing our files may close fd meanwhile */
+    filep->f_count++;
+    rv = filep->f_op->read(filep, buf, count, &filep->f_pos);
+    filep->f_op->close(filep);
+    return rv;
 }
 
 ssize_t do_write(int fd, const void *buf, size_t count) {
     struct file *filep;
+    ssize_t rv;
 
     if(INVALID_FD(fd))
         return -EBADF;
-    filep = curr_task->files[fd];
+    filep = curr_task->files->fd[fd];
     if(!filep)
         return -EBADF;
-    return filep->f_op->write(filep, buf, count, &filep->f_pos);
+    /* Hold on to it, a thread sharing our files may close fd meanwhile */
+    filep->f_count++;
+    rv = filep->f_op->write(filep, buf, count, &filep->f_pos);
+    filep->f_op->close(filep);
+    return rv;
 }
 
 off_t do_lseek(int fd, off_t offset, int whence) {
@@ -84,7 +94,7 @@ off_t do_lseek(int fd, off_t offset, int whence) {
 
     if(INVALID_FD(fd))
         return -EBADF;
-    filep = curr_task->files[fd];
+    filep = curr_task->files->fd[fd];
     if(!filep)
         return -EBADF;
     return filep->f_op->lseek(filep, offset, whence);
@@ -96,11 +106,11 @@ int do_close(int fd) {
 
     if(INVALID_FD(fd))
         return -EBADF;
-    filep = curr_task->files[fd];
+    filep = curr_task->files->fd[fd];
     if(!filep)
         return -EBADF;
+    curr_task->files->fd[fd] = NULL;
     rv = filep->f_op->close(filep);
-    curr_task->files[fd] = NULL;
     return rv;
 }
 
@@ -118,15 +128,15 @@ int do_pipe(int *pipefd) {
 
     /* Choose 2 open file descriptors */
     for(rfd = 0; rfd < TASK_FILES_MAX; rfd++)
-        if(curr_task->files[rfd] == NULL)
+        if(curr_task->files->fd[rfd] == NULL)
             break;
     for(wfd = rfd + 1; wfd < TASK_FILES_MAX; wfd++)
-        if(curr_task->files[wfd] == NULL)
+        if(curr_task->files->fd[wfd] == NULL)
             break;
     if(rfd >= TASK_FILES_MAX || wfd >= TASK_FILES_MAX)
         return -EMFILE;
 
-    err = pipe_open(&curr_task->files[rfd], &curr_task->files[wfd]);
+    err = pipe_open(&curr_task->files->fd[rfd], &curr_task->files->fd[wfd]);
     if(err)
         return err;
     /* Update user fd's */
@@ -169,18 +179,18 @@ int do_dup2(int oldfd, int newfd) {
     if(INVALID_FD(oldfd) || INVALID_FD(newfd))
         return -EBADF; /* invalid fd index */
 
-    oldfilep = curr_task->files[oldfd];
+    oldfilep = curr_task->files->fd[oldfd];
     if(!oldfilep)
         return -EBADF; /* oldfd is not an opened file */
 
     if(oldfd == newfd)
         return newfd;  /* same fd index */
 
-    newfilep = curr_task->files[newfd];
+    newfilep = curr_task->files->fd[newfd];
     if(newfilep)
         newfilep->f_op->close(newfilep); /* close new fd */
     oldfilep->f_count++;
-    curr_task->files[newfd] = oldfilep;
+    curr_task->files->fd[newfd] = oldfilep;
     return newfd;
 }
 
@@ -196,7 +206,7 @@ int do_getdents(unsigned int fd, struct linux_dirent *dirp, unsigned int count)
     if(INVALID_FD(fd))
         return -EBADF;
 
-    filep = curr_task->files[fd];
+    filep = curr_task->files->fd[fd];
     if(!filep)
         return -EBADFD;
 
@@ -238,7 +248,7 @@ void *do_mmap(void *addr, size_t length, int prot, int flags, int fd,
         /* Get the user's open file */
         if(INVALID_FD(fd))
             return (void*)-EBADF;
-        filep = curr_task->files[fd];
+        filep = curr_task->files->fd[fd];
         if(!filep)
             return (void*)-EBADF;
 
@@ -1,31 +1,48 @@
 #include <sbunix/sbunix.h>
 #include <sbunix/sched.h>
 #include <sbunix/syscall.h>
+#include <sched.h> /* CLONE_* */
 
 /* from syscall_entry.s */
 extern void child_ret_from_fork(void);
 
 /**
+ * Create a child of the current task which returns 0 from the syscall.
+ * @clone_flags: CLONE_* flags, 0 for a fork
+ * @newsp: if not 0, the child's user stack pointer
+ * @tls:   the child's FS base, if CLONE_SETTLS
+ * @return: the child's pid, or -errno
+ *
  * TODO: fixme: this is the only thing that breaks without -01 optimization
  *
  * Also, I'm not so sure it works in the first place...
  */
-pid_t do_fork(void) {
+pid_t do_clone(int clone_flags, uint64_t newsp, uint64_t tls) {
     struct task_struct *child;
+    uint64_t flags, stack_top;
 
-    child = fork_curr_task();
+    child = fork_curr_task(clone_flags);
     if(!child)
         return (pid_t)-ENOMEM;
 
-    /* We want to retq to child_ret_from_fork */
-    child->first_switch = 1;
+    /* The child starts at child_ret_from_fork, with the 16 qwords of the
+     * copied syscall frame to pop */
+    stack_top = child->kstack_top + 16;
+    task_set_start(child, stack_top - 16 - 128, child_ret_from_fork);
 
-    /* -(16 * 8), for 16 popq's after child_ret_from_fork
-     * -8, for retq pop */
-    child->kernel_rsp = ALIGN_UP(child->kernel_rsp, PAGE_SIZE) - 16 - 128 - 8;
-    *(uint64_t *)child->kernel_rsp = (uint64_t)child_ret_from_fork;
+    /* The user rsp is the first thing syscall_entry pushed */
+    if(newsp)
+        *(uint64_t *)(stack_top - 16 - 8) = newsp;
+    if(clone_flags & CLONE_SETTLS)
+        child->fs_base = tls;
 
+    flags = local_irq_save();
     schedule();
+    local_irq_restore(flags);
     debug("PARENT RETURNED FROM SCHEDULE: returning child pid %d\n", child->pid);
     return child->pid;
 }
+
+pid_t do_fork(void) {
+    return do_clone(0, 0, 0);
+}
@@ -0,0 +1,126 @@
+#include <sbunix/sbunix.h>
+#include <sbunix/sched.h>
+#include <sbunix/syscall.h>
+#include <sbunix/mm/vmm.h>
+#include <sbunix/interrupt/pit.h>
+#include <sys/futex.h>
+
+/*
+ * Fast user-space mutexes. A task waits on a 32-bit word in its memory
+ * only if the word still has the value it expects, so a lock or a
+ * condition only enters the kernel when it is contended.
+ *
+ * A futex is named by the mm and the user address of the word. There is
+ * no memory shared between address spaces, only threads sharing an mm can
+ * reach the same word, so FUTEX_PRIVATE_FLAG changes nothing. The physical
+ * address would not do: after a fork the first write to the page copies
+ * it, moving the word away from its sleepers. Waiters are blocked on the
+ * wait queue of the hash bucket of the key, with the address in
+ * task->futex_key. The kernel lock keeps the check of the word and going
+ * to sleep atomic against futex_wake().
+ */
+
+#define FUTEX_HASH_BITS  8
+#define FUTEX_HASH_SIZE  (1 << FUTEX_HASH_BITS)
+
+static struct wait_queue_head futex_queues[FUTEX_HASH_SIZE];
+
+static struct wait_queue_head *futex_hash(struct mm_struct *mm, uint64_t key) {
+    /* Fibonacci hashing, words are 4 byte aligned */
+    return &futex_queues[(((key ^ (uint64_t)mm) >> 2) * 0x9E3779B97F4A7C15UL) >>
+                         (64 - FUTEX_HASH_BITS)];
+}
+
+/**
+ * Check that the futex word at uaddr is in a writable vm area.
+ * @return: its key, or 0 if it is not
+ */
+static uint64_t futex_key(uint32_t *uaddr) {
+    if(valid_userptr_write(curr_task->mm, uaddr, sizeof(*uaddr)))
+        return 0;
+    return (uint64_t)uaddr;
+}
+
+/**
+ * Sleep on uaddr if it still holds val, until a futex_wake() or timeout.
+ * @timeout: relative, NULL to wait forever
+ * @return: 0 if woken, -EAGAIN if *uaddr != val, -ETIMEDOUT
+ */
+static int futex_wait(uint32_t *uaddr, uint32_t val,
+                      const struct timespec *timeout) {
+    struct task_struct *curr = curr_task;
+    uint64_t key, deadline = 0;
+    int err = 0;
+
+    if(timeout) {
+        if(timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+           timeout->tv_nsec > 999999999L)
+            return -EINVAL;
+        deadline = jiffies + (uint64_t)timeout->tv_sec * TIMER_HZ +
+                (uint64_t)(timeout->tv_nsec + TICK_NSEC - 1) / TICK_NSEC;
+    }
+    key = futex_key(uaddr);
+    if(!key)
+        return -EFAULT;
+    if(*uaddr != val)
+        return -EAGAIN;
+    if(timeout && !timeout->tv_sec && !timeout->tv_nsec)
+        return -ETIMEDOUT;
+
+    curr->futex_key = key;
+    if(timeout)
+        err = wait_on_timeout(futex_hash(curr->mm, key), TASK_BLOCKED, deadline);
+    else
+        wait_on(futex_hash(curr->mm, key), TASK_BLOCKED, 0);
+    if(curr->futex_key == 0)
+        return 0;  /* woken by futex_wake(), even if it timed out too */
+    curr->futex_key = 0;
+    return err;
+}
+
+/**
+ * Wake up to nr tasks waiting on uaddr.
+ * @return: the number woken
+ */
+static int futex_wake(uint32_t *uaddr, int nr) {
+    struct mm_struct *mm = curr_task->mm;
+    struct wait_queue_head *wq;
+    struct task_struct *task, *next;
+    uint64_t key, flags;
+    int woken = 0;
+
+    key = futex_key(uaddr);
+    if(!key)
+        return -EFAULT;
+    wq = futex_hash(mm, key);
+    flags = local_irq_save();
+    for(task = wq->waiters.tasks; task != NULL && woken < nr; task = next) {
+        next = task->next_rq;
+        if(task->futex_key != key || task->mm != mm)
+            continue;
+        task->futex_key = 0;
+        task_wakeup(&wq->waiters, task);
+        woken++;
+    }
+    local_irq_restore(flags);
+    return woken;
+}
+
+/**
+ * Args have been error checked, except the word itself.
+ * @op: FUTEX_WAIT or FUTEX_WAKE, FUTEX_PRIVATE_FLAG is allowed
+ * @val: expected value for FUTEX_WAIT, number to wake for FUTEX_WAKE
+ */
+long do_futex(uint32_t *uaddr, int op, uint32_t val,
+              const struct timespec *timeout) {
+    if((uint64_t)uaddr & 3)
+        return -EINVAL;
+    switch(op & ~FUTEX_PRIVATE_FLAG) {
+        case FUTEX_WAIT:
+            return futex_wait(uaddr, val, timeout);
+        case FUTEX_WAKE:
+            return futex_wake(uaddr, (int)val);
+        default:
+            return -ENOSYS;
+    }
+}
@@ -2,6 +2,7 @@
 #include <sbunix/sched.h>
 #include <sys/getprocs.h>
 #include <sbunix/string.h>
+#include <sbunix/interrupt/pit.h>
 
 /**
  * Doesn't show the idle task.
@@ -16,21 +17,24 @@ ssize_t do_getprocs(void *procbuf, size_t length) {
     task = kernel_task.next_task;
     /* For all tasks on the system */
     for(; task != &kernel_task; task = task->next_task) {
+        struct proc_struct *proc;
         size_t cmdlen;
         /* Don't show the kernel tasks */
         if(task->type == TASK_KERN)
             continue;
 
         cmdlen = strnlen(task->cmdline, TASK_CMDLINE_MAX);
-        if(wrote + sizeof(pid_t) + cmdlen + 1 > length) {
+        if(wrote + PROC_STRUCT_SIZE(cmdlen) > length) {
             return wrote;  /* Buffer can't fit the next process */
         }
 
         /* procbuf can fit */
-        *(pid_t*)(wrote + (char*)procbuf) = task->pid;
-        wrote += sizeof(pid_t);
-        strlcpy((wrote + (char*)procbuf),task->cmdline, cmdlen + 1);
-        wrote += cmdlen + 1;
+        proc = (struct proc_struct *)(wrote + (char*)procbuf);
+        proc->pid = task->pid;
+        proc->utime = tsc_to_usec(task->acct.utime);
+        proc->stime = tsc_to_usec(task->acct.stime);
+        strlcpy(proc->cmd, task->cmdline, cmdlen + 1);
+        wrote += PROC_STRUCT_SIZE(cmdlen);
     }
     return wrote;
 }
@@ -0,0 +1,24 @@
+#include <sbunix/syscall.h>
+#include <sbunix/sched.h>
+#include <sbunix/cputime.h>
+#include <sys/resource.h>
+
+/**
+ * Args have been error checked.
+ * @who: RUSAGE_SELF or RUSAGE_CHILDREN, the children that were waited for
+ * @usage: set to the usage of who
+ */
+int do_getrusage(int who, struct rusage *usage) {
+    switch(who) {
+        case RUSAGE_SELF:
+            /* Bring the system time of this syscall up to date */
+            account_system_time(curr_task);
+            acct_to_rusage(&curr_task->acct, usage);
+            return 0;
+        case RUSAGE_CHILDREN:
+            acct_to_rusage(&curr_task->cacct, usage);
+            return 0;
+        default:
+            return -EINVAL;
+    }
+}
@@ -12,41 +12,31 @@
  */
 int do_kill(pid_t pid, int sig) {
     struct task_struct *task = kernel_task.next_task;
-    int sendtoall = 0;
-    int sigs_sent = 0;
 
-    if (pid == 0 || pid == -1){
-        sendtoall = 1;
-    } else if (pid < -1){
+    if (pid < -1){
         /* We have no process groups, so just return success */
         /*pid = -pid;*/
         return 0;
+    } else if (pid > 0) {
+        /* Never signal kernel tasks or the init task. A zombie can still
+         * be signalled, it is simply ignored. */
+        task = lookup_pid(pid);
+        if(!task || task->type == TASK_KERN || task->pid == 1)
+            return -ESRCH;
+        send_signal(task, sig);
+        return 0;
     }
 
-    /* For all tasks on the system */
+    /* pid is 0 or -1, signal every task on the system */
     for(; task != &kernel_task; task = task->next_task) {
         /* Don't signal yourself (yet), never signal kernel tasks, and
          * never signal the init task either */
         if(task == curr_task || task->type == TASK_KERN || task->pid == 1)
             continue;
-
-        /* Does the pid match? Or we're sending to everyone */
-        if(task->pid == pid || sendtoall) {
-            send_signal(task, sig);
-            sigs_sent++;
-            if(!sendtoall)
-                break; /* They only wanted to send 1 */
-        }
-    }
-
-    /* Now signal yourself */
-    if(curr_task->pid == pid || sendtoall) {
         send_signal(task, sig);
-        sigs_sent++;
     }
 
-    if(sigs_sent == 0)
-        return -ESRCH;
-
+    /* Now signal yourself */
+    send_signal(curr_task, sig);
     return 0;
 }
@@ -1,32 +1,39 @@
 #include <sbunix/syscall.h>
 #include <sbunix/sched.h>
 #include <sbunix/sbunix.h>
+#include <sbunix/interrupt/pit.h>
 
 /**
- * Sleep with nanosecond granularity (limited by PIT frequency)
+ * Sleep with nanosecond granularity (limited by TIMER_HZ)
  *
- * @req: the requested amount of time to sleep
- * @rem: filled in will zeros if it is not NULL. Since we don't have signals
- * a process always sleep for the entire request
+ * @req: the requested amount of time to sleep, rounded up to whole ticks
+ * @rem: if not NULL, filled in with the time left until the deadline.
+ * Since we don't have signals this is always zero.
  */
 int do_nanosleep(const struct timespec *req, struct timespec *rem) {
+    uint64_t left, flags;
+
     if(!req)
         return -EFAULT;
 
     if(req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec > 999999999L)
         return -EINVAL;
 
+    flags = local_irq_save();
+    curr_task->sleep_until = jiffies;
     if(req->tv_sec || req->tv_nsec) {
-        curr_task->sleepts.tv_sec = req->tv_sec;
-        curr_task->sleepts.tv_nsec = req->tv_nsec;
+        curr_task->sleep_until += (uint64_t)req->tv_sec * TIMER_HZ +
+                (uint64_t)(req->tv_nsec + TICK_NSEC - 1) / TICK_NSEC;
         curr_task->state = TASK_SLEEPING;
     }
     schedule();
+    local_irq_restore(flags);
 
     debug("Task %s: waking up from sleep!\n", curr_task->cmdline);
     if(rem) {
-        rem->tv_sec = 0;
-        rem->tv_nsec = 0;
+        left = curr_task->sleep_until > jiffies? curr_task->sleep_until - jiffies : 0;
+        rem->tv_sec = (time_t)(left / TIMER_HZ);
+        rem->tv_nsec = (long)(left % TIMER_HZ) * TICK_NSEC;
     }
     return 0;
 }
@@ -0,0 +1,123 @@
+#include <sbunix/syscall.h>
+#include <sbunix/sched.h>
+#include <sys/resource.h>
+#include <sbunix/interrupt/pit.h>
+#include <sched.h>
+#include <sys/cpuquota.h>
+
+/**
+ * Only PRIO_PROCESS is supported, who == 0 is the calling task.
+ */
+static struct task_struct *prio_task(int who) {
+    if(who == 0)
+        return curr_task;
+    return find_task_by_pid(who);
+}
+
+/**
+ * Like Linux, returns 20 - nice so the result is always positive.
+ */
+int do_getpriority(int which, int who) {
+    struct task_struct *task;
+
+    if(which != PRIO_PROCESS)
+        return -EINVAL;
+    task = prio_task(who);
+    if(!task)
+        return -ESRCH;
+    return 20 - task->nice;
+}
+
+/**
+ * Set the nice value of a task, values outside [-20, 19] are clamped.
+ */
+int do_setpriority(int which, int who, int prio) {
+    struct task_struct *task;
+
+    if(which != PRIO_PROCESS)
+        return -EINVAL;
+    task = prio_task(who);
+    if(!task)
+        return -ESRCH;
+    if(task->type == TASK_KERN && curr_task->type != TASK_KERN)
+        return -EPERM;  /* users can't renice kernel tasks */
+    task_set_nice(task, prio);
+    return 0;
+}
+
+/**
+ * Set the policy and real-time priority of a task, SCHED_FIFO and
+ * SCHED_RR tasks run before all SCHED_OTHER tasks.
+ */
+int do_sched_setscheduler(pid_t pid, int policy, struct sched_param *param) {
+    struct task_struct *task;
+
+    task = prio_task(pid);
+    if(!task)
+        return -ESRCH;
+    if(task->type == TASK_KERN)
+        return -EPERM;  /* kernel tasks are not tick-accounted, see sched_tick */
+    return sched_setscheduler_task(task, policy, param->sched_priority);
+}
+
+/**
+ * Change only the real-time priority, keeping the policy.
+ */
+int do_sched_setparam(pid_t pid, struct sched_param *param) {
+    struct task_struct *task;
+
+    task = prio_task(pid);
+    if(!task)
+        return -ESRCH;
+    if(task->type == TASK_KERN)
+        return -EPERM;
+    return sched_setscheduler_task(task, task->policy, param->sched_priority);
+}
+
+int do_sched_getscheduler(pid_t pid) {
+    struct task_struct *task;
+
+    task = prio_task(pid);
+    if(!task)
+        return -ESRCH;
+    return task->policy;
+}
+
+int do_sched_getparam(pid_t pid, struct sched_param *param) {
+    struct task_struct *task;
+
+    task = prio_task(pid);
+    if(!task)
+        return -ESRCH;
+    param->sched_priority = task->rt_priority;
+    return 0;
+}
+
+/**
+ * Get and/or set the CPU quota of a task, the kernel keeps it in ticks.
+ */
+int do_cpuquota(pid_t pid, const struct cpu_quota *set, struct cpu_quota *old) {
+    struct task_struct *task;
+
+    task = prio_task(pid);
+    if(!task)
+        return -ESRCH;
+    if(set) {
+        if(set->period_ms < CPUQUOTA_PERIOD_MIN ||
+                set->period_ms > CPUQUOTA_PERIOD_MAX ||
+                set->quota_ms > set->period_ms)
+            return -EINVAL;
+        if(task->type == TASK_KERN)
+            return -EPERM;
+    }
+    if(old) {
+        old->quota_ms = task->quota * 1000 / TIMER_HZ;
+        old->period_ms = task->quota_period * 1000 / TIMER_HZ;
+    }
+    if(set) {
+        /* Round a tiny quota up to one tick, 0 stays "no limit" */
+        task_set_quota(task, set->quota_ms? (set->quota_ms * TIMER_HZ + 999) / 1000 : 0,
+                       set->period_ms * TIMER_HZ / 1000);
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <sbunix/syscall.h>
+#include <sbunix/sched.h>
+#include <sbunix/schedstat.h>
+#include <sbunix/string.h>
+#include <sbunix/interrupt/pit.h>
+
+/**
+ * Args have been error checked.
+ * @pid: the task to read, 0 for the system wide statistics
+ * @stat: filled in with the statistics
+ */
+int do_schedstat(pid_t pid, struct schedstat *stat) {
+    struct task_struct *task;
+    uint64_t flags;
+
+    if(pid < 0)
+        return -EINVAL;
+
+    /* Wakeups from interrupts update the statistics too */
+    flags = local_irq_save();
+    if(pid == 0) {
+        memcpy(stat, &sched_stats, sizeof(*stat));
+    } else {
+        task = find_task_by_pid(pid);
+        if(!task) {
+            local_irq_restore(flags);
+            return -ESRCH;
+        }
+        memset(stat, 0, sizeof(*stat));
+        stat->wakeup = task->sched_info.wakeup;
+        stat->runwait = task->sched_info.runwait;
+        stat->slice = task->sched_info.slice;
+    }
+    local_irq_restore(flags);
+    stat->tsc_khz = tsc_khz;
+    return 0;
+}
@@ -4,17 +4,23 @@
 #include <sbunix/gdt.h>
 #include <sbunix/sbunix.h>
 #include <sbunix/sched.h>
+#include <sbunix/preempt.h>
+#include <sbunix/cputime.h>
+#include <sbunix/smp.h>
 #include <sbunix/mm/vmm.h>
+#include <sched.h>
+#include <sys/futex.h>
 
 /* 9th bit in the RFLAGS is the IF bit */
 #define RFLAGS_IF   1<<9
 
+/* Flags clone() understands, the low byte is the exit signal (ignored) */
+#define CLONE_SIGNAL_MASK   0xff
+#define CLONE_SUPPORTED     (CLONE_VM | CLONE_FILES | CLONE_SETTLS)
+
 /* From syscall_entry.s */
 extern void syscall_entry(void);
 
-uint64_t syscall_user_rsp = 0;
-uint64_t syscall_kernel_rsp = 0;
-
 /**
  * Enable syscalls on Intel/AMD x86_64 architecture.
  */
@@ -33,7 +39,7 @@ void enable_syscalls(void) {
     //debug("Write LSTAR <-- %lx\n", (uint64_t)syscall_entry);
     wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
 
-    /* We want interrupts off in the kernel */
+    /* Interrupts stay off until syscall_dispatch() has the kernel lock */
     wrmsr(MSR_SFMASK, RFLAGS_IF);
 }
 
@@ -51,6 +57,30 @@ pid_t sys_fork(void) {
     return do_fork();
 }
 
+/**
+ * A thread (CLONE_VM) needs its own stack, and the TLS pointer must be a
+ * canonical user address since it is loaded into the FS base.
+ */
+pid_t sys_clone(unsigned long clone_flags, void *newsp, uint64_t tls) {
+    clone_flags &= ~CLONE_SIGNAL_MASK;
+    if(clone_flags & ~CLONE_SUPPORTED)
+        return -EINVAL;
+    if((clone_flags & CLONE_VM) && !newsp)
+        return -EINVAL;
+    if((clone_flags & CLONE_SETTLS) && (tls >> 47))
+        return -EPERM;
+    return do_clone((int)clone_flags, (uint64_t)newsp, tls);
+}
+
+int sys_arch_prctl(int code, uint64_t addr) {
+    return do_arch_prctl(code, addr);
+}
+
+int sys_sched_yield(void) {
+    sched_yield_curr();
+    return 0;
+}
+
 pid_t sys_getpid(void) {
     return curr_task->pid;
 }
@@ -64,7 +94,7 @@ pid_t sys_getppid(void) {
 
 long sys_execve(char *filename, const char **argv, const char **envp) {
     /* TODO: validate unbounded pointers ???? */
-    return do_execve(filename, argv, envp, 0);
+    return do_execve(filename, argv, envp);
 }
 
 pid_t sys_wait4(pid_t pid, int *status, int options, struct rusage *rusage) {
@@ -103,6 +133,42 @@ int sys_nanosleep(const struct timespec *req, struct timespec *rem) {
     return do_nanosleep(req, rem);
 }
 
+int sys_clock_gettime(clockid_t clk, struct timespec *tp) {
+    int err;
+
+    err = valid_userptr_write(curr_task->mm, tp, sizeof(struct timespec));
+    if(err)
+        return err;
+    return do_clock_gettime(clk, tp);
+}
+
+int sys_gettimeofday(struct timeval *tv, void *tz) {
+    int err;
+
+    err = valid_userptr_write(curr_task->mm, tv, sizeof(struct timeval));
+    if(err)
+        return err;
+    return do_gettimeofday(tv, tz);
+}
+
+long sys_futex(uint32_t *uaddr, int op, uint32_t val,
+               const struct timespec *timeout) {
+    int err;
+
+    err = valid_userptr_write(curr_task->mm, uaddr, sizeof(*uaddr));
+    if(err)
+        return err;
+    /* timeout is only read by FUTEX_WAIT */
+    if(timeout && (op & ~FUTEX_PRIVATE_FLAG) == FUTEX_WAIT) {
+        err = valid_userptr_read(curr_task->mm, timeout, sizeof(struct timespec));
+        if(err)
+            return err;
+    } else {
+        timeout = NULL;
+    }
+    return do_futex(uaddr, op, val, timeout);
+}
+
 unsigned int sys_alarm(unsigned int seconds)  {
     return 0;
 }
@@ -221,10 +287,95 @@ ssize_t sys_getprocs(void *procbuf, size_t length) {
     return do_getprocs(procbuf, length);
 }
 
+int sys_getpriority(int which, int who) {
+    return do_getpriority(which, who);
+}
+
+int sys_setpriority(int which, int who, int prio) {
+    return do_setpriority(which, who, prio);
+}
+
+int sys_sched_setscheduler(pid_t pid, int policy, struct sched_param *param) {
+    int err;
+    if(!param)
+        return -EINVAL;
+    err = valid_userptr_read(curr_task->mm, param, sizeof(struct sched_param));
+    if(err)
+        return err;
+    return do_sched_setscheduler(pid, policy, param);
+}
+
+int sys_sched_setparam(pid_t pid, struct sched_param *param) {
+    int err;
+    if(!param)
+        return -EINVAL;
+    err = valid_userptr_read(curr_task->mm, param, sizeof(struct sched_param));
+    if(err)
+        return err;
+    return do_sched_setparam(pid, param);
+}
+
+int sys_sched_getscheduler(pid_t pid) {
+    return do_sched_getscheduler(pid);
+}
+
+int sys_sched_getparam(pid_t pid, struct sched_param *param) {
+    int err;
+    if(!param)
+        return -EINVAL;
+    err = valid_userptr_write(curr_task->mm, param, sizeof(struct sched_param));
+    if(err)
+        return err;
+    return do_sched_getparam(pid, param);
+}
+
+int sys_cpuquota(pid_t pid, struct cpu_quota *set, struct cpu_quota *old) {
+    int err;
+    if(set) {
+        err = valid_userptr_read(curr_task->mm, set, sizeof(struct cpu_quota));
+        if(err)
+            return err;
+    }
+    if(old) {
+        err = valid_userptr_write(curr_task->mm, old, sizeof(struct cpu_quota));
+        if(err)
+            return err;
+    }
+    return do_cpuquota(pid, set, old);
+}
+
+int sys_getrusage(int who, struct rusage *usage) {
+    int err;
+    if(!usage)
+        return -EFAULT;
+    err = valid_userptr_write(curr_task->mm, usage, sizeof(struct rusage));
+    if(err)
+        return err;
+    return do_getrusage(who, usage);
+}
+
+int sys_schedstat(pid_t pid, struct schedstat *stat) {
+    int err;
+    if(!stat)
+        return -EFAULT;
+    err = valid_userptr_write(curr_task->mm, stat, sizeof(struct schedstat));
+    if(err)
+        return err;
+    return do_schedstat(pid, stat);
+}
+
+int sys_schedclass(int class_id) {
+    return sched_set_class(class_id);
+}
+
 int64_t syscall_dispatch(int64_t a1, int64_t a2, int64_t a3,
                          int64_t a4, int64_t a5, int64_t a6, int64_t sysnum) {
     int64_t rv;
+    lock_kernel();
+    account_user_time(curr_task);
+    preempt_disable(); /* only at preemption points, see <sbunix/preempt.h> */
     curr_task->in_syscall = 1; /* set syscall flag */
+    sti();
     debug("Doing a syscall: %d, pid: %d\n", sysnum, (int)curr_task->pid);
     switch(sysnum) {
         case SYS_read:
@@ -264,6 +415,16 @@ int64_t syscall_dispatch(int64_t a1, int64_t a2, int64_t a3,
         case SYS_nanosleep:
             rv = sys_nanosleep((const struct timespec *)a1, (struct timespec *)a2);
             break;
+        case SYS_clock_gettime:
+            rv = sys_clock_gettime((clockid_t)a1, (struct timespec *)a2);
+            break;
+        case SYS_gettimeofday:
+            rv = sys_gettimeofday((struct timeval *)a1, (void *)a2);
+            break;
+        case SYS_futex:
+            rv = sys_futex((uint32_t *)a1, (int)a2, (uint32_t)a3,
+                           (const struct timespec *)a4);
+            break;
         case SYS_alarm:
             rv = sys_alarm((unsigned int)a1);
             break;
@@ -273,6 +434,16 @@ int64_t syscall_dispatch(int64_t a1, int64_t a2, int64_t a3,
         case SYS_fork:
             rv = sys_fork();
             break;
+        case SYS_clone:
+            /* Linux order: flags, newsp, parent_tid, child_tid, tls */
+            rv = sys_clone((unsigned long)a1, (void *)a2, (uint64_t)a5);
+            break;
+        case SYS_arch_prctl:
+            rv = sys_arch_prctl((int)a1, (uint64_t)a2);
+            break;
+        case SYS_sched_yield:
+            rv = sys_sched_yield();
+            break;
         case SYS_execve:
             rv = sys_execve((char *)a1, (const char **)a2, (const char **)a3);
             break;
@@ -304,9 +475,51 @@ int64_t syscall_dispatch(int64_t a1, int64_t a2, int64_t a3,
         case SYS_getprocs:
             rv = sys_getprocs((void*)a1, (size_t)a2);
             break;
+        case SYS_getpriority:
+            rv = sys_getpriority((int)a1, (int)a2);
+            break;
+        case SYS_setpriority:
+            rv = sys_setpriority((int)a1, (int)a2, (int)a3);
+            break;
+        case SYS_schedclass:
+            rv = sys_schedclass((int)a1);
+            break;
+        case SYS_sched_setscheduler:
+            rv = sys_sched_setscheduler((pid_t)a1, (int)a2,
+                                        (struct sched_param *)a3);
+            break;
+        case SYS_sched_setparam:
+            rv = sys_sched_setparam((pid_t)a1, (struct sched_param *)a2);
+            break;
+        case SYS_sched_getscheduler:
+            rv = sys_sched_getscheduler((pid_t)a1);
+            break;
+        case SYS_sched_getparam:
+            rv = sys_sched_getparam((pid_t)a1, (struct sched_param *)a2);
+            break;
+        case SYS_cpuquota:
+            rv = sys_cpuquota((pid_t)a1, (struct cpu_quota *)a2,
+                              (struct cpu_quota *)a3);
+            break;
+        case SYS_schedstat:
+            rv = sys_schedstat((pid_t)a1, (struct schedstat *)a2);
+            break;
+        case SYS_getrusage:
+            rv = sys_getrusage((int)a1, (struct rusage *)a2);
+            break;
         default: rv = -ENOSYS;
     }
     debug("Did a syscall: %d, pid: %d, rv: %ld\n", sysnum, (int)curr_task->pid, rv);
+    cli(); /* until sysretq */
     curr_task->in_syscall = 0;  /* reset syscall flag */
+    /* Killed by another CPU or an interrupt while we were in the kernel */
+    if(curr_task->killed)
+        kill_curr_task(curr_task->exit_code);
+    preempt_enable();
+    /* The tick asked for a reschedule while we were in the kernel */
+    if(curr_task->need_resched)
+        schedule();
+    account_system_time(curr_task);
+    unlock_kernel();
     return rv;
 }
@@ -1,18 +1,19 @@
-# To manually save the current user stack
-.global syscall_user_rsp
-
-# To manually restore the current task's kernel stack
-.global syscall_kernel_rsp
+# Offsets into struct cpu (include/sbunix/smp.h), %gs points at it in the
+# kernel. The user stack is saved in it and the task's kernel stack loaded
+# from it.
+.set CPU_USER_RSP, 8
+.set CPU_KERNEL_RSP, 16
 
 # The C syscall dispather (sys/syscall/syscall_dispatch.c)
 .global syscall_dispatch
 
 #
 # Entry point for the syscall instruction.
+#   0. Switch to the kernel's GS base
 #   1. Save user stack
 #   2. Restore kernel stack
 #   3. Call syscall_dispatch to handler the syscall
-#   4. Return to user
+#   4. Return to user, switching back to the user's GS base
 #
 # Register setup:
 # rax       system call number
@@ -28,9 +29,10 @@
 #
 .global syscall_entry
 syscall_entry:
-    movq %rsp, syscall_user_rsp     # save user stack
-    movq (syscall_kernel_rsp), %rsp # restore task's kernel stack
-    pushq (syscall_user_rsp)        # save user rsp on kernel stack
+    swapgs                          # %gs now points at this CPU's struct cpu
+    movq %rsp, %gs:CPU_USER_RSP     # save user stack
+    movq %gs:CPU_KERNEL_RSP, %rsp   # restore task's kernel stack
+    pushq %gs:CPU_USER_RSP          # save user rsp on kernel stack
     pushq %r11                      # save user RFLAGS
     pushq %rcx                      # save user RIP onto kern stack
     movq %r10, %rcx                 # switch syscall convention to SYSV C convention
@@ -56,6 +58,7 @@ syscall_entry:
 # Child returns here from fork, we need to store 0 in rax
 .global child_ret_from_fork
 child_ret_from_fork:
+    call unlock_kernel              # the parent held it when we were copied
     xorq %rax, %rax                 # Child returns 0
 
 restore_and_sysret:
@@ -78,4 +81,5 @@ restore_and_sysret:
     popq %rcx                       # pop user return addr off kern stack
     popq %r11                       # pop user RFLAGS
     popq %rsp                       # restore user stack
+    swapgs                          # back to the user's GS base
     sysretq
@@ -0,0 +1,33 @@
+#include <sbunix/syscall.h>
+#include <sbunix/sbunix.h>
+#include <sbunix/interrupt/pit.h>
+
+/**
+ * Read a clock with nanosecond resolution, from the TSC.
+ * @clk: CLOCK_REALTIME or CLOCK_MONOTONIC
+ * @tp: filled in with the time
+ */
+int do_clock_gettime(clockid_t clk, struct timespec *tp) {
+    uint64_t ns;
+
+    if(clk == CLOCK_REALTIME)
+        ns = clock_realtime_ns();
+    else if(clk == CLOCK_MONOTONIC)
+        ns = clock_monotonic_ns();
+    else
+        return -EINVAL;
+    tp->tv_sec = (time_t)(ns / NSEC_PER_SEC);
+    tp->tv_nsec = (long)(ns % NSEC_PER_SEC);
+    return 0;
+}
+
+/**
+ * The real time in microseconds. There are no time zones, tz is ignored.
+ */
+int do_gettimeofday(struct timeval *tv, void *tz) {
+    uint64_t us = clock_realtime_ns() / 1000;
+
+    tv->tv_sec = (time_t)(us / 1000000);
+    tv->tv_usec = (suseconds_t)(us % 1000000);
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <sbunix/sched.h>
 #include <sbunix/string.h>
 #include <sbunix/sbunix.h>
+#include <sbunix/cputime.h>
 #include <sys/wait.h> /* W* defines */
 
 /**
@@ -16,44 +17,46 @@
  *
  * @status: set to exit status of child, if NULL ignore
  * @options: could only be WNOHANG, or 0
- * @rusage: set usage info (we sent to all 0's), if NULL ignore
+ * @rusage: set to the usage of the child and the children it waited for,
+ *          if NULL ignore
  */
 pid_t do_wait4(pid_t pid, int *status, int options, struct rusage *rusage) {
     struct task_struct *task;
-    int exit_code, childpid, pid_exists = 0;
+    int exit_code, childpid;
     /* Wait for any child? */
     int anychild = pid == 0 || pid == -1;
 
     /* Waiting for children */
     while(1) {
-        /* For each child */
-        for (task = curr_task->chld; task != NULL; task = task->sib) {
-            /* Does a child we were looking for exist? */
-            if (task->pid == pid || anychild) {
-                pid_exists = 1;
-            }
-            /* If it's DEAD and we're looking for it */
-            if (task->state == TASK_DEAD && (task->pid == pid || anychild)) {
-                childpid = task->pid;
-                exit_code = cleanup_child(task);
-                if(status)
-                    *status = exit_code;
-                if(rusage)
-                    memset(rusage, 0, sizeof(*rusage)); /* No usage stats */
-                return childpid;
-            }
+        if(anychild) {
+            if(!curr_task->chld)
+                return (pid_t)-ECHILD;
+            /* The child that died first */
+            task = curr_task->zombies.tasks;
+        } else {
+            /* Does the child we are looking for exist? */
+            task = lookup_pid(pid);
+            if(!task || task->parent != curr_task)
+                return (pid_t)-ECHILD;
+            if(task->rq != &curr_task->zombies)
+                task = NULL; /* still alive */
         }
-        /* Made it through all the children */
-        if(!pid_exists) {
-            /* If we didn't see a valid pid */
-            return (pid_t)-ECHILD;
+        if(task) {
+            childpid = task->pid;
+            acct_add(&task->acct, &task->cacct);
+            acct_add(&curr_task->cacct, &task->acct);
+            if(rusage)
+                acct_to_rusage(&task->acct, rusage);
+            exit_code = cleanup_child(task);
+            if(status)
+                *status = exit_code;
+            return childpid;
         }
         if(options & WNOHANG) {
             /* User doesn't want to wait */
             return 0;
         }
         /* Otherwise actually wait! */
-        curr_task->state = TASK_WAITING;
-        schedule();
+        wait_on(&curr_task->child_exit, TASK_WAITING, 0);
     }
 }
@@ -12,5 +12,8 @@ void test_exec(void);
 void test_terminal(void);
 void test_pipe(void);
 void exec_preemptuser(void);
+void test_sched_queues(void);
+void test_sleep_tick(void);
+void test_idle_wakeups(void);
 
 #endif //_SBUNIX_TEST_H
@@ -10,7 +10,7 @@ void test_exec(void) {
     if(err) {
         kpanic("task_files_init failed: %s\n", strerror(-err));
     }
-    err = do_execve("/bin/sbush", argv, envp, 0);
+    err = do_execve("/bin/sbush", argv, envp);
     if(err) {
         kpanic("do_execve failed: %s\n", strerror(-err));
     }
@@ -7,7 +7,7 @@ void exec_preemptuser(void) {
     if(err) {
         kpanic("task_files_init failed: %s\n", strerror(-err));
     }
-    err = do_execve("/bin/preemptuser", NULL, NULL, 0);
+    err = do_execve("/bin/preemptuser", NULL, NULL);
     if(err) {
         kpanic("do_execve failed: %s\n", strerror(-err));
     }
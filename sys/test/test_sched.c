@@ -0,0 +1,115 @@
+#include "test.h"
+#include "../sched/roundrobin.h"
+#include <sbunix/mm/kmalloc.h>
+#include <sbunix/interrupt/pit.h>
+
+#define NUM_QTASKS 1000
+
+/**
+ * Microbenchmark of the run queue operations with NUM_QTASKS tasks queued.
+ * Prints the average number of cycles per operation.
+ */
+void test_sched_queues(void) {
+    static struct task_struct *tasks[NUM_QTASKS];
+    struct queue q = { .num_tasks = 0, .tasks = NULL, .tail = NULL };
+    uint64_t start, add, rem, pop;
+    int i, n;
+
+    for(n = 0; n < NUM_QTASKS; n++) {
+        tasks[n] = kmalloc(sizeof(struct task_struct));
+        if(!tasks[n])
+            break;
+        tasks[n]->state = TASK_RUNNABLE;
+        tasks[n]->next_rq = tasks[n]->prev_rq = NULL;
+        tasks[n]->rq = NULL;
+    }
+    if(n == 0)
+        return;
+
+    start = read_tsc();
+    for(i = 0; i < n; i++)
+        rr_queue_add(&q, tasks[i]);
+    add = read_tsc() - start;
+
+    /* Remove from the tail end, the worst case for a singly linked list */
+    start = read_tsc();
+    for(i = n - 1; i >= 0; i--)
+        rr_queue_remove(&q, tasks[i]);
+    rem = read_tsc() - start;
+
+    for(i = 0; i < n; i++)
+        rr_queue_add(&q, tasks[i]);
+    start = read_tsc();
+    for(i = 0; i < n; i++)
+        rr_queue_pop(&q);
+    pop = read_tsc() - start;
+
+    if(q.num_tasks != 0 || q.tasks || q.tail)
+        printk("test_sched_queues: queue not empty after pops!\n");
+    printk("rq %d tasks: add %lu, remove %lu, pop %lu cycles/op\n", n,
+           add / n, rem / n, pop / n);
+
+    while(n--)
+        kfree(tasks[n]);
+}
+
+#define SLEEP_TICKS  1000
+#define NUM_SLEEPERS 1000
+
+/**
+ * Cost of the timer tick's sleeper check with n tasks asleep, none due.
+ */
+static void time_sleep_tick(int n) {
+    static struct task_struct *tasks[NUM_SLEEPERS];
+    uint64_t start, cycles;
+    int i;
+
+    for(i = 0; i < n; i++) {
+        tasks[i] = kmalloc(sizeof(struct task_struct));
+        if(!tasks[i])
+            break;
+        tasks[i]->state = TASK_SLEEPING;
+        tasks[i]->rq = NULL;
+        /* Due long after the test is done */
+        tasks[i]->sleep_until = jiffies + 1000000 + i;
+        sleep_add(tasks[i]);
+    }
+    n = i;
+
+    start = read_tsc();
+    for(i = 0; i < SLEEP_TICKS; i++)
+        sleep_wakeup_expired(jiffies);
+    cycles = read_tsc() - start;
+    printk("sleepers %d: %lu cycles/tick\n", n, cycles / SLEEP_TICKS);
+
+    while(n--) {
+        sleep_remove(tasks[n]);
+        kfree(tasks[n]);
+    }
+}
+
+/**
+ * Tick overhead with 1, 100, and 1000 sleeping tasks.
+ */
+void test_sleep_tick(void) {
+    time_sleep_tick(1);
+    time_sleep_tick(100);
+    time_sleep_tick(NUM_SLEEPERS);
+}
+
+/**
+ * Sleep for a few seconds and report how often the idle task woke up.
+ * Run with nothing else runnable, and compare with a -DNOHZ_IDLE=0 build.
+ */
+void test_idle_wakeups(void) {
+    struct timespec ts = {5, 0};
+    uint64_t wakeups, ticks;
+
+    wakeups = idle_wakeups;
+    ticks = jiffies;
+    do_nanosleep(&ts, NULL);
+    wakeups = idle_wakeups - wakeups;
+    ticks = jiffies - ticks;
+    printk("idle: %lu wakeups in %lu ticks, %lu/sec\n", wakeups, ticks,
+           ticks? wakeups * TIMER_HZ / ticks : 0);
+}
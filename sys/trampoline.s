@@ -0,0 +1,85 @@
+#
+# AP startup trampoline, copied to TRAMPOLINE_PHYS by smp_init().
+#
+# A Startup IPI starts each AP in real mode at 0x0800:0000. From there it
+# enables paging with the kernel's page table and goes straight to long
+# mode, then jumps to ap_entry64 at its linked (high) address. smp_init()
+# identity maps low memory while the APs pass through here.
+#
+# The tramp_* values are filled in by smp_init() before the copy.
+#
+
+.set TRAMPOLINE_PHYS, 0x8000   # keep in sync with include/sbunix/smp.h
+.set MSR_EFER, 0xC0000080
+
+.text
+.code16
+.global trampoline_start
+trampoline_start:
+    cli
+    cld
+    movw %cs, %ax
+    movw %ax, %ds                           # data is addressed from 0x8000
+    lgdtl tramp_gdtr - trampoline_start
+
+    movl tramp_cr4 - trampoline_start, %eax
+    movl %eax, %cr4                         # PAE, as on the BSP
+    movl tramp_cr3 - trampoline_start, %eax
+    movl %eax, %cr3                         # the kernel's page table
+    movl $MSR_EFER, %ecx
+    movl tramp_efer - trampoline_start, %eax
+    xorl %edx, %edx
+    wrmsr                                   # LME, NXE as on the BSP
+    movl tramp_cr0 - trampoline_start, %eax
+    movl %eax, %cr0                         # PE and PG together
+    ljmpl $0x08, $(TRAMPOLINE_PHYS + tramp64 - trampoline_start)
+
+.code64
+tramp64:
+    movw $0x10, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %ss
+    movabsq $ap_entry64, %rax
+    jmpq *%rax
+
+.balign 8
+tramp_gdt:
+    .quad 0                                 # NULL descriptor
+    .quad 0x00209A0000000000                # 64-bit code
+    .quad 0x0000920000000000                # data
+tramp_gdtr:
+    .word tramp_gdtr - tramp_gdt - 1
+    .long TRAMPOLINE_PHYS + tramp_gdt - trampoline_start
+
+.global tramp_cr0
+tramp_cr0:  .long 0
+.global tramp_cr3
+tramp_cr3:  .long 0
+.global tramp_cr4
+tramp_cr4:  .long 0
+.global tramp_efer
+tramp_efer: .long 0
+
+.global trampoline_end
+trampoline_end:
+
+#
+# Running at the kernel's address now. Claim a slot in cpus[], switch to
+# the stack smp_init() allocated for it, and call ap_main(id).
+# APs beyond ap_max_id are parked.
+#
+.global ap_entry64
+ap_entry64:
+    movl $1, %eax
+    lock xaddl %eax, ap_next_id(%rip)
+    cmpl ap_max_id(%rip), %eax
+    jae ap_park
+    movq ap_stacks(,%rax,8), %rsp
+    xorq %rbp, %rbp
+    movl %eax, %edi
+    call ap_main
+ap_park:
+    cli
+    hlt
+    jmp ap_park